@@ -0,0 +1,36 @@
+# writes a header holding every file in SHADER_DIR as a byte array, so the renderer can be built to
+# load its shaders from memory (RENDERER_EMBED_SHADERS). run in script mode:
+#   cmake -DSHADER_DIR=<dir> -DOUTPUT=<header> -P EmbedShaders.cmake
+
+file(GLOB SHADERS RELATIVE "${SHADER_DIR}" "${SHADER_DIR}/*")
+list(SORT SHADERS)
+
+set(ARRAYS "")
+set(TABLE "")
+set(INDEX 0)
+foreach(SHADER ${SHADERS})
+    file(READ "${SHADER_DIR}/${SHADER}" HEX HEX)
+    string(LENGTH "${HEX}" DIGITS)
+    math(EXPR SIZE "${DIGITS} / 2")
+
+    # 16 bytes to a line
+    string(REGEX REPLACE "([0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f])" "\\1\n    " HEX "${HEX}")
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1, " BYTES "${HEX}")
+
+    string(APPEND ARRAYS "// ${SHADER}\nstatic const unsigned char EMBEDDED_SHADER_${INDEX}[] = {\n    ${BYTES}0x00\n};\n\n")
+    string(APPEND TABLE "    { \"${SHADER}\", (const char*)EMBEDDED_SHADER_${INDEX}, ${SIZE} },\n")
+    math(EXPR INDEX "${INDEX} + 1")
+endforeach()
+
+set(HEADER "// generated by cmake/EmbedShaders.cmake from src/shaders, do not edit\n")
+string(APPEND HEADER "#ifndef EMBEDDEDSHADERS_H\n#define EMBEDDEDSHADERS_H\n\n")
+string(APPEND HEADER "${ARRAYS}")
+string(APPEND HEADER "struct EmbeddedShader\n{\n    const char *name;\n    const char *data;\n    unsigned int size;\n};\n\n")
+string(APPEND HEADER "static const EmbeddedShader EMBEDDED_SHADERS[] = {\n${TABLE}};\n\n")
+string(APPEND HEADER "static const unsigned int EMBEDDED_SHADER_COUNT = ${INDEX};\n\n#endif\n")
+
+# only touch the header when it changes, so an unrelated reconfigure doesn't rebuild everything
+set(TEMPORARY "${OUTPUT}.tmp")
+file(WRITE "${TEMPORARY}" "${HEADER}")
+execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different "${TEMPORARY}" "${OUTPUT}")
+file(REMOVE "${TEMPORARY}")
@@ -0,0 +1,1656 @@
+// micro benchmarks for the renderer's CPU-side systems, and whole frames of a scene
+// usage: RendererBench <benchmark> [options], run without arguments for the list
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#ifdef RENDERER_BENCH_EGL
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+
+#include <frustum.h>
+#include <bvh.h>
+#include <occlusion.h>
+#include <commandlist.h>
+#include <parallel.h>
+#include <shader.h>
+#include <shadervariants.h>
+#include <clusteredlights.h>
+#include <transforms.h>
+#include <model.h>
+#include <batch.h>
+#include <ringbuffer.h>
+#include <uniformblocks.h>
+#include <shadowmaps.h>
+#include <lightculling.h>
+#include <profiler.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+// ----------------- TIMING -----------------
+// runs the function several times and returns the fastest run in milliseconds
+template<typename Function>
+double bestOf(int runs, Function function)
+{
+    double best = 1e30;
+    for(int i = 0; i < runs; i++)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        function();
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if(elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+void report(const char *name, double ms, unsigned int items, unsigned int result)
+{
+    std::cout << "  " << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(3)
+              << std::setw(10) << ms << " ms  " << std::setw(8) << (ms * 1e6 / items) << " ns/item  "
+              << std::setw(8) << std::setprecision(1) << (items / ms / 1e3) << " M items/s  -> " << result << std::endl;
+}
+
+// ----------------- FRUSTUM CULLING -----------------
+// culls randomly placed boxes around a camera with every kernel the build supports
+int benchCulling(unsigned int count)
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+    std::uniform_real_distribution<float> size(0.1f, 5.0f);
+
+    AABBSoA boxes;
+    boxes.reserve(count);
+    for(unsigned int i = 0; i < count; i++)
+        boxes.Add(glm::vec3(position(rng), position(rng), position(rng)), glm::vec3(size(rng), size(rng), size(rng)));
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 1000.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    CullParams params(projection, view, 0.002f);
+
+    std::vector<unsigned char> reference(count), visible(count);
+    unsigned int visibleCount = 0;
+
+    std::cout << "Frustum culling, " << count << " boxes" << std::endl;
+
+    double ms = bestOf(5, [&]() { visibleCount = CullAABBsScalar(params, boxes, &reference[0]); });
+    report("scalar", ms, count, visibleCount);
+
+    int mismatches = 0;
+#ifdef FRUSTUM_SSE
+    ms = bestOf(5, [&]() { visibleCount = CullAABBsSSE(params, boxes, &visible[0]); });
+    report("sse", ms, count, visibleCount);
+    mismatches += memcmp(&reference[0], &visible[0], count) != 0;
+#endif
+#ifdef FRUSTUM_AVX
+    ms = bestOf(5, [&]() { visibleCount = CullAABBsAVX(params, boxes, &visible[0]); });
+    report("avx", ms, count, visibleCount);
+    mismatches += memcmp(&reference[0], &visible[0], count) != 0;
+#endif
+
+    if(mismatches)
+        std::cout << "  WARNING: SIMD results differ from the scalar reference" << std::endl;
+    return mismatches ? 1 : 0;
+}
+
+// ----------------- BVH -----------------
+// build, refit and frustum query times of the instance BVH, against linear SIMD culling
+int benchBVH(unsigned int count)
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+    std::uniform_real_distribution<float> size(0.1f, 5.0f);
+    std::uniform_real_distribution<float> jitter(-1.0f, 1.0f);
+
+    std::vector<AABB> boxes(count);
+    for(unsigned int i = 0; i < count; i++)
+    {
+        glm::vec3 center(position(rng), position(rng), position(rng));
+        glm::vec3 extent(size(rng), size(rng), size(rng));
+        boxes[i].min = center - extent;
+        boxes[i].max = center + extent;
+    }
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 1000.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    CullParams params(projection, view);
+
+    std::cout << "BVH, " << count << " instances" << std::endl;
+
+    BVH bvh;
+    double ms = bestOf(3, [&]() { bvh.Build(boxes); });
+    report("build", ms, count, bvh.nodes.size());
+
+    // every instance moves a little, then the whole tree is refitted
+    std::vector<AABB> moved(boxes);
+    for(unsigned int i = 0; i < count; i++)
+    {
+        glm::vec3 offset(jitter(rng), jitter(rng), jitter(rng));
+        moved[i].min += offset;
+        moved[i].max += offset;
+    }
+    bvh.boxes = moved;
+    ms = bestOf(3, [&]() { bvh.Refit(); });
+    report("refit", ms, count, bvh.nodes.size());
+
+    // 1% of the instances move, each refitting its own path
+    unsigned int movers = count / 100 > 0 ? count / 100 : 1;
+    ms = bestOf(3, [&]() { for(unsigned int i = 0; i < movers; i++) bvh.Update(i * 100 % count, moved[i * 100 % count]); });
+    report("update 1%", ms, movers, movers);
+
+    std::cout << "  SAH cost after refit is " << std::setprecision(2) << bvh.SAHCost() << ", rebuild " << (bvh.NeedsRebuild() ? "needed" : "not needed") << std::endl;
+
+    // hierarchical query against a linear pass over the same boxes
+    std::vector<unsigned int> visible;
+    unsigned int visited = 0;
+    ms = bestOf(5, [&]() { visible.clear(); visited = bvh.FrustumCull(params.frustum, visible); });
+    report("query", ms, count, visible.size());
+    std::cout << "  visited " << visited << " of " << bvh.nodes.size() << " nodes" << std::endl;
+
+    AABBSoA soa;
+    soa.reserve(count);
+    for(unsigned int i = 0; i < count; i++)
+        soa.Add(moved[i]);
+
+    std::vector<unsigned char> flags(count);
+    unsigned int linearCount = 0;
+    ms = bestOf(5, [&]() { linearCount = CullAABBs(params, soa, &flags[0]); });
+    report("linear", ms, count, linearCount);
+
+    if(linearCount != visible.size())
+    {
+        std::cout << "  WARNING: BVH and linear culling disagree" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// ----------------- OCCLUSION -----------------
+// appends a box as 12 triangles, wound counter-clockwise seen from outside
+void addBoxMesh(const AABB &box, std::vector<glm::vec3> &positions, std::vector<unsigned int> &indices)
+{
+    // faces as corner indices (bit 0 = x, bit 1 = y, bit 2 = z), each with its outward axis
+    static const unsigned int faces[6][4] = { {0, 2, 6, 4}, {1, 3, 7, 5}, {0, 1, 5, 4}, {2, 3, 7, 6}, {0, 1, 3, 2}, {4, 5, 7, 6} };
+    static const float normals[6][3] = { {-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1} };
+
+    unsigned int first = positions.size();
+    for(int i = 0; i < 8; i++)
+        positions.push_back(glm::vec3((i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y, (i & 4) ? box.max.z : box.min.z));
+
+    for(int f = 0; f < 6; f++)
+    {
+        const unsigned int *q = faces[f];
+        glm::vec3 normal = glm::cross(positions[first + q[1]] - positions[first + q[0]], positions[first + q[2]] - positions[first + q[0]]);
+        bool flip = glm::dot(normal, glm::vec3(normals[f][0], normals[f][1], normals[f][2])) < 0.0f;
+
+        unsigned int quad[6] = { q[0], q[1], q[2], q[0], q[2], q[3] };
+        for(int i = 0; i < 6; i += 3)
+        {
+            indices.push_back(first + quad[i]);
+            indices.push_back(first + quad[flip ? i + 2 : i + 1]);
+            indices.push_back(first + quad[flip ? i + 1 : i + 2]);
+        }
+    }
+}
+
+// a street of large occluders in front of many small boxes, culled with the low resolution hierarchical
+// test and with a brute force per-pixel test against a full resolution buffer
+int benchOcclusion(unsigned int count)
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices;
+    for(int i = 0; i < 50; i++)
+    {
+        AABB building;
+        building.min = glm::vec3(-60.0f + unit(rng) * 120.0f, -2.0f, -15.0f - unit(rng) * 60.0f);
+        building.max = building.min + glm::vec3(2.0f + unit(rng) * 8.0f, 4.0f + unit(rng) * 12.0f, 2.0f + unit(rng) * 8.0f);
+        addBoxMesh(building, positions, indices);
+    }
+
+    std::vector<AABB> boxes(count);
+    for(unsigned int i = 0; i < count; i++)
+    {
+        // spread across the view: the horizontal half angle is atan(2 * tan(30 degrees))
+        float z = -10.0f - unit(rng) * 250.0f;
+        glm::vec3 center((unit(rng) * 2.0f - 1.0f) * 1.15f * -z, -2.0f + unit(rng) * 6.0f, z);
+        glm::vec3 extent(0.2f + unit(rng) * 1.5f);
+        boxes[i].min = center - extent;
+        boxes[i].max = center + extent;
+    }
+
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 2.0f, 0.1f, 500.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 viewProjection = projection * view;
+    glm::mat4 identity(1.0f);
+
+    std::cout << "Occlusion culling, " << indices.size() / 3 << " occluder triangles, " << count << " boxes" << std::endl;
+
+    // the occluders are rasterized with one thread and with every hardware thread
+    OcclusionBuffer occlusion(256, 128);
+    std::vector<unsigned int> threadCounts(1, 1);
+    if(HardwareThreads() > 1)
+        threadCounts.push_back(HardwareThreads());
+
+    for(unsigned int t = 0; t < threadCounts.size(); t++)
+    {
+        occlusion.threads = threadCounts[t];
+        double ms = bestOf(10, [&]() {
+            occlusion.Begin(viewProjection);
+            occlusion.AddOccluder(&positions[0], sizeof(glm::vec3), positions.size(), &indices[0], indices.size(), identity);
+            occlusion.Rasterize();
+        });
+        std::string name = "raster x" + std::to_string(threadCounts[t]);
+        report(name.c_str(), ms, occlusion.submittedTriangles, occlusion.rasterizedTriangles);
+    }
+
+    // only boxes inside the frustum are tested, as in the renderer
+    AABBSoA soa;
+    soa.reserve(count);
+    for(unsigned int i = 0; i < count; i++)
+        soa.Add(boxes[i]);
+
+    std::vector<unsigned char> inFrustum;
+    unsigned int frustumCount = CullAABBs(CullParams(projection, view), soa, inFrustum);
+
+    std::vector<unsigned char> visible;
+    unsigned int visibleCount = 0;
+    double ms = bestOf(5, [&]() { visible = inFrustum; visibleCount = occlusion.TestAABBs(boxes, visible); });
+    report("hiz test", ms, frustumCount, visibleCount);
+
+    // reference: 4x the resolution on each axis, and every covered pixel tested
+    OcclusionBuffer reference(1024, 512);
+    ms = bestOf(3, [&]() {
+        reference.Begin(viewProjection);
+        reference.AddOccluder(&positions[0], sizeof(glm::vec3), positions.size(), &indices[0], indices.size(), identity);
+        reference.Rasterize();
+    });
+    report("ref raster", ms, reference.submittedTriangles, reference.rasterizedTriangles);
+
+    std::vector<unsigned char> expected(count);
+    unsigned int expectedCount = 0;
+    ms = bestOf(3, [&]() {
+        expectedCount = 0;
+        for(unsigned int i = 0; i < count; i++)
+            expectedCount += expected[i] = inFrustum[i] && reference.IsVisibleBruteForce(boxes[i]);
+    });
+    report("ref test", ms, frustumCount, expectedCount);
+
+    // false visible boxes only cost a draw; falsely occluded ones would pop
+    unsigned int falseVisible = 0, falseOccluded = 0;
+    for(unsigned int i = 0; i < count; i++)
+    {
+        falseVisible += visible[i] && !expected[i];
+        falseOccluded += !visible[i] && expected[i];
+    }
+
+    unsigned int occluded = frustumCount - expectedCount;
+    std::cout << "  " << frustumCount << " boxes in the frustum, " << occluded << " occluded in the reference, " << falseVisible << " of them kept ("
+              << std::setprecision(1) << (occluded ? 100.0 * falseVisible / occluded : 0.0) << "% false visible), "
+              << falseOccluded << " falsely occluded" << std::endl;
+    if(falseOccluded)
+        std::cout << "  WARNING: the hierarchical test hid boxes the reference sees" << std::endl;
+    return falseOccluded ? 1 : 0;
+}
+
+// ----------------- COMMAND LISTS -----------------
+// stands in for GL when replaying: consumes every command and keeps an order independent checksum
+struct NullBackend
+{
+    unsigned long long checksum;
+    unsigned int draws;
+
+    NullBackend() : checksum(0), draws(0) {}
+
+    void BindProgram(unsigned int id) { checksum += id; }
+    void BindVertexArray(unsigned int id) { checksum += id; }
+    void BindTexture(unsigned int unit, unsigned int id) { checksum += unit + id; }
+    void SetInt(int location, int value) { checksum += location + value; }
+    void SetFloat(int location, float value) { checksum += location + (int)value; }
+    void SetMat3(int location, const glm::mat3 &value) { checksum += location + (int)value[2][2]; }
+    void SetMat4(int location, const glm::mat4 &value) { checksum += location + (int)value[3][0]; }
+    void DrawElements(unsigned int count, unsigned int firstIndex, int baseVertex) { checksum += count + firstIndex + baseVertex; draws++; }
+};
+
+struct BenchObject
+{
+    glm::vec3 position;
+    float radius, spin;
+    unsigned int program, vertexArray, diffuse, specular, indexCount;
+};
+
+// CPU cost of preparing and submitting a frame of draws (cull, build matrices, sort by state, record)
+// with the work split over 1 to N threads; the recorded lists are replayed on one thread as the GL thread would
+int benchCommandLists(unsigned int count, unsigned int maxThreads)
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> position(-200.0f, 200.0f);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    std::vector<BenchObject> objects(count);
+    for(unsigned int i = 0; i < count; i++)
+    {
+        BenchObject &object = objects[i];
+        object.position = glm::vec3(position(rng), position(rng) * 0.1f, position(rng));
+        object.radius = 0.5f + unit(rng) * 2.0f;
+        object.spin = unit(rng) * 6.28f;
+        object.program = 1 + rng() % 4;
+        object.vertexArray = 1 + rng() % 64;
+        object.diffuse = 1 + rng() % 256;
+        object.specular = 257 + rng() % 256;
+        object.indexCount = 36 * (1 + rng() % 100);
+    }
+
+    // wide view so most objects survive culling and the frame is dominated by draw preparation
+    glm::mat4 projection = glm::perspective(glm::radians(120.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 50.0f, 250.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    Frustum frustum(projection * view);
+
+    std::cout << "Command lists, " << count << " objects" << std::endl;
+
+    std::vector<unsigned int> threadCounts;
+    for(unsigned int t = 1; t < maxThreads; t *= 2)
+        threadCounts.push_back(t);
+    threadCounts.push_back(maxThreads);
+
+    double single = 0.0;
+    unsigned long long expected = 0;
+    int result = 0;
+
+    for(unsigned int c = 0; c < threadCounts.size(); c++)
+    {
+        unsigned int threads = threadCounts[c];
+        std::vector<CommandList> lists(threads);
+        std::vector<std::vector<std::pair<unsigned long long, unsigned int> > > sorted(threads);
+        std::vector<glm::mat4> models(count);
+        NullBackend backend;
+        double recordMs = 0.0, replayMs = 0.0;
+
+        double ms = bestOf(10, [&]() {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+            ParallelFor(count, threads, [&](unsigned int begin, unsigned int end, unsigned int thread)
+            {
+                // cull and pack per-object uniforms
+                std::vector<std::pair<unsigned long long, unsigned int> > &visible = sorted[thread];
+                visible.clear();
+                for(unsigned int i = begin; i < end; i++)
+                {
+                    const BenchObject &object = objects[i];
+                    BoundingSphere sphere = { object.position, object.radius };
+                    if(!frustum.IntersectsSphere(sphere))
+                        continue;
+
+                    models[i] = glm::rotate(glm::translate(glm::mat4(1.0f), object.position), object.spin, glm::vec3(0.0f, 1.0f, 0.0f));
+
+                    unsigned long long key = ((unsigned long long)object.program << 48) | ((unsigned long long)object.vertexArray << 32) | object.diffuse;
+                    visible.push_back(std::make_pair(key, i));
+                }
+
+                // state sorted, so the list drops most rebinds
+                std::sort(visible.begin(), visible.end());
+
+                CommandList &list = lists[thread];
+                list.clear();
+                for(unsigned int v = 0; v < visible.size(); v++)
+                {
+                    const BenchObject &object = objects[visible[v].second];
+                    list.BindProgram(object.program);
+                    list.BindVertexArray(object.vertexArray);
+                    list.BindTexture(0, object.diffuse);
+                    list.BindTexture(1, object.specular);
+                    list.SetMat4(0, models[visible[v].second]);
+                    list.DrawElements(object.indexCount);
+                }
+            });
+
+            std::chrono::steady_clock::time_point recorded = std::chrono::steady_clock::now();
+
+            backend = NullBackend();
+            for(unsigned int t = 0; t < lists.size(); t++)
+                lists[t].Replay(backend);
+
+            std::chrono::steady_clock::time_point replayed = std::chrono::steady_clock::now();
+            // breakdown of the fastest frame
+            double record = std::chrono::duration<double, std::milli>(recorded - start).count();
+            double replay = std::chrono::duration<double, std::milli>(replayed - recorded).count();
+            if(recordMs == 0.0 || record + replay < recordMs + replayMs)
+            {
+                recordMs = record;
+                replayMs = replay;
+            }
+        });
+
+        size_t bytes = 0;
+        unsigned int commands = 0;
+        for(unsigned int t = 0; t < lists.size(); t++)
+        {
+            bytes += lists[t].data.size();
+            commands += lists[t].commands;
+        }
+
+        if(c == 0)
+            single = ms;
+
+        std::string name = "x" + std::to_string(threads);
+        report(name.c_str(), ms, count, backend.draws);
+        std::cout << "             record " << std::setprecision(3) << recordMs << " ms, replay " << replayMs << " ms, "
+                  << commands << " commands in " << bytes / 1024 << " KB, speedup " << std::setprecision(2) << single / ms << "x" << std::endl;
+
+        // the draws are the same whatever the split, only their order within a list changes
+        unsigned long long drawSum = 0;
+        for(unsigned int i = 0; i < count; i++)
+        {
+            BoundingSphere sphere = { objects[i].position, objects[i].radius };
+            if(frustum.IntersectsSphere(sphere))
+                drawSum++;
+        }
+        if(backend.draws != drawSum)
+        {
+            std::cout << "  WARNING: " << backend.draws << " draws replayed, " << drawSum << " expected" << std::endl;
+            result = 1;
+        }
+        if(c == 0)
+            expected = backend.draws;
+        else if(backend.draws != expected)
+            result = 1;
+    }
+    return result;
+}
+
+// ----------------- CLUSTERED LIGHTS -----------------
+// bins randomly placed point lights into the cluster grid with every kernel the build supports, then builds
+// the full light lists; every light reaching a random point in the view must be listed in that point's cluster
+int benchLights(unsigned int count)
+{
+    const unsigned int width = 1280, height = 720;
+    const float zNear = 0.1f, zFar = 100.0f;
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> across(-40.0f, 40.0f);
+    std::uniform_real_distribution<float> depth(-95.0f, 0.0f);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    std::vector<LocalLight> lights(count);
+    for(unsigned int i = 0; i < count; i++)
+    {
+        lights[i].position = glm::vec3(across(rng), across(rng), depth(rng));
+        lights[i].diffuse = glm::vec3(unit(rng), unit(rng), unit(rng));
+        lights[i].specular = lights[i].diffuse * 0.5f;
+        lights[i].spot = i % 4 == 0;
+    }
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)width / height, zNear, zFar);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    ClusteredLights clustered;
+    clustered.Build(lights, projection, view, width, height, zNear, zFar);
+
+    std::vector<ClusterRange> reference(count), ranges(count);
+    unsigned int inView = 0;
+
+    std::cout << "Clustered lights, " << count << " lights, " << ClusterParams::CLUSTERS << " clusters" << std::endl;
+
+    double ms = bestOf(5, [&]() { inView = BinLightsScalar(clustered.params, clustered.spheres, &reference[0]); });
+    report("scalar", ms, count, inView);
+
+    int mismatches = 0;
+#ifdef FRUSTUM_SSE
+    ms = bestOf(5, [&]() { inView = BinLightsSSE(clustered.params, clustered.spheres, &ranges[0]); });
+    report("sse", ms, count, inView);
+    for(unsigned int i = 0; i < count; i++)
+        mismatches += reference[i].minX <= reference[i].maxX && memcmp(&reference[i], &ranges[i], sizeof(ClusterRange)) != 0;
+#endif
+#ifdef FRUSTUM_AVX
+    ms = bestOf(5, [&]() { inView = BinLightsAVX(clustered.params, clustered.spheres, &ranges[0]); });
+    report("avx", ms, count, inView);
+    for(unsigned int i = 0; i < count; i++)
+        mismatches += reference[i].minX <= reference[i].maxX && memcmp(&reference[i], &ranges[i], sizeof(ClusterRange)) != 0;
+#endif
+
+    // everything a frame does on the CPU: bounds, binning and the compacted lists (-> list entries)
+    ms = bestOf(5, [&]() { clustered.Build(lights, projection, view, width, height, zNear, zFar); });
+    report("build", ms, count, clustered.lightIndices.size());
+
+    std::cout << "  " << clustered.lightsInView << " lights in view, " << std::setprecision(1)
+              << (clustered.occupiedClusters ? (float)clustered.lightIndices.size() / clustered.occupiedClusters : 0.0f)
+              << " per lit cluster (at most " << clustered.maxClusterLights << ") against " << clustered.lightsInView
+              << " per fragment unclustered" << std::endl;
+
+    // random points in the view frustum, looked up the way the shaders do
+    std::mt19937 pointRng(5678);
+    glm::mat4 inverseProjection = glm::inverse(projection);
+    unsigned int missed = 0, points = 100000;
+    for(unsigned int p = 0; p < points; p++)
+    {
+        float windowX = unit(pointRng) * width, windowY = unit(pointRng) * height;
+        float pointDepth = zNear * powf(zFar / zNear, unit(pointRng));
+
+        // the view space point on the ray through the window position at that depth
+        glm::vec4 ray = inverseProjection * glm::vec4(windowX / width * 2.0f - 1.0f, windowY / height * 2.0f - 1.0f, 1.0f, 1.0f);
+        glm::vec3 direction = glm::vec3(ray) / ray.w;
+        glm::vec3 point = direction * (pointDepth / -direction.z);
+
+        glm::uvec2 list = clustered.clusterLights[clustered.ClusterAt(windowX, windowY, pointDepth)];
+        for(unsigned int i = 0; i < count; i++)
+        {
+            if(glm::length(lights[i].position - point) >= clustered.spheres.radius[i])
+                continue;
+
+            // the lights in view keep their order when packed, so the packed index is the number of earlier ones
+            unsigned int packed = 0;
+            for(unsigned int j = 0; j < i; j++)
+                packed += clustered.ranges[j].minX <= clustered.ranges[j].maxX;
+
+            bool listed = clustered.ranges[i].minX <= clustered.ranges[i].maxX;
+            for(unsigned int e = 0; listed && e < list.y && clustered.lightIndices[list.x + e] != packed; e++)
+                listed = e + 1 < list.y;
+            missed += !listed;
+        }
+    }
+
+    if(mismatches)
+        std::cout << "  WARNING: SIMD results differ from the scalar reference" << std::endl;
+    if(missed)
+        std::cout << "  WARNING: " << missed << " lights reaching a point missing from its cluster" << std::endl;
+    return mismatches || missed ? 1 : 0;
+}
+
+// ----------------- TRANSFORMS -----------------
+// per-object model view projection and normal matrices with every kernel the build supports, checked against
+// glm's general inverse, which is what the vertex shaders used to run for every vertex
+int benchTransforms(unsigned int count)
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> position(-200.0f, 200.0f);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    // translated, rotated and non-uniformly scaled, so the normal matrix isn't just the rotation
+    std::vector<glm::mat4> models(count);
+    for(unsigned int i = 0; i < count; i++)
+    {
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(position(rng), position(rng), position(rng)));
+        model = glm::rotate(model, unit(rng) * 6.28f, glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + 0.01f));
+        models[i] = glm::scale(model, glm::vec3(0.5f + unit(rng) * 2.0f, 0.5f + unit(rng) * 2.0f, 0.5f + unit(rng) * 2.0f));
+    }
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+    glm::mat4 viewProjection = projection * glm::lookAt(glm::vec3(0.0f, 50.0f, 250.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    std::vector<ObjectTransform> reference(count), transforms(count);
+
+    std::cout << "Object transforms, " << count << " objects" << std::endl;
+
+    // what the shaders did, per object instead of per vertex
+    double ms = bestOf(5, [&]() {
+        for(unsigned int i = 0; i < count; i++)
+        {
+            reference[i].modelViewProjection = viewProjection * models[i];
+            reference[i].model = models[i];
+            reference[i].normal = glm::mat4(glm::transpose(glm::inverse(glm::mat3(models[i]))));
+        }
+    });
+    report("glm", ms, count, count);
+
+    // largest difference from the reference, relative to the largest element of each matrix
+    auto compare = [&]() -> float
+    {
+        float worst = 0.0f;
+        for(unsigned int i = 0; i < count; i++)
+        {
+            const glm::mat4 *expected[2] = { &reference[i].modelViewProjection, &reference[i].normal };
+            const glm::mat4 *computed[2] = { &transforms[i].modelViewProjection, &transforms[i].normal };
+            for(int m = 0; m < 2; m++)
+            {
+                float scale = 1e-6f, error = 0.0f;
+                for(int c = 0; c < 4; c++)
+                    for(int r = 0; r < 4; r++)
+                    {
+                        scale = std::max(scale, fabsf((*expected[m])[c][r]));
+                        error = std::max(error, fabsf((*expected[m])[c][r] - (*computed[m])[c][r]));
+                    }
+                worst = std::max(worst, error / scale);
+            }
+        }
+        return worst;
+    };
+
+    float worst = 0.0f;
+    ms = bestOf(5, [&]() { ComputeTransformsScalar(viewProjection, &models[0], count, &transforms[0]); });
+    report("scalar", ms, count, count);
+    worst = std::max(worst, compare());
+#ifdef FRUSTUM_SSE
+    ms = bestOf(5, [&]() { ComputeTransformsSSE(viewProjection, &models[0], count, &transforms[0]); });
+    report("sse", ms, count, count);
+    worst = std::max(worst, compare());
+#endif
+#ifdef FRUSTUM_AVX
+    ms = bestOf(5, [&]() { ComputeTransformsAVX(viewProjection, &models[0], count, &transforms[0]); });
+    report("avx", ms, count, count);
+    worst = std::max(worst, compare());
+#endif
+
+    std::cout << "  largest relative error against glm: " << std::scientific << std::setprecision(2) << worst << std::fixed << std::endl;
+    if(worst > 1e-4f)
+        std::cout << "  WARNING: kernels differ from the reference" << std::endl;
+    return worst > 1e-4f ? 1 : 0;
+}
+
+// ----------------- GL CONTEXT -----------------
+// whether the GL benchmarks run without a window system (--headless), e.g. on build machines with Mesa's
+// llvmpipe and no display or GPU
+bool headless = false;
+
+void contextHints()
+{
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+}
+
+// GLFW's null platform has no window system at all; its contexts come from OSMesa
+bool createNullPlatformContext()
+{
+    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+    if(!glfwInit())
+        return false;
+
+    contextHints();
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+    GLFWwindow *window = glfwCreateWindow(64, 64, "RendererBench", NULL, NULL);
+    if(window == NULL)
+    {
+        glfwTerminate();
+        return false;
+    }
+
+    glfwMakeContextCurrent(window);
+    return gladLoadGLLoader((GLADloadproc)glfwGetProcAddress) != 0;
+}
+
+#ifdef RENDERER_BENCH_EGL
+// a surfaceless EGL context, for Mesa builds without OSMesa: no surface, so no default framebuffer either
+bool createSurfacelessContext()
+{
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if(!getPlatformDisplay)
+        return false;
+
+    EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if(display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL) || !eglBindAPI(EGL_OPENGL_API))
+        return false;
+
+    // any config will do, none at all where EGL_KHR_no_config_context allows it
+    EGLint configAttributes[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+    EGLConfig config;
+    EGLint configs = 0;
+    eglChooseConfig(display, configAttributes, &config, 1, &configs);
+
+    EGLint contextAttributes[] = { EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+                                   EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE };
+    EGLContext context = eglCreateContext(display, configs ? config : EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttributes);
+    if(context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        return false;
+
+    return gladLoadGLLoader((GLADloadproc)eglGetProcAddress) != 0;
+}
+#endif
+
+// a hidden window, for the benchmarks that have to call into the driver; headless, a context without one
+bool createContext()
+{
+    if(headless)
+    {
+        bool created = createNullPlatformContext();
+#ifdef RENDERER_BENCH_EGL
+        if(!created)
+            created = createSurfacelessContext();
+#endif
+        if(!created)
+        {
+            std::cout << "Failed to create a headless GL context, it needs OSMesa or surfaceless EGL" << std::endl;
+            return false;
+        }
+    }
+    else
+    {
+        if(!glfwInit())
+        {
+            std::cout << "Failed to initialize GLFW" << std::endl;
+            return false;
+        }
+
+        contextHints();
+        GLFWwindow *window = glfwCreateWindow(64, 64, "RendererBench", NULL, NULL);
+        if(window == NULL)
+        {
+            std::cout << "Failed to create a GL context" << std::endl;
+            glfwTerminate();
+            return false;
+        }
+
+        glfwMakeContextCurrent(window);
+        if(!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            glfwTerminate();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// ----------------- UNIFORMS -----------------
+// cost of a uniform setter looking its location up through the driver every call, as Shader used to,
+// against the locations cached from reflection at link time
+int benchUniforms(unsigned int calls)
+{
+    if(!createContext())
+        return 1;
+
+    Shader shader("modelShader.vs", "modelShader.fs");
+    shader.use();
+
+    std::string shininess = "material.shininess";
+    glm::mat4 model(1.0f);
+
+    // uniforms every permutation reads, so none of the setters below land on a location the compiler dropped
+    if(shader.uniformLocation("material.shininess") < 0 || shader.uniformLocation("modelViewProjection") < 0)
+    {
+        std::cout << "modelShader lacks material.shininess or modelViewProjection" << std::endl;
+        glfwTerminate();
+        return 1;
+    }
+
+    std::cout << "Uniform setters, " << calls << " calls, " << glGetString(GL_RENDERER) << std::endl;
+
+    double ms = bestOf(5, [&]() {
+        for(unsigned int i = 0; i < calls; i++)
+            glUniform1f(glGetUniformLocation(shader.ID, std::string("material.shininess").c_str()), (float)i);
+        glFinish();
+    });
+    report("old float", ms, calls, calls);
+
+    ms = bestOf(5, [&]() {
+        for(unsigned int i = 0; i < calls; i++)
+            shader.setFloat(shininess, (float)i);
+        glFinish();
+    });
+    report("str float", ms, calls, calls);
+
+    ms = bestOf(5, [&]() {
+        for(unsigned int i = 0; i < calls; i++)
+            shader.setFloat("material.shininess", (float)i);
+        glFinish();
+    });
+    report("lit float", ms, calls, calls);
+
+    // the floor: the location already in hand
+    int location = shader.uniformLocation("material.shininess");
+    ms = bestOf(5, [&]() {
+        for(unsigned int i = 0; i < calls; i++)
+            glUniform1f(location, (float)i);
+        glFinish();
+    });
+    report("raw float", ms, calls, calls);
+
+    ms = bestOf(5, [&]() {
+        for(unsigned int i = 0; i < calls; i++)
+        {
+            model[3][0] = (float)i;
+            glUniformMatrix4fv(glGetUniformLocation(shader.ID, std::string("modelViewProjection").c_str()), 1, GL_FALSE, glm::value_ptr(model));
+        }
+        glFinish();
+    });
+    report("old mat4", ms, calls, calls);
+
+    ms = bestOf(5, [&]() {
+        for(unsigned int i = 0; i < calls; i++)
+        {
+            model[3][0] = (float)i;
+            shader.setMat4("modelViewProjection", model);
+        }
+        glFinish();
+    });
+    report("lit mat4", ms, calls, calls);
+
+    // the same value every call: after the first, the shadow copy skips the upload (-> uploads issued)
+    Shader::uniformCalls() = 0;
+    ms = bestOf(5, [&]() {
+        for(unsigned int i = 0; i < calls; i++)
+            shader.setFloat("material.shininess", 32.0f);
+        glFinish();
+    });
+    report("same float", ms, calls, Shader::uniformCalls());
+
+    model[3][0] = -1.0f; // not the value last uploaded, so the first call goes through
+    Shader::uniformCalls() = 0;
+    ms = bestOf(5, [&]() {
+        for(unsigned int i = 0; i < calls; i++)
+            shader.setMat4("modelViewProjection", model);
+        glFinish();
+    });
+    report("same mat4", ms, calls, Shader::uniformCalls());
+
+    glfwTerminate();
+    return 0;
+}
+
+// ----------------- PROGRAM BINARY CACHE -----------------
+// builds every program the renderer uses, once compiling from source (a cold cache, which is then
+// written) and once loading the binaries back (a warm cache)
+int benchPrograms()
+{
+    if(!createContext())
+        return 1;
+
+    static const char *programs[][2] = {
+        { "modelShader.vs", "modelShader.fs" },
+        { "modelShaderIndirect.vs", "modelShader.fs" },
+        { "shader.vs", "shader.fs" },
+        { "light.vs", "light.fs" },
+        { "depth.vs", "depth.fs" },
+        { "boundingBox.vs", "boundingBox.fs" }
+    };
+    const unsigned int count = sizeof(programs) / sizeof(programs[0]);
+
+    std::cout << "Program binary cache, " << count << " programs, " << glGetString(GL_RENDERER) << std::endl;
+    if(!ProgramCache::IsSupported())
+    {
+        std::cout << "  program binaries not supported, every start is cold" << std::endl;
+        glfwTerminate();
+        return 1;
+    }
+
+    const char *names[] = { "cold", "warm" };
+    ProgramCache::Mode modes[] = { ProgramCache::CACHE_REFRESH, ProgramCache::CACHE_ENABLED };
+    for(int pass = 0; pass < 2; pass++)
+    {
+        ProgramCache::mode() = modes[pass];
+        ProgramCache::Stats before = ProgramCache::stats();
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for(unsigned int i = 0; i < count; i++)
+        {
+            Shader shader(programs[i][0], programs[i][1]);
+            glDeleteProgram(shader.ID);
+        }
+        glFinish();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        ProgramCache::Stats &after = ProgramCache::stats();
+        std::cout << "  " << std::left << std::setw(10) << names[pass] << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(10) << ms << " ms  " << std::setw(8) << ms / count << " ms/program  -> "
+                  << after.hits - before.hits << " from cache, " << after.misses - before.misses << " compiled, "
+                  << after.saved - before.saved << " saved, " << after.rejected - before.rejected << " rejected" << std::endl;
+    }
+
+    glfwTerminate();
+    return 0;
+}
+
+// ----------------- VERTEX STAGE -----------------
+// the model vertex shader as it was: both matrix products and a 3x3 inverse for every vertex
+static const char *perVertexMatricesShader =
+    "#version 330 core\n"
+    "layout (location = 0) in vec3 aPos;\n"
+    "layout (location = 1) in vec3 aNormal;\n"
+    "layout (location = 2) in vec2 aTexCoords;\n"
+    "uniform mat4 projection;\n"
+    "uniform mat4 view;\n"
+    "uniform mat4 model;\n"
+    "out vec3 Normal;\n"
+    "out vec3 FragPos;\n"
+    "out vec2 TexCoords;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_Position = projection * view * model * vec4(aPos, 1.0);\n"
+    "    TexCoords = aTexCoords;\n"
+    "    FragPos = vec3(model * vec4(aPos, 1.0));\n"
+    "    Normal = mat3(transpose(inverse(model))) * aNormal;\n"
+    "}\n";
+
+// same layout as the renderer's Vertex
+struct GridVertex
+{
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+};
+
+static const char *discardFragmentShader =
+    "#version 330 core\n"
+    "in vec3 Normal;\n"
+    "in vec3 FragPos;\n"
+    "in vec2 TexCoords;\n"
+    "out vec4 FragColor;\n"
+    "void main() { FragColor = vec4(Normal + FragPos, TexCoords.x); }\n";
+
+unsigned int linkProgram(const char *vertexSource, const char *fragmentSource)
+{
+    unsigned int vertex = glCreateShader(GL_VERTEX_SHADER), fragment = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(vertex, 1, &vertexSource, NULL);
+    glShaderSource(fragment, 1, &fragmentSource, NULL);
+    glCompileShader(vertex);
+    glCompileShader(fragment);
+
+    unsigned int program = glCreateProgram();
+    glAttachShader(program, vertex);
+    glAttachShader(program, fragment);
+    glLinkProgram(program);
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+
+    int linked = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    return linked ? program : 0;
+}
+
+// GPU time of the vertex stage over a dense grid mesh, with the matrices built per vertex in the shader
+// against the per-object matrices of modelShader.vs. everything lands in a one pixel viewport, so the time is
+// vertex shading and primitive setup; rasterizer discard would be cleaner, but some drivers then skip the
+// vertex shader altogether
+int benchVertices(unsigned int vertices)
+{
+    if(!createContext())
+        return 1;
+
+    unsigned int side = std::max(2u, (unsigned int)sqrtf((float)vertices));
+    vertices = side * side;
+
+    std::vector<GridVertex> grid(vertices);
+    for(unsigned int y = 0; y < side; y++)
+        for(unsigned int x = 0; x < side; x++)
+        {
+            GridVertex &vertex = grid[y * side + x];
+            vertex.Position = glm::vec3((float)x / side - 0.5f, sinf(x * 0.1f) * cosf(y * 0.1f) * 0.05f, (float)y / side - 0.5f);
+            vertex.Normal = glm::vec3(0.0f, 1.0f, 0.0f);
+            vertex.TexCoords = glm::vec2((float)x / side, (float)y / side);
+        }
+
+    std::vector<unsigned int> indices;
+    indices.reserve((side - 1) * (side - 1) * 6);
+    for(unsigned int y = 0; y + 1 < side; y++)
+        for(unsigned int x = 0; x + 1 < side; x++)
+        {
+            unsigned int corner = y * side + x;
+            unsigned int quad[6] = { corner, corner + side, corner + 1, corner + 1, corner + side, corner + side + 1 };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+
+    unsigned int VAO, buffers[2];
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(2, buffers);
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, grid.size() * sizeof(GridVertex), &grid[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GridVertex), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(GridVertex), (void*)offsetof(GridVertex, Normal));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(GridVertex), (void*)offsetof(GridVertex, TexCoords));
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 1.0f, 1.5f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 model = glm::scale(glm::rotate(glm::mat4(1.0f), 0.3f, glm::vec3(0.0f, 1.0f, 0.0f)), glm::vec3(1.0f, 2.0f, 1.0f));
+
+    unsigned int perVertex = linkProgram(perVertexMatricesShader, discardFragmentShader);
+    glUseProgram(perVertex);
+    glUniformMatrix4fv(glGetUniformLocation(perVertex, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    glUniformMatrix4fv(glGetUniformLocation(perVertex, "view"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(glGetUniformLocation(perVertex, "model"), 1, GL_FALSE, glm::value_ptr(model));
+
+    Shader perObject("modelShader.vs", "modelShader.fs", ShaderDefines().Set("SPECULAR_MAP").Source()); // keeps every output in use
+    ObjectTransform transform;
+    ComputeTransforms(projection * view, &model, 1, &transform);
+    perObject.use();
+    SetTransform(perObject, transform);
+
+    std::cout << "Vertex stage, " << vertices << " vertices, " << indices.size() / 3 << " triangles, " << glGetString(GL_RENDERER) << std::endl;
+    if(!perVertex)
+    {
+        std::cout << "  the per-vertex program failed to build" << std::endl;
+        glfwTerminate();
+        return 1;
+    }
+
+    // a target of its own: a headless context has no default framebuffer, and draws into none are dropped
+    unsigned int FBO, colour;
+    glGenFramebuffers(1, &FBO);
+    glGenRenderbuffers(1, &colour);
+    glBindRenderbuffer(GL_RENDERBUFFER, colour);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, 1, 1);
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colour);
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "  failed to create the render target" << std::endl;
+        glfwTerminate();
+        return 1;
+    }
+
+    unsigned int query;
+    glGenQueries(1, &query);
+    glViewport(0, 0, 1, 1);
+    glDisable(GL_DEPTH_TEST);
+
+    const unsigned int draws = 10;
+    const char *names[2][2] = { { "vtx query", "vtx finish" }, { "obj query", "obj finish" } }; // matrices per vertex / per object
+    unsigned int programs[2] = { perVertex, perObject.ID };
+    double gpuMs[2], finishMs[2];
+    for(int p = 0; p < 2; p++)
+    {
+        glUseProgram(programs[p]);
+        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0); // warm up
+        glFinish();
+
+        // the fastest of several timed draws, by timer query and by the CPU waiting on glFinish
+        // (software renderers may shade at the flush, outside the query)
+        gpuMs[p] = 1e30;
+        for(unsigned int d = 0; d < draws; d++)
+        {
+            glBeginQuery(GL_TIME_ELAPSED, query);
+            glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+            glEndQuery(GL_TIME_ELAPSED);
+
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+            gpuMs[p] = std::min(gpuMs[p], nanoseconds / 1e6);
+        }
+        finishMs[p] = bestOf(draws, [&]() {
+            glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+            glFinish();
+        });
+
+        report(names[p][0], gpuMs[p], vertices, draws);
+        report(names[p][1], finishMs[p], vertices, draws);
+    }
+
+    std::cout << "  per object matrices: vertex stage " << std::setprecision(2) << gpuMs[0] / gpuMs[1] << "x faster by timer query, "
+              << finishMs[0] / finishMs[1] << "x by glFinish" << std::endl;
+
+    glfwTerminate();
+    return 0;
+}
+
+// ----------------- PROFILER -----------------
+// what a CPU zone costs with no capture running and while recording, the frame's collection included.
+// needs a profiler build (RENDERER_PROFILER); otherwise the zones are compiled out and cost nothing
+int benchProfiler(unsigned int zones)
+{
+#ifdef RENDERER_PROFILER
+    if(!createContext())
+        return 1;
+
+    const unsigned int perFrame = 1000;
+    unsigned int frames = max(1u, zones / perFrame);
+    volatile unsigned int work = 0;
+    auto frame = [&]()
+    {
+        for(unsigned int f = 0; f < frames; f++)
+        {
+            for(unsigned int z = 0; z < perFrame; z++)
+            {
+                PROFILE_ZONE("zone");
+                work = work + 1;
+            }
+            PROFILE_FRAME();
+        }
+    };
+
+    std::cout << "Profiler zones, " << frames * perFrame << " zones in " << frames << " frames" << std::endl;
+    double ms = bestOf(3, frame);
+    report("idle", ms, frames * perFrame, 0);
+
+    // a capture of exactly the timed frames, started at the next frame boundary
+    const char *path = "profile_bench.json";
+    PROFILE_CAPTURE(3 * frames, path);
+    PROFILE_FRAME();
+    ms = bestOf(3, frame);
+    report("recording", ms, frames * perFrame, frames * perFrame);
+
+    for(unsigned int f = 0; f <= Profiler::GPU_FRAMES; f++)
+        PROFILE_FRAME();
+    std::remove(path);
+
+    glfwTerminate();
+    return 0;
+#else
+    (void)zones;
+    std::cout << "Profiler not built in, configure with -DRENDERER_PROFILER=ON" << std::endl;
+    return 1;
+#endif
+}
+
+// ----------------- REPLAY COMPARISON -----------------
+// the per-frame timings of a camera path replay (Renderer --replay), columns frame_ms, cpu_ms and gpu_ms
+bool readReplayTimings(const char *path, vector<glm::vec3> &timings)
+{
+    std::ifstream file(path);
+    std::string line;
+    if(!std::getline(file, line) || line != "frame,frame_ms,cpu_ms,gpu_ms")
+    {
+        std::cout << "Not replay timings: " << path << std::endl;
+        return false;
+    }
+
+    unsigned int frame;
+    glm::vec3 times;
+    char comma;
+    while(file >> frame >> comma >> times.x >> comma >> times.y >> comma >> times.z)
+        timings.push_back(times);
+    return true;
+}
+
+// two replays of the same camera path, usually from two builds: the distribution of every timing in each,
+// and the frames that got slower the most
+int benchCompare(const char *basePath, const char *testPath)
+{
+    vector<glm::vec3> base, test;
+    if(!readReplayTimings(basePath, base) || !readReplayTimings(testPath, test))
+        return 1;
+    if(base.size() != test.size())
+        std::cout << "WARNING: " << base.size() << " against " << test.size() << " frames, comparing the first " << std::min(base.size(), test.size()) << std::endl;
+    unsigned int frames = std::min(base.size(), test.size());
+    if(frames == 0)
+        return 1;
+
+    std::cout << "Replay timings, " << frames << " frames: " << basePath << " -> " << testPath << std::endl;
+    const char *names[3] = { "frame", "cpu", "gpu" };
+    for(int m = 0; m < 3; m++)
+    {
+        // mean, median and 99th percentile of each
+        double stats[2][3];
+        for(int r = 0; r < 2; r++)
+        {
+            vector<float> times(frames);
+            double sum = 0.0;
+            for(unsigned int f = 0; f < frames; f++)
+                sum += times[f] = (r ? test : base)[f][m];
+            std::sort(times.begin(), times.end());
+            stats[r][0] = sum / frames;
+            stats[r][1] = times[frames / 2];
+            stats[r][2] = times[std::min((unsigned int)(frames * 0.99), frames - 1)];
+        }
+
+        std::cout << "  " << std::left << std::setw(6) << names[m] << std::right << std::fixed << std::setprecision(3);
+        const char *columns[3] = { "mean", "median", "p99" };
+        for(int c = 0; c < 3; c++)
+            std::cout << "  " << columns[c] << " " << stats[0][c] << " -> " << stats[1][c] << " ms (" << std::showpos << std::setprecision(1)
+                      << (stats[0][c] > 0.0 ? 100.0 * (stats[1][c] / stats[0][c] - 1.0) : 0.0) << "%)" << std::noshowpos << std::setprecision(3);
+        std::cout << std::endl;
+    }
+
+    // the same views, so a frame that slowed down points at what to look at
+    vector<unsigned int> order(frames);
+    for(unsigned int f = 0; f < frames; f++)
+        order[f] = f;
+    std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return test[a].x - base[a].x > test[b].x - base[b].x; });
+    std::cout << "  slowest frames against the base:";
+    for(unsigned int i = 0; i < std::min(frames, 5u); i++)
+        std::cout << " " << order[i] << " (" << std::showpos << test[order[i]].x - base[order[i]].x << std::noshowpos << " ms)";
+    std::cout << std::endl;
+    return 0;
+}
+
+// ----------------- SCENE -----------------
+// texture of a single colour, for the generated scene
+unsigned int solidTexture(const glm::vec3 &colour)
+{
+    unsigned char pixel[4] = { (unsigned char)(colour.r * 255.0f), (unsigned char)(colour.g * 255.0f), (unsigned char)(colour.b * 255.0f), 255 };
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+// a grid of spheres on the xz plane in four materials, so the benchmark runs without any assets
+void buildGridScene(Model &model, unsigned int side)
+{
+    vector<Texture> materials[4];
+    const glm::vec3 colours[4] = { glm::vec3(0.8f, 0.3f, 0.2f), glm::vec3(0.3f, 0.7f, 0.3f), glm::vec3(0.2f, 0.4f, 0.8f), glm::vec3(0.8f, 0.8f, 0.7f) };
+    for(unsigned int m = 0; m < 4; m++)
+    {
+        Texture diffuse, specular;
+        diffuse.id = solidTexture(colours[m]);
+        diffuse.type = "texture_diffuse";
+        specular.id = solidTexture(glm::vec3(0.5f));
+        specular.type = "texture_specular";
+        materials[m].push_back(diffuse);
+        materials[m].push_back(specular);
+    }
+
+    const unsigned int rings = 16, segments = 32;
+    const float radius = 0.4f;
+    for(unsigned int z = 0; z < side; z++)
+        for(unsigned int x = 0; x < side; x++)
+        {
+            glm::vec3 center(x - (side - 1) * 0.5f, radius, z - (side - 1) * 0.5f);
+
+            vector<Vertex> vertices;
+            for(unsigned int r = 0; r <= rings; r++)
+                for(unsigned int s = 0; s <= segments; s++)
+                {
+                    float theta = glm::pi<float>() * r / rings, phi = 2.0f * glm::pi<float>() * s / segments;
+                    Vertex vertex;
+                    vertex.Normal = glm::vec3(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+                    vertex.Position = center + vertex.Normal * radius;
+                    vertex.TexCoords = glm::vec2((float)s / segments, (float)r / rings);
+                    vertices.push_back(vertex);
+                }
+
+            vector<unsigned int> indices;
+            for(unsigned int r = 0; r < rings; r++)
+                for(unsigned int s = 0; s < segments; s++)
+                {
+                    unsigned int corner = r * (segments + 1) + s;
+                    unsigned int quad[6] = { corner, corner + segments + 1, corner + 1, corner + 1, corner + segments + 1, corner + segments + 2 };
+                    indices.insert(indices.end(), quad, quad + 6);
+                }
+
+            Mesh mesh(vertices, indices, materials[(x + z) % 4]);
+            mesh.bounds.min = center - radius;
+            mesh.bounds.max = center + radius;
+            mesh.sphere.center = center;
+            mesh.sphere.radius = radius;
+            model.meshes.push_back(mesh);
+        }
+}
+
+// the renderer's forward frame over a whole scene, drawn offscreen for a number of frames along a scripted
+// orbit around it: frustum culling, shadow cascades, clustered lights and per-draw light lists, then the
+// visible meshes through multi-draw indirect where supported and one draw each otherwise. prints every
+// frame's CPU time (building and submitting it) and GPU time (GL_TIMESTAMP queries at its start and end, as
+// the shadow cascades time themselves with GL_TIME_ELAPSED) and the run's throughput as JSON.
+// the scene is a model file, or "grid" for generated spheres that need no assets
+int benchScene(const std::string &scene, unsigned int frames, unsigned int width, unsigned int height)
+{
+    if(frames == 0 || width == 0 || height == 0)
+    {
+        std::cout << "The scene benchmark needs at least one frame of at least 1x1" << std::endl;
+        return 1;
+    }
+
+    if(!createContext())
+        return 1;
+
+    const unsigned int warmupFrames = 10; // programs built and buffers settled, not reported
+    const float nearPlane = 0.1f, farPlane = 100.0f;
+
+    // the frame's target, the same with or without a window
+    unsigned int FBO, renderbuffers[2];
+    glGenFramebuffers(1, &FBO);
+    glGenRenderbuffers(2, renderbuffers);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "Failed to create a " << width << "x" << height << " target" << std::endl;
+        glfwTerminate();
+        return 1;
+    }
+    glEnable(GL_DEPTH_TEST);
+
+    // scene
+    Model model;
+    if(scene == "grid")
+        buildGridScene(model, 16);
+    else
+    {
+        stbi_set_flip_vertically_on_load(true);
+        model = Model(scene);
+    }
+    if(model.meshes.empty())
+    {
+        std::cout << "No meshes in " << scene << std::endl;
+        glfwTerminate();
+        return 1;
+    }
+
+    AABB bounds = model.meshes[0].bounds;
+    unsigned int triangles = 0;
+    for(unsigned int i = 0; i < model.meshes.size(); i++)
+    {
+        bounds.min = glm::min(bounds.min, model.meshes[i].bounds.min);
+        bounds.max = glm::max(bounds.max, model.meshes[i].bounds.max);
+        triangles += model.meshes[i].indices.size() / 3;
+    }
+
+    // lighting as in the renderer: the directional light with shadows, the block's point lights at the
+    // corners, a flashlight on the camera and scattered clustered lights
+    FrameUniforms frameUniforms;
+    frameUniforms.lights.dirLight.direction = glm::vec3(0.4f, -1.0f, -0.3f);
+    frameUniforms.lights.dirLight.ambient = glm::vec3(0.1f);
+    frameUniforms.lights.dirLight.diffuse = glm::vec3(0.7f);
+    frameUniforms.lights.dirLight.specular = glm::vec3(0.5f);
+    for(unsigned int i = 0; i < MAX_POINT_LIGHTS; i++)
+    {
+        PointLightBlock &light = frameUniforms.lights.pointLights[i];
+        light.position = glm::vec3(i & 1 ? bounds.max.x : bounds.min.x, bounds.center().y, i & 2 ? bounds.max.z : bounds.min.z);
+        light.ambient = glm::vec3(0.02f);
+        light.diffuse = glm::vec3(0.8f);
+        light.specular = glm::vec3(0.4f);
+        light.constant = 1.0f;
+        light.linear = 0.0f;
+        light.quadratic = 40.0f;
+    }
+    SpotLightBlock &flashlight = frameUniforms.lights.spotLight;
+    flashlight.innerCutOff = glm::cos(glm::radians(12.5f));
+    flashlight.outerCutOff = glm::cos(glm::radians(17.5f));
+    flashlight.diffuse = glm::vec3(0.8f);
+    flashlight.specular = glm::vec3(0.5f);
+    flashlight.constant = 1.0f;
+    flashlight.linear = 0.7f;
+    flashlight.quadratic = 1.8f;
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    vector<LocalLight> sceneLights(256);
+    for(unsigned int i = 0; i < sceneLights.size(); i++)
+    {
+        LocalLight &light = sceneLights[i];
+        glm::vec3 offset(unit(rng), unit(rng), unit(rng));
+        light.position = bounds.min - 1.0f + offset * (bounds.max - bounds.min + 2.0f);
+        glm::vec3 colour = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + 0.05f);
+        light.diffuse = colour * 0.5f;
+        light.specular = colour * 0.2f;
+        light.quadratic = 20.0f;
+    }
+
+    ShaderVariants modelShaders("modelShader.vs", "modelShader.fs");
+    ShaderVariants indirectShaders("modelShaderIndirect.vs", "modelShader.fs");
+    FrameUniforms::BindBlocks(modelShaders);
+    FrameUniforms::BindBlocks(indirectShaders);
+    ShaderDefines sceneDefines;
+    sceneDefines.Set("NR_POINT_LIGHTS", MAX_POINT_LIGHTS).Set("SPOT_LIGHT").Set("SPECULAR_MAP").Set("CLUSTERED_LIGHTS").Set("SHADOWS").Set("LIGHT_LISTS");
+
+    RingBuffer frameData(4 * 1024 * 1024);
+    ClusteredLights clusteredLights;
+    ShadowMaps shadowMaps;
+    DrawLightLists drawLightLists;
+    DrawBatcher batcher;
+    batcher.Build(model);
+    bool indirect = DrawBatcher::IsSupported();
+
+    // GPU start and end of every reported frame, read once the run is over so reading never stalls it
+    vector<GLuint> timestamps(2 * frames);
+    if(frames)
+        glGenQueries(2 * frames, &timestamps[0]);
+
+    struct FrameTiming
+    {
+        double cpuMs;
+        unsigned int visible, draws, triangles;
+    };
+    vector<FrameTiming> timings(frames);
+
+    AABBSoA meshBounds;
+    vector<AABB> worldBounds(model.meshes.size());
+    vector<glm::mat4> models(model.meshes.size(), glm::mat4(1.0f));
+    vector<ObjectTransform> transforms;
+    vector<unsigned char> visible;
+    glm::vec3 center = bounds.center();
+    float orbit = std::max(glm::length(bounds.extent()) * 2.5f, 1.0f);
+
+    std::chrono::steady_clock::time_point runStart = std::chrono::steady_clock::now();
+    for(unsigned int f = 0; f < warmupFrames + frames; f++)
+    {
+        if(f == warmupFrames)
+        {
+            glFinish();
+            runStart = std::chrono::steady_clock::now();
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int reported = (int)f - (int)warmupFrames;
+        if(reported >= 0)
+            glQueryCounter(timestamps[2 * reported], GL_TIMESTAMP);
+
+        // one turn around the scene over the run, rising and falling twice
+        float angle = 2.0f * glm::pi<float>() * f / std::max(warmupFrames + frames, 1u);
+        glm::vec3 eye = center + orbit * glm::vec3(cosf(angle), 0.3f + 0.2f * sinf(2.0f * angle), sinf(angle));
+
+        frameData.BeginFrame();
+        frameUniforms.camera.projection = glm::perspective(glm::radians(45.0f), (float)width / height, nearPlane, farPlane);
+        frameUniforms.camera.view = glm::lookAt(eye, center, glm::vec3(0.0f, 1.0f, 0.0f));
+        frameUniforms.camera.viewPos = eye;
+        flashlight.position = eye;
+        flashlight.direction = glm::normalize(center - eye);
+        glm::mat4 viewProjection = frameUniforms.camera.projection * frameUniforms.camera.view;
+
+        clusteredLights.Build(sceneLights, frameUniforms.camera.projection, frameUniforms.camera.view, width, height, nearPlane, farPlane);
+        clusteredLights.Upload();
+        frameUniforms.clusters = clusteredLights.block;
+
+        ComputeTransforms(viewProjection, models, transforms);
+        shadowMaps.Update(frameUniforms.camera.projection, frameUniforms.camera.view, nearPlane, frameUniforms.lights.dirLight.direction, bounds);
+        frameUniforms.shadows = shadowMaps.block;
+        frameUniforms.Upload(frameData);
+
+        meshBounds.clear();
+        for(unsigned int i = 0; i < model.meshes.size(); i++)
+        {
+            worldBounds[i] = model.meshes[i].bounds;
+            meshBounds.Add(worldBounds[i]);
+        }
+        unsigned int visibleMeshes = CullAABBs(CullParams(frameUniforms.camera.projection, frameUniforms.camera.view, 0.002f), meshBounds, visible);
+        drawLightLists.Build(frameUniforms.lights, MAX_POINT_LIGHTS, true, worldBounds, &visible);
+
+        shadowMaps.Render(model, glm::mat4(1.0f), meshBounds);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glViewport(0, 0, width, height);
+        glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        unsigned int draws = 0, drawnTriangles = 0;
+        if(indirect)
+        {
+            Shader &shader = indirectShaders.Get(sceneDefines);
+            shader.use();
+            shader.setFloat("material.shininess", 32.0f);
+            clusteredLights.Bind(shader);
+            shadowMaps.Bind(shader);
+            batcher.Draw(shader, transforms, frameData, &visible, &drawLightLists.lists);
+            draws = batcher.submittedCalls;
+        }
+        else
+        {
+            for(unsigned int i = 0; i < model.meshes.size(); i++)
+            {
+                if(!visible[i])
+                    continue;
+
+                ShaderDefines defines = sceneDefines;
+                if(!model.meshes[i].HasTexture("texture_specular"))
+                    defines.Unset("SPECULAR_MAP");
+                Shader &shader = modelShaders.Get(defines);
+                shader.use();
+                shader.setFloat("material.shininess", 32.0f);
+                clusteredLights.Bind(shader);
+                shadowMaps.Bind(shader);
+                SetTransform(shader, transforms[i]);
+                shader.setInt("drawLights", drawLightLists.lists[i]);
+                model.meshes[i].Draw(shader);
+                draws++;
+            }
+        }
+        for(unsigned int i = 0; i < model.meshes.size(); i++)
+            if(visible[i])
+                drawnTriangles += model.meshes[i].indices.size() / 3;
+
+        frameData.EndFrame();
+        if(reported >= 0)
+        {
+            glQueryCounter(timestamps[2 * reported + 1], GL_TIMESTAMP);
+            FrameTiming &timing = timings[reported];
+            timing.cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            timing.visible = visibleMeshes;
+            timing.draws = draws;
+            timing.triangles = drawnTriangles;
+        }
+        glFlush();
+    }
+    glFinish();
+    double runMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - runStart).count();
+
+    // per frame, then the run
+    double cpuTotal = 0.0, gpuTotal = 0.0, gpuLongest = 0.0;
+    unsigned long long trianglesTotal = 0;
+    std::cout << std::fixed << std::setprecision(4);
+    std::cout << "{" << std::endl;
+    std::cout << "  \"benchmark\": \"scene\"," << std::endl;
+    std::cout << "  \"scene\": \"" << scene << "\"," << std::endl;
+    std::cout << "  \"renderer\": \"" << glGetString(GL_RENDERER) << "\"," << std::endl;
+    std::cout << "  \"headless\": " << (headless ? "true" : "false") << "," << std::endl;
+    std::cout << "  \"width\": " << width << ", \"height\": " << height << "," << std::endl;
+    std::cout << "  \"meshes\": " << model.meshes.size() << ", \"triangles\": " << triangles << "," << std::endl;
+    std::cout << "  \"draw_path\": \"" << (indirect ? "multi-draw indirect" : "per mesh") << "\"," << std::endl;
+    std::cout << "  \"frames\": [" << std::endl;
+    for(unsigned int f = 0; f < frames; f++)
+    {
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(timestamps[2 * f], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(timestamps[2 * f + 1], GL_QUERY_RESULT, &end);
+        double gpuMs = end > begin ? (end - begin) / 1e6 : 0.0;
+
+        const FrameTiming &timing = timings[f];
+        cpuTotal += timing.cpuMs;
+        gpuTotal += gpuMs;
+        gpuLongest = std::max(gpuLongest, gpuMs);
+        trianglesTotal += timing.triangles;
+        std::cout << "    { \"frame\": " << f << ", \"cpu_ms\": " << timing.cpuMs << ", \"gpu_ms\": " << gpuMs << ", \"visible\": " << timing.visible
+                  << ", \"draws\": " << timing.draws << ", \"triangles\": " << timing.triangles << " }" << (f + 1 < frames ? "," : "") << std::endl;
+    }
+    std::cout << "  ]," << std::endl;
+    std::cout << "  \"summary\": { \"frames\": " << frames << ", \"wall_ms\": " << runMs
+              << ", \"cpu_ms_mean\": " << (frames ? cpuTotal / frames : 0.0) << ", \"gpu_ms_mean\": " << (frames ? gpuTotal / frames : 0.0)
+              << ", \"gpu_ms_max\": " << gpuLongest << ", \"frames_per_second\": " << (runMs > 0.0 ? frames * 1000.0 / runMs : 0.0)
+              << ", \"triangles_per_second\": " << (runMs > 0.0 ? trianglesTotal * 1000.0 / runMs : 0.0) << " }" << std::endl;
+    std::cout << "}" << std::endl;
+
+    glfwTerminate();
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    // --headless anywhere applies to every GL benchmark, the rest are positional
+    vector<char*> arguments;
+    for(int i = 0; i < argc; i++)
+    {
+        if(i > 0 && strcmp(argv[i], "--headless") == 0)
+            headless = true;
+        else
+            arguments.push_back(argv[i]);
+    }
+    argc = arguments.size();
+    argv = &arguments[0];
+
+    std::string benchmark = argc > 1 ? argv[1] : "";
+
+    if(benchmark == "culling")
+        return benchCulling(argc > 2 ? atoi(argv[2]) : 1000000);
+
+    if(benchmark == "bvh")
+    {
+        if(argc > 2)
+            return benchBVH(atoi(argv[2]));
+
+        int result = 0;
+        for(unsigned int count = 10000; count <= 1000000; count *= 10)
+            result |= benchBVH(count);
+        return result;
+    }
+
+    if(benchmark == "occlusion")
+        return benchOcclusion(argc > 2 ? atoi(argv[2]) : 100000);
+
+    if(benchmark == "commands")
+        return benchCommandLists(argc > 2 ? atoi(argv[2]) : 50000, argc > 3 ? atoi(argv[3]) : HardwareThreads());
+
+    if(benchmark == "lights")
+    {
+        if(argc > 2)
+            return benchLights(atoi(argv[2]));
+
+        int result = 0;
+        for(unsigned int count = 16; count <= 4096; count *= 16)
+            result |= benchLights(count);
+        return result;
+    }
+
+    if(benchmark == "transforms")
+        return benchTransforms(argc > 2 ? atoi(argv[2]) : 100000);
+
+    if(benchmark == "vertices")
+        return benchVertices(argc > 2 ? atoi(argv[2]) : 1000000);
+
+    if(benchmark == "uniforms")
+        return benchUniforms(argc > 2 ? atoi(argv[2]) : 1000000);
+
+    if(benchmark == "programs")
+        return benchPrograms();
+
+    if(benchmark == "profiler")
+        return benchProfiler(argc > 2 ? atoi(argv[2]) : 200000);
+
+    if(benchmark == "compare" && argc > 3)
+        return benchCompare(argv[2], argv[3]);
+
+    if(benchmark == "scene")
+        return benchScene(argc > 2 ? argv[2] : "grid", argc > 3 ? atoi(argv[3]) : 300, argc > 4 ? atoi(argv[4]) : 1280, argc > 5 ? atoi(argv[5]) : 720);
+
+    std::cout << "Usage: RendererBench <benchmark> [options] [--headless]" << std::endl;
+    std::cout << "  culling [boxes=1000000]   frustum + screen size culling kernels" << std::endl;
+    std::cout << "  bvh [instances]           BVH build/refit/query at 10k, 100k and 1M instances" << std::endl;
+    std::cout << "  occlusion [boxes=100000]  software occlusion culling against a brute force reference" << std::endl;
+    std::cout << "  commands [draws=50000] [threads]  draw preparation recorded into command lists on 1 to N threads" << std::endl;
+    std::cout << "  lights [lights]           clustered light binning and lists at 16, 256 and 4096 lights" << std::endl;
+    std::cout << "  transforms [objects=100000]  per-object model view projection and normal matrix kernels" << std::endl;
+    std::cout << "  vertices [vertices=1000000]  vertex stage of a dense mesh, matrices per vertex against per object (needs a GL context)" << std::endl;
+    std::cout << "  uniforms [calls=1000000]  uniform setters with driver lookups against cached locations (needs a GL context)" << std::endl;
+    std::cout << "  programs                  startup cost of the renderer's programs, cold and warm binary cache (needs a GL context)" << std::endl;
+    std::cout << "  profiler [zones=200000]   cost of a profiler zone, idle and recording (needs RENDERER_PROFILER and a GL context)" << std::endl;
+    std::cout << "  scene [model|grid] [frames=300] [width=1280] [height=720]  whole frames offscreen along an orbit, JSON timings (needs a GL context)" << std::endl;
+    std::cout << "  compare <base.csv> <test.csv>  two replays' timings of one camera path (Renderer --replay), e.g. from two builds" << std::endl;
+    std::cout << "  --headless                GL contexts without a window system: GLFW's null platform with OSMesa, or surfaceless EGL" << std::endl;
+    return benchmark.empty() ? 0 : 1;
+}
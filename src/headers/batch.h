@@ -0,0 +1,252 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <mesh.h>
+#include <model.h>
+#include <ringbuffer.h>
+#include <shader.h>
+#include <transforms.h>
+#include <profiler.h>
+
+#include <map>
+#include <vector>
+using namespace std;
+
+// layout of a single draw as read by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint  baseVertex;
+    GLuint baseInstance;
+};
+
+// per-draw data, fetched in the vertex shader as instanced attributes selected by the draw's base instance
+typedef ObjectTransform DrawData;
+
+// a run of draws that share the same textures, so they can be submitted with a single call
+struct DrawBatch
+{
+    unsigned int firstMesh;          // mesh whose textures are bound for the whole batch
+    vector<unsigned int> meshes;     // meshes (draw ids) belonging to this batch
+};
+
+// packs every mesh of a model into shared vertex/index buffers and submits each batch of
+// compatible meshes with one glMultiDrawElementsIndirect instead of one glDrawElements per mesh
+class DrawBatcher
+{
+    public:
+        // batches built by the last call to Build
+        vector<DrawBatch> batches;
+
+        // number of multi-draw calls and individual draws submitted by the last Draw
+        unsigned int submittedCalls;
+        unsigned int submittedDraws;
+
+        DrawBatcher() : submittedCalls(0), submittedDraws(0), model(NULL), VAO(0), VBO(0), EBO(0)
+        {
+        }
+
+        // multi-draw indirect needs GL 4.3 or ARB_multi_draw_indirect + ARB_base_instance (base instance selects the per-draw data)
+        static bool IsSupported()
+        {
+            bool core = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 3);
+            bool extensions = GLAD_GL_ARB_multi_draw_indirect && GLAD_GL_ARB_base_instance;
+
+            return (core || extensions) && glad_glMultiDrawElementsIndirect != NULL;
+        }
+
+        // copies all meshes of the model into shared buffers and groups them by texture set
+        void Build(Model &source)
+        {
+            model = &source;
+            batches.clear();
+            firstIndex.clear();
+            baseVertex.clear();
+
+            if(!IsSupported())
+                return;
+
+            vector<Vertex> vertices;
+            vector<unsigned int> indices;
+            map<vector<unsigned int>, unsigned int> batchLookup; // texture ids -> batch
+
+            for(unsigned int i = 0; i < source.meshes.size(); i++)
+            {
+                Mesh &mesh = source.meshes[i];
+
+                firstIndex.push_back(indices.size());
+                baseVertex.push_back(vertices.size());
+                vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+                indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+
+                // meshes with identical textures are compatible and end up in the same batch
+                vector<unsigned int> key;
+                for(unsigned int t = 0; t < mesh.textures.size(); t++)
+                    key.push_back(mesh.textures[t].id);
+
+                map<vector<unsigned int>, unsigned int>::iterator found = batchLookup.find(key);
+                if(found == batchLookup.end())
+                {
+                    DrawBatch batch;
+                    batch.firstMesh = i;
+                    found = batchLookup.insert(make_pair(key, (unsigned int)batches.size())).first;
+                    batches.push_back(batch);
+                }
+                batches[found->second].meshes.push_back(i);
+            }
+
+            if(vertices.empty())
+                return;
+
+            setupBuffers(vertices, indices);
+        }
+
+        // draws the model's meshes with their transforms (one per mesh, from ComputeTransforms); the shader
+        // must read them from the per-draw attributes (see modelShaderIndirect.vs).
+        // meshes flagged 0 in visible (one flag per mesh, optional; meshes past its end are drawn) are left out of the commands.
+        // drawLights (one packed list per mesh, see lightculling.h) feeds LIGHT_LISTS permutations and is
+        // required by them.
+        // per-draw data and commands are streamed through the frame's ring buffer.
+        void Draw(Shader &shader, const vector<DrawData> &drawData, RingBuffer &ring, const vector<unsigned char> *visible = NULL,
+                  const vector<int> *drawLights = NULL)
+        {
+            PROFILE_GPU_ZONE("DrawBatcher::Draw");
+            submittedCalls = 0;
+            submittedDraws = 0;
+
+            if(!VAO || drawData.size() < model->meshes.size())
+                return;
+
+            // one command per mesh, laid out batch by batch so each batch is a contiguous range
+            vector<DrawElementsIndirectCommand> commands;
+            vector<GLintptr> batchOffsets;
+            vector<GLsizei> batchCounts;
+            for(unsigned int b = 0; b < batches.size(); b++)
+            {
+                batchOffsets.push_back(commands.size() * sizeof(DrawElementsIndirectCommand));
+                for(unsigned int m = 0; m < batches[b].meshes.size(); m++)
+                {
+                    unsigned int meshIndex = batches[b].meshes[m];
+                    if(visible && meshIndex < visible->size() && !(*visible)[meshIndex])
+                        continue;
+
+                    DrawElementsIndirectCommand command;
+                    command.count = model->meshes[meshIndex].indices.size();
+                    command.instanceCount = 1;
+                    command.firstIndex = firstIndex[meshIndex];
+                    command.baseVertex = baseVertex[meshIndex];
+                    command.baseInstance = meshIndex; // selects this draw's DrawData
+                    commands.push_back(command);
+                }
+                batchCounts.push_back(commands.size() - batchOffsets[b] / sizeof(DrawElementsIndirectCommand));
+            }
+
+            if(commands.empty())
+                return;
+
+            GLintptr drawDataOffset = ring.Upload(&drawData[0], drawData.size() * sizeof(DrawData), sizeof(glm::vec4));
+            GLintptr commandOffset = ring.Upload(&commands[0], commands.size() * sizeof(DrawElementsIndirectCommand), sizeof(GLuint));
+            GLintptr drawLightsOffset = 0;
+            if(drawLights && drawLights->size() >= model->meshes.size())
+                drawLightsOffset = ring.Upload(&(*drawLights)[0], drawLights->size() * sizeof(GLint), sizeof(GLint));
+            else
+                drawLights = NULL;
+            if(drawDataOffset < 0 || commandOffset < 0 || drawLightsOffset < 0)
+                return;
+
+            glBindVertexArray(VAO);
+
+            // point the per-draw attributes at this frame's copy of the draw data
+            glBindBuffer(GL_ARRAY_BUFFER, ring.ID);
+            for(unsigned int column = 0; column < 4; column++)
+            {
+                GLintptr offset = drawDataOffset + column * sizeof(glm::vec4);
+                glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(DrawData), (void*)(offset + offsetof(DrawData, model)));
+                glVertexAttribPointer(7 + column, 4, GL_FLOAT, GL_FALSE, sizeof(DrawData), (void*)(offset + offsetof(DrawData, modelViewProjection)));
+                if(column < 3)
+                    glVertexAttribPointer(11 + column, 3, GL_FLOAT, GL_FALSE, sizeof(DrawData), (void*)(offset + offsetof(DrawData, normal)));
+            }
+            if(drawLights)
+            {
+                glEnableVertexAttribArray(14);
+                glVertexAttribIPointer(14, 1, GL_INT, sizeof(GLint), (void*)drawLightsOffset);
+            }
+            else
+                glDisableVertexAttribArray(14);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, ring.ID);
+            for(unsigned int b = 0; b < batches.size(); b++)
+            {
+                if(batchCounts[b] == 0)
+                    continue;
+
+                model->meshes[batches[b].firstMesh].BindTextures(shader);
+
+                glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(commandOffset + batchOffsets[b]), batchCounts[b], 0);
+
+                submittedCalls++;
+                submittedDraws += batchCounts[b];
+            }
+
+            glBindVertexArray(0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            glActiveTexture(GL_TEXTURE0);
+        }
+
+    private:
+        Model *model;
+
+        // shared geometry
+        unsigned int VAO, VBO, EBO;
+
+        // where each mesh lives inside the shared buffers
+        vector<unsigned int> firstIndex;
+        vector<int> baseVertex;
+
+        void setupBuffers(const vector<Vertex> &vertices, const vector<unsigned int> &indices)
+        {
+            glGenVertexArrays(1, &VAO);
+            glGenBuffers(1, &VBO);
+            glGenBuffers(1, &EBO);
+
+            glBindVertexArray(VAO);
+
+            // shared vertex and index data, same layout as Mesh::setupMesh
+            glBindBuffer(GL_ARRAY_BUFFER, VBO);
+            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+
+            // per-draw matrices, one column per attribute location (model 3-6, model view projection 7-10,
+            // normal 11-13), advanced once per instance so that the draw's base instance picks its own entry.
+            // the pointers are set every frame in Draw, since the draw data moves around the ring buffer.
+            // location 14 is the draw's light list, a separate stream enabled only when Draw is given one
+            for(unsigned int location = 3; location <= 13; location++)
+            {
+                glEnableVertexAttribArray(location);
+                glVertexAttribDivisor(location, 1);
+            }
+            glVertexAttribDivisor(14, 1);
+
+            glBindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+};
+#endif
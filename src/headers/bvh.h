@@ -0,0 +1,437 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include <frustum.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+using namespace std;
+
+// bounding volume hierarchy over instance boxes, for culling and spatial queries.
+// built top-down with binned SAH; each node covers a contiguous range of the instance order,
+// so a subtree that is entirely inside the frustum is accepted without visiting its children.
+// moving instances are handled by refitting, and the tree is rebuilt once refits have degraded it.
+class BVH
+{
+    public:
+        struct Node
+        {
+            AABB bounds;
+            unsigned int left;   // first child (the second is left + 1); 0 for leaves, since the root is never a child
+            unsigned int parent;
+            unsigned int first;  // range of the subtree in order[]
+            unsigned int count;
+
+            bool isLeaf() const { return left == 0; }
+        };
+
+        static const unsigned int BINS = 16;
+        static const unsigned int MAX_LEAF_SIZE = 4;
+
+        vector<Node> nodes;
+        vector<unsigned int> order;  // instance indices, grouped by leaf
+        vector<AABB> boxes;          // current box of every instance
+
+        BVH() : buildCost(0.0f), depth(0) {}
+
+        unsigned int size() const { return boxes.size(); }
+
+        // rebuilds the tree from scratch over the given instance boxes
+        void Build(const vector<AABB> &instanceBoxes)
+        {
+            boxes = instanceBoxes;
+            Rebuild();
+        }
+
+        // rebuilds over the current boxes, e.g. once NeedsRebuild says refits have made the tree too loose
+        void Rebuild()
+        {
+            nodes.clear();
+            order.resize(boxes.size());
+            leafOf.assign(boxes.size(), 0);
+
+            // the build partitions copies of the boxes so it streams through memory instead of chasing order[]
+            references.resize(boxes.size());
+            for(unsigned int i = 0; i < boxes.size(); i++)
+            {
+                references[i].box = boxes[i];
+                references[i].centroid = boxes[i].center();
+                references[i].instance = i;
+            }
+
+            depth = 0;
+            if(boxes.empty())
+            {
+                buildCost = 0.0f;
+                return;
+            }
+
+            nodes.reserve(boxes.size() * 2);
+
+            Node root;
+            root.left = 0;
+            root.parent = 0;
+            root.first = 0;
+            root.count = boxes.size();
+            nodes.push_back(root);
+
+            subdivide(0, 1);
+
+            for(unsigned int i = 0; i < references.size(); i++)
+                order[i] = references[i].instance;
+            vector<BuildReference>().swap(references);
+
+            buildCost = SAHCost();
+        }
+
+        // moves one instance and refits the boxes on its path to the root
+        void Update(unsigned int instance, const AABB &box)
+        {
+            boxes[instance] = box;
+
+            unsigned int node = leafOf[instance];
+            while(true)
+            {
+                AABB old = nodes[node].bounds;
+                nodes[node].bounds = nodeBounds(node);
+
+                // stop once a node's box no longer changes, its ancestors won't either
+                if(node == 0 || (old.min == nodes[node].bounds.min && old.max == nodes[node].bounds.max))
+                    break;
+                node = nodes[node].parent;
+            }
+        }
+
+        // refits every node bottom-up after many instances moved (children always come after their parent)
+        void Refit()
+        {
+            for(int i = (int)nodes.size() - 1; i >= 0; i--)
+                nodes[i].bounds = nodeBounds(i);
+        }
+
+        // surface area heuristic cost of the current tree (relative, lower is better)
+        float SAHCost() const
+        {
+            if(nodes.empty())
+                return 0.0f;
+
+            float rootArea = area(nodes[0].bounds);
+            float cost = 0.0f;
+            for(unsigned int i = 0; i < nodes.size(); i++)
+                cost += area(nodes[i].bounds) / rootArea * (nodes[i].isLeaf() ? nodes[i].count : 1.0f);
+            return cost;
+        }
+
+        // true once refitting has made the tree noticeably worse than when it was built
+        bool NeedsRebuild(float tolerance = 1.5f) const
+        {
+            return SAHCost() > buildCost * tolerance;
+        }
+
+        // appends every instance whose box touches the frustum. returns the number of nodes visited
+        unsigned int FrustumCull(const Frustum &frustum, vector<unsigned int> &visible) const
+        {
+            if(nodes.empty())
+                return 0;
+
+            // each entry carries the planes its parent still straddled; planes it was fully inside are skipped
+            struct Entry { unsigned int node; unsigned int planeMask; };
+            vector<Entry> stack(depth + 1);
+            unsigned int top = 0;
+            unsigned int visited = 0;
+
+            stack[top].node = 0;
+            stack[top].planeMask = 0x3f;
+            top++;
+
+            while(top > 0)
+            {
+                top--;
+                const Node &node = nodes[stack[top].node];
+                unsigned int planeMask = stack[top].planeMask;
+                visited++;
+
+                glm::vec3 center = node.bounds.center();
+                glm::vec3 extent = node.bounds.extent();
+
+                bool outside = false;
+                for(unsigned int p = 0; p < 6; p++)
+                {
+                    if(!(planeMask & (1 << p)))
+                        continue;
+
+                    glm::vec3 normal(frustum.planes[p]);
+                    float distance = glm::dot(normal, center) + frustum.planes[p].w;
+                    float radius = glm::dot(glm::abs(normal), extent);
+
+                    if(distance + radius < 0.0f)
+                    {
+                        outside = true;
+                        break;
+                    }
+                    if(distance - radius >= 0.0f)
+                        planeMask &= ~(1 << p); // fully in front of this plane, so are all children
+                }
+
+                if(outside)
+                    continue;
+
+                // entirely inside (or a leaf): take the whole range without looking further
+                if(planeMask == 0 || node.isLeaf())
+                {
+                    if(planeMask == 0)
+                    {
+                        visible.insert(visible.end(), order.begin() + node.first, order.begin() + node.first + node.count);
+                    }
+                    else
+                    {
+                        for(unsigned int i = node.first; i < node.first + node.count; i++)
+                            if(frustum.IntersectsAABB(boxes[order[i]].center(), boxes[order[i]].extent()))
+                                visible.push_back(order[i]);
+                    }
+                    continue;
+                }
+
+                stack[top].node = node.left;
+                stack[top].planeMask = planeMask;
+                top++;
+                stack[top].node = node.left + 1;
+                stack[top].planeMask = planeMask;
+                top++;
+            }
+            return visited;
+        }
+
+        // appends every instance whose box overlaps the query box
+        void Query(const AABB &box, vector<unsigned int> &result) const
+        {
+            if(nodes.empty())
+                return;
+
+            vector<unsigned int> stack(depth + 1);
+            unsigned int top = 0;
+            stack[top++] = 0;
+
+            while(top > 0)
+            {
+                const Node &node = nodes[stack[--top]];
+                if(!overlaps(node.bounds, box))
+                    continue;
+
+                if(node.isLeaf())
+                {
+                    for(unsigned int i = node.first; i < node.first + node.count; i++)
+                        if(overlaps(boxes[order[i]], box))
+                            result.push_back(order[i]);
+                    continue;
+                }
+
+                stack[top++] = node.left;
+                stack[top++] = node.left + 1;
+            }
+        }
+
+    private:
+        float buildCost;
+        unsigned int depth;            // deepest level, bounds the traversal stacks
+        vector<unsigned int> leafOf;   // leaf node holding each instance, for Update
+
+        // an instance as seen by the build
+        struct BuildReference
+        {
+            AABB box;
+            glm::vec3 centroid;
+            unsigned int instance;
+        };
+        vector<BuildReference> references;
+
+        struct Bin
+        {
+            AABB bounds;
+            unsigned int count;
+        };
+
+        static float area(const AABB &box)
+        {
+            glm::vec3 d = glm::max(box.max - box.min, glm::vec3(0.0f));
+            return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+        }
+
+        static bool overlaps(const AABB &a, const AABB &b)
+        {
+            return a.min.x <= b.max.x && a.max.x >= b.min.x &&
+                   a.min.y <= b.max.y && a.max.y >= b.min.y &&
+                   a.min.z <= b.max.z && a.max.z >= b.min.z;
+        }
+
+        static AABB emptyBox()
+        {
+            AABB box;
+            box.min = glm::vec3(FLT_MAX);
+            box.max = glm::vec3(-FLT_MAX);
+            return box;
+        }
+
+        static void grow(AABB &box, const AABB &other)
+        {
+            box.min = glm::min(box.min, other.min);
+            box.max = glm::max(box.max, other.max);
+        }
+
+        AABB nodeBounds(unsigned int index) const
+        {
+            const Node &node = nodes[index];
+            AABB box = emptyBox();
+
+            if(node.isLeaf())
+            {
+                for(unsigned int i = node.first; i < node.first + node.count; i++)
+                    grow(box, boxes[order[i]]);
+            }
+            else
+            {
+                grow(box, nodes[node.left].bounds);
+                grow(box, nodes[node.left + 1].bounds);
+            }
+            return box;
+        }
+
+        void makeLeaf(unsigned int index)
+        {
+            Node &node = nodes[index];
+            node.left = 0;
+            for(unsigned int i = node.first; i < node.first + node.count; i++)
+                leafOf[references[i].instance] = index;
+        }
+
+        // splits a node along the cheapest binned SAH plane, recursing until splitting no longer pays off
+        void subdivide(unsigned int index, unsigned int level)
+        {
+            depth = max(depth, level);
+
+            nodes[index].bounds = emptyBox();
+            AABB centroidBounds = emptyBox();
+            for(unsigned int i = nodes[index].first; i < nodes[index].first + nodes[index].count; i++)
+            {
+                grow(nodes[index].bounds, references[i].box);
+                centroidBounds.min = glm::min(centroidBounds.min, references[i].centroid);
+                centroidBounds.max = glm::max(centroidBounds.max, references[i].centroid);
+            }
+
+            unsigned int first = nodes[index].first;
+            unsigned int count = nodes[index].count;
+
+            if(count <= MAX_LEAF_SIZE)
+            {
+                makeLeaf(index);
+                return;
+            }
+
+            // find the best split over all three axes
+            int bestAxis = -1;
+            unsigned int bestSplit = 0;
+            float bestCost = area(nodes[index].bounds) * count; // cost of not splitting
+
+            // bin every instance along all three axes in a single pass over the range
+            Bin bins[3][BINS];
+            glm::vec3 scale(0.0f);
+            for(int axis = 0; axis < 3; axis++)
+            {
+                float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+                if(extent > 0.0f)
+                    scale[axis] = BINS / extent;
+
+                for(unsigned int b = 0; b < BINS; b++)
+                {
+                    bins[axis][b].bounds = emptyBox();
+                    bins[axis][b].count = 0;
+                }
+            }
+
+            for(unsigned int i = first; i < first + count; i++)
+            {
+                const AABB &box = references[i].box;
+                glm::vec3 binPosition = (references[i].centroid - centroidBounds.min) * scale;
+                for(int axis = 0; axis < 3; axis++)
+                {
+                    Bin &bin = bins[axis][min(BINS - 1, (unsigned int)binPosition[axis])];
+                    bin.count++;
+                    grow(bin.bounds, box);
+                }
+            }
+
+            for(int axis = 0; axis < 3; axis++)
+            {
+                if(scale[axis] == 0.0f)
+                    continue;
+
+                // sweep from both sides to get the cost of every split plane
+                float leftArea[BINS - 1], rightArea[BINS - 1];
+                unsigned int leftCount[BINS - 1], rightCount[BINS - 1];
+                AABB leftBox = emptyBox(), rightBox = emptyBox();
+                unsigned int leftSum = 0, rightSum = 0;
+                for(unsigned int b = 0; b < BINS - 1; b++)
+                {
+                    leftSum += bins[axis][b].count;
+                    grow(leftBox, bins[axis][b].bounds);
+                    leftCount[b] = leftSum;
+                    leftArea[b] = leftSum ? area(leftBox) : 0.0f;
+
+                    rightSum += bins[axis][BINS - 1 - b].count;
+                    grow(rightBox, bins[axis][BINS - 1 - b].bounds);
+                    rightCount[BINS - 2 - b] = rightSum;
+                    rightArea[BINS - 2 - b] = rightSum ? area(rightBox) : 0.0f;
+                }
+
+                for(unsigned int b = 0; b < BINS - 1; b++)
+                {
+                    float cost = leftArea[b] * leftCount[b] + rightArea[b] * rightCount[b];
+                    if(leftCount[b] && rightCount[b] && cost < bestCost)
+                    {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestSplit = b;
+                    }
+                }
+            }
+
+            if(bestAxis < 0)
+            {
+                makeLeaf(index);
+                return;
+            }
+
+            // partition the node's range in place around the chosen plane
+            float lo = centroidBounds.min[bestAxis];
+            float axisScale = scale[bestAxis];
+            BuildReference *begin = &references[0] + first;
+            BuildReference *middle = std::partition(begin, begin + count, [&](const BuildReference &reference)
+            {
+                return min(BINS - 1, (unsigned int)((reference.centroid[bestAxis] - lo) * axisScale)) <= bestSplit;
+            });
+            unsigned int leftCount = middle - begin;
+
+            unsigned int left = nodes.size();
+            Node child;
+            child.left = 0;
+            child.parent = index;
+
+            child.first = first;
+            child.count = leftCount;
+            nodes.push_back(child);
+
+            child.first = first + leftCount;
+            child.count = count - leftCount;
+            nodes.push_back(child);
+
+            nodes[index].left = left;
+
+            subdivide(left, level + 1);
+            subdivide(left + 1, level + 1);
+        }
+};
+#endif
@@ -0,0 +1,262 @@
+#ifndef CAMERAPATH_H
+#define CAMERAPATH_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <camera.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// the camera state a view depends on
+struct CameraKey
+{
+    glm::vec3 position;
+    float yaw, pitch, zoom;
+};
+
+// the camera's state after every fixed update, so a flight can be replayed exactly. the file is
+//   "CPTH", version (uint32), timestep in seconds (float), key count (uint32)
+//   per key: position x, y, z, yaw, pitch, zoom (floats)
+// in the byte order of the machine that wrote it, 24 bytes a key
+class CameraPath
+{
+    public:
+        static const uint32_t VERSION = 1;
+
+        vector<CameraKey> keys;
+        float timestep; // seconds between keys
+
+        CameraPath(float timestep = 1.0f / 120.0f) : timestep(timestep) {}
+
+        void Record(const Camera &camera)
+        {
+            CameraKey key;
+            key.position = camera.Position;
+            key.yaw = camera.Yaw;
+            key.pitch = camera.Pitch;
+            key.zoom = camera.Zoom;
+            keys.push_back(key);
+        }
+
+        // the camera as it was at the given key, the last one past the end
+        void Apply(unsigned int index, Camera &camera) const
+        {
+            if(keys.empty())
+                return;
+            const CameraKey &key = keys[min(index, (unsigned int)keys.size() - 1)];
+            camera.Position = key.position;
+            camera.Zoom = key.zoom;
+            camera.SetOrientation(key.yaw, key.pitch);
+        }
+
+        bool Save(const string &path) const
+        {
+            std::ofstream file(path.c_str(), std::ios::binary);
+            uint32_t version = VERSION, count = keys.size();
+            file.write("CPTH", 4);
+            file.write((const char*)&version, sizeof(version));
+            file.write((const char*)&timestep, sizeof(timestep));
+            file.write((const char*)&count, sizeof(count));
+            for(unsigned int i = 0; i < keys.size(); i++)
+            {
+                const CameraKey &key = keys[i];
+                float values[6] = { key.position.x, key.position.y, key.position.z, key.yaw, key.pitch, key.zoom };
+                file.write((const char*)values, sizeof(values));
+            }
+
+            if(!file)
+            {
+                std::cout << "ERROR::CAMERA_PATH::NOT_WRITTEN: " << path << std::endl;
+                return false;
+            }
+            return true;
+        }
+
+        bool Load(const string &path)
+        {
+            std::ifstream file(path.c_str(), std::ios::binary);
+            char magic[4] = { 0 };
+            uint32_t version = 0, count = 0;
+            float step = 0.0f;
+            file.read(magic, 4);
+            file.read((char*)&version, sizeof(version));
+            file.read((char*)&step, sizeof(step));
+            file.read((char*)&count, sizeof(count));
+            if(!file || memcmp(magic, "CPTH", 4) != 0 || version != VERSION || !(step > 0.0f))
+            {
+                std::cout << "ERROR::CAMERA_PATH::NOT_A_CAMERA_PATH: " << path << std::endl;
+                return false;
+            }
+
+            // the keys must all be there before a count read from the file sizes an allocation
+            std::streampos keysStart = file.tellg();
+            file.seekg(0, std::ios::end);
+            std::streamoff available = file.tellg() - keysStart;
+            file.seekg(keysStart);
+            if(!file || available < (std::streamoff)count * (std::streamoff)(6 * sizeof(float)))
+            {
+                std::cout << "ERROR::CAMERA_PATH::TRUNCATED: " << path << std::endl;
+                return false;
+            }
+
+            vector<CameraKey> loaded(count);
+            for(unsigned int i = 0; i < count; i++)
+            {
+                float values[6];
+                file.read((char*)values, sizeof(values));
+                loaded[i].position = glm::vec3(values[0], values[1], values[2]);
+                loaded[i].yaw = values[3];
+                loaded[i].pitch = values[4];
+                loaded[i].zoom = values[5];
+            }
+            if(!file)
+            {
+                std::cout << "ERROR::CAMERA_PATH::TRUNCATED: " << path << std::endl;
+                return false;
+            }
+
+            keys.swap(loaded);
+            timestep = step;
+            return true;
+        }
+};
+
+// plays a camera path back one key per frame, however long frames take, so every run renders the same
+// views in the same order, and times every frame: from its start to the next one's, its CPU time up to
+// EndFrame, and its GPU time between two GL_TIMESTAMP queries, read TIMER_QUERIES frames later
+class CameraReplay
+{
+    public:
+        static const unsigned int TIMER_QUERIES = 8; // frames a GPU time may take to arrive
+
+        struct FrameTiming
+        {
+            float frameMs; // start to the next frame's start
+            float cpuMs;   // start to EndFrame
+            float gpuMs;   // the GL commands between BeginFrame and EndFrame
+        };
+
+        CameraPath path;
+        unsigned int frame; // the key the current frame shows
+        vector<FrameTiming> timings;
+
+        CameraReplay() : frame(0)
+        {
+            glGenQueries(2 * TIMER_QUERIES, queries);
+            for(unsigned int q = 0; q < TIMER_QUERIES; q++)
+                pending[q] = false;
+        }
+
+        bool Done() const
+        {
+            return frame >= path.keys.size();
+        }
+
+        // places the camera at this frame's key and starts timing the frame
+        void BeginFrame(Camera &camera)
+        {
+            Clock::time_point now = Clock::now();
+            if(frame > 0)
+                timings[frame - 1].frameMs = milliseconds(frameStart, now);
+            frameStart = now;
+
+            unsigned int slot = frame % TIMER_QUERIES;
+            if(pending[slot])
+                collect(slot);
+
+            timings.resize(frame + 1);
+            timings[frame].frameMs = timings[frame].cpuMs = timings[frame].gpuMs = 0.0f;
+            path.Apply(frame, camera);
+            glQueryCounter(queries[2 * slot], GL_TIMESTAMP);
+        }
+
+        // ends the frame's CPU and GPU timing; call once its commands are submitted
+        void EndFrame()
+        {
+            unsigned int slot = frame % TIMER_QUERIES;
+            glQueryCounter(queries[2 * slot + 1], GL_TIMESTAMP);
+            pending[slot] = true;
+            frames[slot] = frame;
+
+            timings[frame].cpuMs = milliseconds(frameStart, Clock::now());
+            frame++;
+        }
+
+        // waits for the last GPU times, then writes every frame's timings to path as CSV and prints a summary
+        bool Finish(const string &csvPath)
+        {
+            if(frame > 0)
+                timings[frame - 1].frameMs = milliseconds(frameStart, Clock::now());
+            for(unsigned int i = 0; i < TIMER_QUERIES; i++)
+                if(pending[(frame + i) % TIMER_QUERIES])
+                    collect((frame + i) % TIMER_QUERIES);
+
+            std::ofstream file(csvPath.c_str());
+            file << "frame,frame_ms,cpu_ms,gpu_ms" << std::endl;
+            for(unsigned int i = 0; i < timings.size(); i++)
+                file << i << "," << timings[i].frameMs << "," << timings[i].cpuMs << "," << timings[i].gpuMs << std::endl;
+            if(!file)
+            {
+                std::cout << "ERROR::CAMERA_REPLAY::TIMINGS_NOT_WRITTEN: " << csvPath << std::endl;
+                return false;
+            }
+
+            std::cout << "Replay of " << timings.size() << " frames, timings written to " << csvPath << std::endl;
+            summarize("frame", &FrameTiming::frameMs);
+            summarize("CPU", &FrameTiming::cpuMs);
+            summarize("GPU", &FrameTiming::gpuMs);
+            return true;
+        }
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        GLuint queries[2 * TIMER_QUERIES]; // start and end of each slot's frame
+        bool pending[TIMER_QUERIES];
+        unsigned int frames[TIMER_QUERIES]; // the frame each slot timed
+        Clock::time_point frameStart;
+
+        static float milliseconds(Clock::time_point from, Clock::time_point to)
+        {
+            return std::chrono::duration<float, std::milli>(to - from).count();
+        }
+
+        // reads a slot's GPU time, waiting for it if it hasn't arrived
+        void collect(unsigned int slot)
+        {
+            GLuint64 start = 0, end = 0;
+            glGetQueryObjectui64v(queries[2 * slot], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(queries[2 * slot + 1], GL_QUERY_RESULT, &end);
+            timings[frames[slot]].gpuMs = end > start ? (end - start) / 1e6f : 0.0f;
+            pending[slot] = false;
+        }
+
+        void summarize(const char *name, float FrameTiming::*member) const
+        {
+            if(timings.empty())
+                return;
+
+            vector<float> times(timings.size());
+            double sum = 0.0;
+            for(unsigned int i = 0; i < timings.size(); i++)
+            {
+                times[i] = timings[i].*member;
+                sum += times[i];
+            }
+            sort(times.begin(), times.end());
+            std::cout << "  " << name << ": " << sum / times.size() << " ms mean, median " << times[times.size() / 2] << " ms, 99th percentile "
+                      << times[min((size_t)(times.size() * 0.99), times.size() - 1)] << " ms, longest " << times.back() << " ms" << std::endl;
+        }
+};
+#endif
@@ -0,0 +1,607 @@
+#ifndef CLUSTEREDLIGHTS_H
+#define CLUSTEREDLIGHTS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <frustum.h>
+#include <shader.h>
+#include <uniformblocks.h>
+#include <profiler.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+// clustered forward lighting: the view is cut into a grid of screen tiles and exponential depth slices
+// (froxels), every point and spot light is binned into the clusters its range reaches, and a fragment
+// shades only the lights listed for its cluster (src/shaders/clusters.glsl, CLUSTERED_LIGHTS permutations).
+// binning runs on the CPU each frame; the lists go to the GPU as buffer textures, which 3.3 has (SSBOs need 4.3).
+
+// lights contributing less than this (of a channel at full brightness) are cut off, which bounds every light
+const float LIGHT_CUTOFF = 1.0f / 256.0f;
+
+// a point light, or a spot light when spot is set. cutoffs are cosines, as for SpotLight in lights.glsl
+struct LocalLight
+{
+    glm::vec3 position;
+    glm::vec3 direction; // spot lights only
+
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+
+    float constant;
+    float linear;
+    float quadratic;
+
+    float innerCutOff;
+    float outerCutOff;
+    bool spot;
+
+    LocalLight() : position(0.0f), direction(0.0f, 0.0f, -1.0f), ambient(0.0f), diffuse(1.0f), specular(1.0f),
+                   constant(1.0f), linear(0.7f), quadratic(1.8f), innerCutOff(0.976f), outerCutOff(0.953f), spot(false) {}
+};
+
+// the distance at which attenuation takes a light's brightest channel (of ambient + diffuse + specular)
+// below LIGHT_CUTOFF
+inline float AttenuationRadius(const glm::vec3 &total, float constant, float linear, float quadratic)
+{
+    float brightest = max(total.r, max(total.g, total.b));
+
+    // solve constant + linear * d + quadratic * d^2 = brightest / LIGHT_CUTOFF
+    float target = brightest / LIGHT_CUTOFF - constant;
+    if(target <= 0.0f)
+        return 0.0f;
+    if(quadratic > 0.0f)
+        return (-linear + sqrtf(linear * linear + 4.0f * quadratic * target)) / (2.0f * quadratic);
+    if(linear > 0.0f)
+        return target / linear;
+    return 1e6f; // no falloff at all, so it reaches everything
+}
+
+// the shaders drop the light beyond it too, so shading doesn't depend on which clusters a light landed in
+inline float LightRadius(const LocalLight &light)
+{
+    return AttenuationRadius(light.ambient + light.diffuse + light.specular, light.constant, light.linear, light.quadratic);
+}
+
+// light bounding spheres (world space) as structure of arrays, padded to a multiple of 8 like AABBSoA
+struct SphereSoA
+{
+    static const unsigned int LANES = 8;
+
+    vector<float> centerX, centerY, centerZ, radius;
+
+    SphereSoA() : count(0) {}
+
+    unsigned int size() const { return count; }
+
+    void clear()
+    {
+        count = 0;
+        centerX.clear(); centerY.clear(); centerZ.clear(); radius.clear();
+    }
+
+    void Add(const glm::vec3 &center, float r)
+    {
+        if(count == centerX.size())
+            pad(count + LANES);
+
+        centerX[count] = center.x; centerY[count] = center.y; centerZ[count] = center.z;
+        radius[count] = r;
+        count++;
+    }
+
+private:
+    unsigned int count;
+
+    // a padding sphere has a hugely negative radius, so it is never in front of the near plane
+    void pad(unsigned int n)
+    {
+        centerX.resize(n, 0.0f); centerY.resize(n, 0.0f); centerZ.resize(n, 0.0f);
+        radius.resize(n, -1e30f);
+    }
+};
+
+// the cluster grid for one view. x and y are tiles of the window, z is sliced exponentially between the
+// clip planes so every slice has about the same depth to width ratio: slice = log2(depth) * sliceScale + sliceBias
+struct ClusterParams
+{
+    static const unsigned int GRID_X = 16, GRID_Y = 9, GRID_Z = 24;
+    static const unsigned int CLUSTERS = GRID_X * GRID_Y * GRID_Z;
+
+    glm::mat4 view;
+    float projX, projY; // projection[0][0] and [1][1]: ndc = proj * (view space x or y) / depth
+    float zNear, zFar;
+    float sliceScale, sliceBias;
+
+    ClusterParams() : view(1.0f), projX(1.0f), projY(1.0f), zNear(0.1f), zFar(100.0f), sliceScale(1.0f), sliceBias(0.0f) {}
+
+    ClusterParams(const glm::mat4 &projection, const glm::mat4 &view, float zNear, float zFar)
+        : view(view), projX(projection[0][0]), projY(projection[1][1]), zNear(zNear), zFar(zFar)
+    {
+        sliceScale = GRID_Z / log2f(zFar / zNear);
+        sliceBias = -log2f(zNear) * sliceScale;
+    }
+};
+
+// the clusters a light reaches into, inclusive on every axis
+struct ClusterRange
+{
+    unsigned char minX, maxX, minY, maxY, minZ, maxZ;
+};
+
+// ranges are widened by this fraction of a cluster, covering the CPU's approximate log2 and rounding
+// differences against the shaders, so a light is never missing from a cluster it touches
+const float CLUSTER_EPSILON = 0.01f;
+
+// log2 from the float's exponent plus a short series for the mantissa (within 3e-4 of log2f), for the slicing kernels
+inline float fastLog2(float x)
+{
+    unsigned int bits;
+    memcpy(&bits, &x, sizeof(bits));
+    float exponent = (float)((int)((bits >> 23) & 255) - 127);
+    bits = (bits & 0x7fffff) | 0x3f800000;
+
+    float m;
+    memcpy(&m, &bits, sizeof(m));
+    float r = (m - 1.0f) / (m + 1.0f), r2 = r * r;
+    return exponent + r * (2.8853900f + r2 * (0.9617967f + r2 * 0.5770780f));
+}
+
+// the span of tiles a circle (centre c along the axis, depth w, radius r) covers, from the tangent lines
+// through the eye; false when it is off screen along this axis
+inline bool tileSpan(float c, float w, float r, float proj, unsigned int tiles, unsigned char &first, unsigned char &last)
+{
+    float d2 = c * c + w * w, r2 = r * r;
+    float t = sqrtf(max(d2 - r2, 0.0f));
+
+    float hiDen = w * t - c * r, loDen = w * t + c * r;
+    float hi = hiDen > 0.0f ? (c * t + r * w) / hiDen : 1e30f;  // a tangent behind the eye: unbounded
+    float lo = loDen > 0.0f ? (c * t - r * w) / loDen : -1e30f;
+    if(d2 <= r2)
+    {
+        lo = -1e30f;
+        hi = 1e30f;
+    }
+
+    lo *= proj;
+    hi *= proj;
+
+    float half = 0.5f * tiles;
+    float limit = (float)(tiles - 1);
+    first = (unsigned char)min(max(lo * half + half - CLUSTER_EPSILON, 0.0f), limit);
+    last = (unsigned char)min(max(hi * half + half + CLUSTER_EPSILON, 0.0f), limit);
+    return hi >= -1.0f && lo <= 1.0f;
+}
+
+// reference implementation, one light at a time. fills ranges[i] for every sphere and returns the number in view;
+// the ranges of lights out of view are left undefined
+inline unsigned int BinLightsScalar(const ClusterParams &params, const SphereSoA &spheres, ClusterRange *ranges)
+{
+    const glm::mat4 &v = params.view;
+    float sliceLimit = (float)(ClusterParams::GRID_Z - 1);
+    unsigned int inView = 0;
+
+    for(unsigned int i = 0; i < spheres.size(); i++)
+    {
+        float x = spheres.centerX[i], y = spheres.centerY[i], z = spheres.centerZ[i], r = spheres.radius[i];
+
+        // view space, with depth increasing away from the camera
+        float vx = (v[0][0] * x + v[1][0] * y) + (v[2][0] * z + v[3][0]);
+        float vy = (v[0][1] * x + v[1][1] * y) + (v[2][1] * z + v[3][1]);
+        float w = -((v[0][2] * x + v[1][2] * y) + (v[2][2] * z + v[3][2]));
+
+        bool inside = w + r > params.zNear && w - r < params.zFar;
+
+        ClusterRange &range = ranges[i];
+        float nearSlice = fastLog2(max(w - r, params.zNear)) * params.sliceScale + params.sliceBias - CLUSTER_EPSILON;
+        float farSlice = fastLog2(min(w + r, params.zFar)) * params.sliceScale + params.sliceBias + CLUSTER_EPSILON;
+        range.minZ = (unsigned char)min(max(nearSlice, 0.0f), sliceLimit);
+        range.maxZ = (unsigned char)min(max(farSlice, 0.0f), sliceLimit);
+
+        inside &= tileSpan(vx, w, r, params.projX, ClusterParams::GRID_X, range.minX, range.maxX);
+        inside &= tileSpan(vy, w, r, params.projY, ClusterParams::GRID_Y, range.minY, range.maxY);
+
+        if(!inside)
+        {
+            range.minX = 1;
+            range.maxX = 0;
+        }
+        inView += inside;
+    }
+    return inView;
+}
+
+#ifdef FRUSTUM_SSE
+inline __m128 fastLog2SSE(__m128 x)
+{
+    __m128i bits = _mm_castps_si128(x);
+    __m128 exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_and_si128(_mm_srli_epi32(bits, 23), _mm_set1_epi32(255)), _mm_set1_epi32(127)));
+    __m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x7fffff)), _mm_set1_epi32(0x3f800000)));
+
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 r = _mm_div_ps(_mm_sub_ps(m, one), _mm_add_ps(m, one));
+    __m128 r2 = _mm_mul_ps(r, r);
+    __m128 series = _mm_add_ps(_mm_set1_ps(0.9617967f), _mm_mul_ps(r2, _mm_set1_ps(0.5770780f)));
+    series = _mm_add_ps(_mm_set1_ps(2.8853900f), _mm_mul_ps(r2, series));
+    return _mm_add_ps(exponent, _mm_mul_ps(r, series));
+}
+
+inline __m128 selectSSE(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// tileSpan for four circles; returns the on screen mask
+inline __m128 tileSpanSSE(__m128 c, __m128 w, __m128 r, float proj, unsigned int tiles, __m128i &first, __m128i &last)
+{
+    __m128 d2 = _mm_add_ps(_mm_mul_ps(c, c), _mm_mul_ps(w, w)), r2 = _mm_mul_ps(r, r);
+    __m128 t = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(d2, r2), _mm_setzero_ps()));
+
+    __m128 hiDen = _mm_sub_ps(_mm_mul_ps(w, t), _mm_mul_ps(c, r)), loDen = _mm_add_ps(_mm_mul_ps(w, t), _mm_mul_ps(c, r));
+    __m128 hi = _mm_div_ps(_mm_add_ps(_mm_mul_ps(c, t), _mm_mul_ps(r, w)), hiDen);
+    __m128 lo = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(c, t), _mm_mul_ps(r, w)), loDen);
+
+    __m128 outside = _mm_cmpgt_ps(d2, r2);
+    hi = selectSSE(_mm_and_ps(outside, _mm_cmpgt_ps(hiDen, _mm_setzero_ps())), hi, _mm_set1_ps(1e30f));
+    lo = selectSSE(_mm_and_ps(outside, _mm_cmpgt_ps(loDen, _mm_setzero_ps())), lo, _mm_set1_ps(-1e30f));
+
+    __m128 scale = _mm_set1_ps(proj);
+    lo = _mm_mul_ps(lo, scale);
+    hi = _mm_mul_ps(hi, scale);
+
+    __m128 half = _mm_set1_ps(0.5f * tiles), epsilon = _mm_set1_ps(CLUSTER_EPSILON);
+    __m128 limit = _mm_set1_ps((float)(tiles - 1));
+    first = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_sub_ps(_mm_add_ps(_mm_mul_ps(lo, half), half), epsilon), _mm_setzero_ps()), limit));
+    last = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(hi, half), half), epsilon), _mm_setzero_ps()), limit));
+    return _mm_and_ps(_mm_cmpge_ps(hi, _mm_set1_ps(-1.0f)), _mm_cmple_ps(lo, _mm_set1_ps(1.0f)));
+}
+
+// four lights per step
+inline unsigned int BinLightsSSE(const ClusterParams &params, const SphereSoA &spheres, ClusterRange *ranges)
+{
+    const glm::mat4 &v = params.view;
+    __m128 v00 = _mm_set1_ps(v[0][0]), v10 = _mm_set1_ps(v[1][0]), v20 = _mm_set1_ps(v[2][0]), v30 = _mm_set1_ps(v[3][0]);
+    __m128 v01 = _mm_set1_ps(v[0][1]), v11 = _mm_set1_ps(v[1][1]), v21 = _mm_set1_ps(v[2][1]), v31 = _mm_set1_ps(v[3][1]);
+    __m128 v02 = _mm_set1_ps(v[0][2]), v12 = _mm_set1_ps(v[1][2]), v22 = _mm_set1_ps(v[2][2]), v32 = _mm_set1_ps(v[3][2]);
+    __m128 zNear = _mm_set1_ps(params.zNear), zFar = _mm_set1_ps(params.zFar);
+    __m128 sliceScale = _mm_set1_ps(params.sliceScale), sliceBias = _mm_set1_ps(params.sliceBias);
+    __m128 epsilon = _mm_set1_ps(CLUSTER_EPSILON), sliceLimit = _mm_set1_ps((float)(ClusterParams::GRID_Z - 1));
+
+    unsigned int inView = 0;
+    unsigned int count = spheres.size();
+
+    for(unsigned int i = 0; i < count; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(&spheres.centerX[i]), y = _mm_loadu_ps(&spheres.centerY[i]), z = _mm_loadu_ps(&spheres.centerZ[i]);
+        __m128 r = _mm_loadu_ps(&spheres.radius[i]);
+
+        __m128 vx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v00, x), _mm_mul_ps(v10, y)), _mm_add_ps(_mm_mul_ps(v20, z), v30));
+        __m128 vy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v01, x), _mm_mul_ps(v11, y)), _mm_add_ps(_mm_mul_ps(v21, z), v31));
+        __m128 w = _mm_sub_ps(_mm_setzero_ps(), _mm_add_ps(_mm_add_ps(_mm_mul_ps(v02, x), _mm_mul_ps(v12, y)), _mm_add_ps(_mm_mul_ps(v22, z), v32)));
+
+        __m128 inside = _mm_and_ps(_mm_cmpgt_ps(_mm_add_ps(w, r), zNear), _mm_cmplt_ps(_mm_sub_ps(w, r), zFar));
+
+        __m128 nearSlice = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(fastLog2SSE(_mm_max_ps(_mm_sub_ps(w, r), zNear)), sliceScale), sliceBias), epsilon);
+        __m128 farSlice = _mm_add_ps(_mm_add_ps(_mm_mul_ps(fastLog2SSE(_mm_min_ps(_mm_add_ps(w, r), zFar)), sliceScale), sliceBias), epsilon);
+        __m128i minZ = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(nearSlice, _mm_setzero_ps()), sliceLimit));
+        __m128i maxZ = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(farSlice, _mm_setzero_ps()), sliceLimit));
+
+        __m128i minX, maxX, minY, maxY;
+        inside = _mm_and_ps(inside, tileSpanSSE(vx, w, r, params.projX, ClusterParams::GRID_X, minX, maxX));
+        inside = _mm_and_ps(inside, tileSpanSSE(vy, w, r, params.projY, ClusterParams::GRID_Y, minY, maxY));
+
+        int mask = _mm_movemask_ps(inside);
+
+        int lanes[6][4];
+        _mm_storeu_si128((__m128i*)lanes[0], minX); _mm_storeu_si128((__m128i*)lanes[1], maxX);
+        _mm_storeu_si128((__m128i*)lanes[2], minY); _mm_storeu_si128((__m128i*)lanes[3], maxY);
+        _mm_storeu_si128((__m128i*)lanes[4], minZ); _mm_storeu_si128((__m128i*)lanes[5], maxZ);
+
+        unsigned int active = count - i < 4 ? count - i : 4;
+        for(unsigned int lane = 0; lane < active; lane++)
+        {
+            ClusterRange &range = ranges[i + lane];
+            bool visible = (mask >> lane) & 1;
+            range.minX = visible ? (unsigned char)lanes[0][lane] : 1;
+            range.maxX = visible ? (unsigned char)lanes[1][lane] : 0;
+            range.minY = (unsigned char)lanes[2][lane]; range.maxY = (unsigned char)lanes[3][lane];
+            range.minZ = (unsigned char)lanes[4][lane]; range.maxZ = (unsigned char)lanes[5][lane];
+            inView += visible;
+        }
+    }
+    return inView;
+}
+#endif
+
+#ifdef FRUSTUM_AVX
+// AVX has no 256-bit integer shifts, so the exponent is taken a half at a time
+inline __m256 fastLog2AVX(__m256 x)
+{
+    __m128 low = fastLog2SSE(_mm256_castps256_ps128(x));
+    __m128 high = fastLog2SSE(_mm256_extractf128_ps(x, 1));
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(low), high, 1);
+}
+
+inline __m256 tileSpanAVX(__m256 c, __m256 w, __m256 r, float proj, unsigned int tiles, __m256i &first, __m256i &last)
+{
+    __m256 d2 = _mm256_add_ps(_mm256_mul_ps(c, c), _mm256_mul_ps(w, w)), r2 = _mm256_mul_ps(r, r);
+    __m256 t = _mm256_sqrt_ps(_mm256_max_ps(_mm256_sub_ps(d2, r2), _mm256_setzero_ps()));
+
+    __m256 hiDen = _mm256_sub_ps(_mm256_mul_ps(w, t), _mm256_mul_ps(c, r)), loDen = _mm256_add_ps(_mm256_mul_ps(w, t), _mm256_mul_ps(c, r));
+    __m256 hi = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(c, t), _mm256_mul_ps(r, w)), hiDen);
+    __m256 lo = _mm256_div_ps(_mm256_sub_ps(_mm256_mul_ps(c, t), _mm256_mul_ps(r, w)), loDen);
+
+    __m256 outside = _mm256_cmp_ps(d2, r2, _CMP_GT_OQ);
+    hi = _mm256_blendv_ps(_mm256_set1_ps(1e30f), hi, _mm256_and_ps(outside, _mm256_cmp_ps(hiDen, _mm256_setzero_ps(), _CMP_GT_OQ)));
+    lo = _mm256_blendv_ps(_mm256_set1_ps(-1e30f), lo, _mm256_and_ps(outside, _mm256_cmp_ps(loDen, _mm256_setzero_ps(), _CMP_GT_OQ)));
+
+    __m256 scale = _mm256_set1_ps(proj);
+    lo = _mm256_mul_ps(lo, scale);
+    hi = _mm256_mul_ps(hi, scale);
+
+    __m256 half = _mm256_set1_ps(0.5f * tiles), epsilon = _mm256_set1_ps(CLUSTER_EPSILON);
+    __m256 limit = _mm256_set1_ps((float)(tiles - 1));
+    first = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(lo, half), half), epsilon), _mm256_setzero_ps()), limit));
+    last = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(hi, half), half), epsilon), _mm256_setzero_ps()), limit));
+    return _mm256_and_ps(_mm256_cmp_ps(hi, _mm256_set1_ps(-1.0f), _CMP_GE_OQ), _mm256_cmp_ps(lo, _mm256_set1_ps(1.0f), _CMP_LE_OQ));
+}
+
+// eight lights per step
+inline unsigned int BinLightsAVX(const ClusterParams &params, const SphereSoA &spheres, ClusterRange *ranges)
+{
+    const glm::mat4 &v = params.view;
+    __m256 v00 = _mm256_set1_ps(v[0][0]), v10 = _mm256_set1_ps(v[1][0]), v20 = _mm256_set1_ps(v[2][0]), v30 = _mm256_set1_ps(v[3][0]);
+    __m256 v01 = _mm256_set1_ps(v[0][1]), v11 = _mm256_set1_ps(v[1][1]), v21 = _mm256_set1_ps(v[2][1]), v31 = _mm256_set1_ps(v[3][1]);
+    __m256 v02 = _mm256_set1_ps(v[0][2]), v12 = _mm256_set1_ps(v[1][2]), v22 = _mm256_set1_ps(v[2][2]), v32 = _mm256_set1_ps(v[3][2]);
+    __m256 zNear = _mm256_set1_ps(params.zNear), zFar = _mm256_set1_ps(params.zFar);
+    __m256 sliceScale = _mm256_set1_ps(params.sliceScale), sliceBias = _mm256_set1_ps(params.sliceBias);
+    __m256 epsilon = _mm256_set1_ps(CLUSTER_EPSILON), sliceLimit = _mm256_set1_ps((float)(ClusterParams::GRID_Z - 1));
+
+    unsigned int inView = 0;
+    unsigned int count = spheres.size();
+
+    for(unsigned int i = 0; i < count; i += 8)
+    {
+        __m256 x = _mm256_loadu_ps(&spheres.centerX[i]), y = _mm256_loadu_ps(&spheres.centerY[i]), z = _mm256_loadu_ps(&spheres.centerZ[i]);
+        __m256 r = _mm256_loadu_ps(&spheres.radius[i]);
+
+        __m256 vx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(v00, x), _mm256_mul_ps(v10, y)), _mm256_add_ps(_mm256_mul_ps(v20, z), v30));
+        __m256 vy = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(v01, x), _mm256_mul_ps(v11, y)), _mm256_add_ps(_mm256_mul_ps(v21, z), v31));
+        __m256 w = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(v02, x), _mm256_mul_ps(v12, y)), _mm256_add_ps(_mm256_mul_ps(v22, z), v32)));
+
+        __m256 inside = _mm256_and_ps(_mm256_cmp_ps(_mm256_add_ps(w, r), zNear, _CMP_GT_OQ), _mm256_cmp_ps(_mm256_sub_ps(w, r), zFar, _CMP_LT_OQ));
+
+        __m256 nearSlice = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(fastLog2AVX(_mm256_max_ps(_mm256_sub_ps(w, r), zNear)), sliceScale), sliceBias), epsilon);
+        __m256 farSlice = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(fastLog2AVX(_mm256_min_ps(_mm256_add_ps(w, r), zFar)), sliceScale), sliceBias), epsilon);
+        __m256i minZ = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(nearSlice, _mm256_setzero_ps()), sliceLimit));
+        __m256i maxZ = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(farSlice, _mm256_setzero_ps()), sliceLimit));
+
+        __m256i minX, maxX, minY, maxY;
+        inside = _mm256_and_ps(inside, tileSpanAVX(vx, w, r, params.projX, ClusterParams::GRID_X, minX, maxX));
+        inside = _mm256_and_ps(inside, tileSpanAVX(vy, w, r, params.projY, ClusterParams::GRID_Y, minY, maxY));
+
+        int mask = _mm256_movemask_ps(inside);
+
+        int lanes[6][8];
+        _mm256_storeu_si256((__m256i*)lanes[0], minX); _mm256_storeu_si256((__m256i*)lanes[1], maxX);
+        _mm256_storeu_si256((__m256i*)lanes[2], minY); _mm256_storeu_si256((__m256i*)lanes[3], maxY);
+        _mm256_storeu_si256((__m256i*)lanes[4], minZ); _mm256_storeu_si256((__m256i*)lanes[5], maxZ);
+
+        unsigned int active = count - i < 8 ? count - i : 8;
+        for(unsigned int lane = 0; lane < active; lane++)
+        {
+            ClusterRange &range = ranges[i + lane];
+            bool visible = (mask >> lane) & 1;
+            range.minX = visible ? (unsigned char)lanes[0][lane] : 1;
+            range.maxX = visible ? (unsigned char)lanes[1][lane] : 0;
+            range.minY = (unsigned char)lanes[2][lane]; range.maxY = (unsigned char)lanes[3][lane];
+            range.minZ = (unsigned char)lanes[4][lane]; range.maxZ = (unsigned char)lanes[5][lane];
+            inView += visible;
+        }
+    }
+    return inView;
+}
+#endif
+
+// bins with the widest kernel the build supports. ranges must hold spheres.size() entries
+inline unsigned int BinLights(const ClusterParams &params, const SphereSoA &spheres, ClusterRange *ranges)
+{
+#if defined(FRUSTUM_AVX)
+    return BinLightsAVX(params, spheres, ranges);
+#elif defined(FRUSTUM_SSE)
+    return BinLightsSSE(params, spheres, ranges);
+#else
+    return BinLightsScalar(params, spheres, ranges);
+#endif
+}
+
+// per-frame light lists for the CLUSTERED_LIGHTS permutations. Build is CPU only; Upload streams the result
+// into three buffer textures: the lights in view, a (first, count) pair per cluster, and the index lists
+class ClusteredLights
+{
+    public:
+        // texture units of the buffer textures, above those the materials use
+        static const unsigned int LIGHTS_UNIT = 13, RANGES_UNIT = 14, INDICES_UNIT = 15;
+
+        // RGBA32F texels per light in the lights texture, matching LOCAL_LIGHT_TEXELS in clusters.glsl
+        static const unsigned int LIGHT_TEXELS = 6;
+
+        ClusterParams params;
+        ClustersBlock block;        // the grid for the shaders, copied into FrameUniforms::clusters
+        SphereSoA spheres;          // bounds of the lights passed to the last Build
+        vector<ClusterRange> ranges; // the clusters each of them reaches
+
+        vector<glm::vec4> lightTexels;      // lights in view, LIGHT_TEXELS each
+        vector<glm::uvec2> clusterLights;   // per cluster, the first entry and count in lightIndices
+        vector<unsigned int> lightIndices;  // into the lights in view
+
+        // of the last Build
+        unsigned int lightsInView;
+        unsigned int occupiedClusters; // clusters with at least one light
+        unsigned int maxClusterLights;
+
+        ClusteredLights() : lightsInView(0), occupiedClusters(0), maxClusterLights(0), buffers(), textures()
+        {
+            memset(&block, 0, sizeof(block));
+        }
+
+        // assigns the lights to the clusters of a view drawn into a width x height window
+        void Build(const vector<LocalLight> &lights, const glm::mat4 &projection, const glm::mat4 &view,
+                   unsigned int width, unsigned int height, float zNear, float zFar)
+        {
+            PROFILE_ZONE("ClusteredLights::Build");
+            params = ClusterParams(projection, view, zNear, zFar);
+
+            block.grid = glm::uvec4(ClusterParams::GRID_X, ClusterParams::GRID_Y, ClusterParams::GRID_Z, 0);
+            block.scale = glm::vec4((float)ClusterParams::GRID_X / max(width, 1u), (float)ClusterParams::GRID_Y / max(height, 1u),
+                                    params.sliceScale, params.sliceBias);
+
+            spheres.clear();
+            for(unsigned int i = 0; i < lights.size(); i++)
+                spheres.Add(lights[i].position, LightRadius(lights[i]));
+
+            ranges.resize(spheres.size());
+            lightsInView = spheres.size() ? BinLights(params, spheres, &ranges[0]) : 0;
+
+            // count every cluster's lights, turn the counts into offsets, then scatter the indices
+            counts.assign(ClusterParams::CLUSTERS, 0);
+            lightTexels.clear();
+            for(unsigned int i = 0; i < lights.size(); i++)
+            {
+                const ClusterRange &range = ranges[i];
+                if(range.minX > range.maxX)
+                    continue;
+
+                packLight(lights[i], spheres.radius[i]);
+                forEachCluster(range, [&](unsigned int cluster) { counts[cluster]++; });
+            }
+
+            clusterLights.resize(ClusterParams::CLUSTERS);
+            unsigned int total = 0;
+            occupiedClusters = maxClusterLights = 0;
+            for(unsigned int c = 0; c < ClusterParams::CLUSTERS; c++)
+            {
+                clusterLights[c] = glm::uvec2(total, counts[c]);
+                total += counts[c];
+                occupiedClusters += counts[c] > 0;
+                maxClusterLights = max(maxClusterLights, counts[c]);
+                counts[c] = clusterLights[c].x; // now the next free entry
+            }
+
+            lightIndices.resize(total);
+            unsigned int packed = 0;
+            for(unsigned int i = 0; i < lights.size(); i++)
+            {
+                const ClusterRange &range = ranges[i];
+                if(range.minX > range.maxX)
+                    continue;
+
+                forEachCluster(range, [&](unsigned int cluster) { lightIndices[counts[cluster]++] = packed; });
+                packed++;
+            }
+        }
+
+        // streams the last Build into the buffer textures and binds them to their units
+        void Upload()
+        {
+            PROFILE_ZONE("ClusteredLights::Upload");
+            if(!buffers[0])
+            {
+                glGenBuffers(3, buffers);
+                glGenTextures(3, textures);
+
+                GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+                for(unsigned int i = 0; i < 3; i++)
+                {
+                    glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+                    glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+                    glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+                }
+                glBindTexture(GL_TEXTURE_BUFFER, 0);
+            }
+
+            upload(0, LIGHTS_UNIT, lightTexels.empty() ? NULL : &lightTexels[0], lightTexels.size() * sizeof(glm::vec4));
+            upload(1, RANGES_UNIT, &clusterLights[0], clusterLights.size() * sizeof(glm::uvec2));
+            upload(2, INDICES_UNIT, lightIndices.empty() ? NULL : &lightIndices[0], lightIndices.size() * sizeof(unsigned int));
+            glActiveTexture(GL_TEXTURE0);
+        }
+
+        // points a CLUSTERED_LIGHTS program's samplers at the units; the program must be in use.
+        // cheap to repeat, the shadow uniforms drop it unless the program was relinked
+        void Bind(const Shader &shader) const
+        {
+            shader.setInt("clusterLights", LIGHTS_UNIT);
+            shader.setInt("clusterRanges", RANGES_UNIT);
+            shader.setInt("clusterLightIndices", INDICES_UNIT);
+        }
+
+        // the index of the cluster holding a window position at a view depth, as the shaders compute it
+        unsigned int ClusterAt(float windowX, float windowY, float depth) const
+        {
+            int x = (int)(windowX * block.scale.x), y = (int)(windowY * block.scale.y);
+            int z = (int)(log2f(depth) * block.scale.z + block.scale.w);
+            x = min(max(x, 0), (int)ClusterParams::GRID_X - 1);
+            y = min(max(y, 0), (int)ClusterParams::GRID_Y - 1);
+            z = min(max(z, 0), (int)ClusterParams::GRID_Z - 1);
+            return (z * ClusterParams::GRID_Y + y) * ClusterParams::GRID_X + x;
+        }
+
+    private:
+        vector<unsigned int> counts;
+        GLuint buffers[3];
+        GLuint textures[3];
+
+        template<typename Function>
+        static void forEachCluster(const ClusterRange &range, Function function)
+        {
+            for(unsigned int z = range.minZ; z <= range.maxZ; z++)
+                for(unsigned int y = range.minY; y <= range.maxY; y++)
+                {
+                    unsigned int row = (z * ClusterParams::GRID_Y + y) * ClusterParams::GRID_X;
+                    for(unsigned int x = range.minX; x <= range.maxX; x++)
+                        function(row + x);
+                }
+        }
+
+        // the texel layout read by FetchLocalLight in clusters.glsl. the cone is kept as a scale and offset
+        // on the cosine to the spot direction, so a point light is a spot light whose cone always gives 1
+        void packLight(const LocalLight &light, float radius)
+        {
+            float coneScale = 0.0f, coneOffset = 1.0f;
+            glm::vec3 towardsLight(0.0f, 0.0f, 1.0f);
+            if(light.spot)
+            {
+                coneScale = 1.0f / max(light.innerCutOff - light.outerCutOff, 1e-4f);
+                coneOffset = -light.outerCutOff * coneScale;
+                towardsLight = -glm::normalize(light.direction);
+            }
+
+            lightTexels.push_back(glm::vec4(light.position, radius));
+            lightTexels.push_back(glm::vec4(light.ambient, light.constant));
+            lightTexels.push_back(glm::vec4(light.diffuse, light.linear));
+            lightTexels.push_back(glm::vec4(light.specular, light.quadratic));
+            lightTexels.push_back(glm::vec4(towardsLight, coneScale));
+            lightTexels.push_back(glm::vec4(coneOffset, 0.0f, 0.0f, 0.0f));
+        }
+
+        // respecifies the store every frame (orphaning it, so the GPU can keep reading last frame's)
+        void upload(unsigned int i, unsigned int unit, const void *data, size_t size)
+        {
+            static const unsigned int empty[4] = { 0, 0, 0, 0 };
+
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, size ? size : sizeof(empty), size ? data : empty, GL_STREAM_DRAW);
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+            glActiveTexture(GL_TEXTURE0 + unit);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        }
+};
+#endif
@@ -0,0 +1,226 @@
+#ifndef COMMANDLIST_H
+#define COMMANDLIST_H
+
+#include <glm/glm.hpp>
+
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+// a compact, GL-agnostic stream of draw commands.
+// recording touches no GL state, so worker threads can each fill their own list for a disjoint range of
+// objects while the GL thread waits; the GL thread then replays the lists in order through a backend.
+// objects are plain GL names and uniform locations resolved up front. commands are packed as a one byte
+// opcode followed by their arguments, and bindings that wouldn't change anything are dropped while recording.
+class CommandList
+{
+    public:
+        enum Opcode
+        {
+            BIND_PROGRAM,      // program
+            BIND_VERTEX_ARRAY, // vertex array
+            BIND_TEXTURE,      // unit, 2D texture
+            SET_INT,           // location, value
+            SET_FLOAT,         // location, value
+            SET_MAT3,          // location, 9 floats
+            SET_MAT4,          // location, 16 floats
+            DRAW_ELEMENTS      // index count, first index, base vertex (unsigned int indices, triangles)
+        };
+
+        static const unsigned int MAX_TEXTURE_UNITS = 16;
+
+        vector<unsigned char> data;
+        unsigned int commands; // recorded commands
+        unsigned int draws;    // of which draws
+
+        CommandList() : commands(0), draws(0)
+        {
+            clear();
+        }
+
+        // empties the list, keeping its memory for the next frame
+        void clear()
+        {
+            data.clear();
+            commands = draws = 0;
+            program = vertexArray = ~0u;
+            for(unsigned int i = 0; i < MAX_TEXTURE_UNITS; i++)
+                textures[i] = ~0u;
+        }
+
+        void BindProgram(unsigned int id)
+        {
+            if(id == program)
+                return;
+            program = id;
+            record(BIND_PROGRAM, id);
+        }
+
+        void BindVertexArray(unsigned int id)
+        {
+            if(id == vertexArray)
+                return;
+            vertexArray = id;
+            record(BIND_VERTEX_ARRAY, id);
+        }
+
+        void BindTexture(unsigned int unit, unsigned int id)
+        {
+            if(unit < MAX_TEXTURE_UNITS)
+            {
+                if(textures[unit] == id)
+                    return;
+                textures[unit] = id;
+            }
+            record(BIND_TEXTURE, unit, id);
+        }
+
+        void SetInt(int location, int value)
+        {
+            record(SET_INT, location, value);
+        }
+
+        void SetFloat(int location, float value)
+        {
+            record(SET_FLOAT, location, value);
+        }
+
+        void SetMat3(int location, const glm::mat3 &value)
+        {
+            record(SET_MAT3, location, value);
+        }
+
+        void SetMat4(int location, const glm::mat4 &value)
+        {
+            record(SET_MAT4, location, value);
+        }
+
+        void DrawElements(unsigned int count, unsigned int firstIndex = 0, int baseVertex = 0)
+        {
+            record(DRAW_ELEMENTS, count, firstIndex, baseVertex);
+            draws++;
+        }
+
+        // decodes the list, calling the matching backend method for every command
+        template<typename Backend>
+        void Replay(Backend &backend) const
+        {
+            const unsigned char *p = data.empty() ? NULL : &data[0];
+            const unsigned char *end = p + data.size();
+
+            while(p < end)
+            {
+                unsigned char opcode = *p++;
+                switch(opcode)
+                {
+                    case BIND_PROGRAM:
+                    {
+                        unsigned int id = get<unsigned int>(p);
+                        backend.BindProgram(id);
+                        break;
+                    }
+                    case BIND_VERTEX_ARRAY:
+                    {
+                        unsigned int id = get<unsigned int>(p);
+                        backend.BindVertexArray(id);
+                        break;
+                    }
+                    case BIND_TEXTURE:
+                    {
+                        unsigned int unit = get<unsigned int>(p);
+                        unsigned int id = get<unsigned int>(p);
+                        backend.BindTexture(unit, id);
+                        break;
+                    }
+                    case SET_INT:
+                    {
+                        int location = get<int>(p);
+                        int value = get<int>(p);
+                        backend.SetInt(location, value);
+                        break;
+                    }
+                    case SET_FLOAT:
+                    {
+                        int location = get<int>(p);
+                        float value = get<float>(p);
+                        backend.SetFloat(location, value);
+                        break;
+                    }
+                    case SET_MAT3:
+                    {
+                        int location = get<int>(p);
+                        glm::mat3 value = get<glm::mat3>(p);
+                        backend.SetMat3(location, value);
+                        break;
+                    }
+                    case SET_MAT4:
+                    {
+                        int location = get<int>(p);
+                        glm::mat4 value = get<glm::mat4>(p);
+                        backend.SetMat4(location, value);
+                        break;
+                    }
+                    case DRAW_ELEMENTS:
+                    {
+                        unsigned int count = get<unsigned int>(p);
+                        unsigned int firstIndex = get<unsigned int>(p);
+                        int baseVertex = get<int>(p);
+                        backend.DrawElements(count, firstIndex, baseVertex);
+                        break;
+                    }
+                    default:
+                        return; // corrupt stream
+                }
+            }
+        }
+
+    private:
+        // last binding recorded, so repeats can be dropped
+        unsigned int program, vertexArray;
+        unsigned int textures[MAX_TEXTURE_UNITS];
+
+        // appends a command in one go; arguments are packed unaligned, so they are copied in and out
+        unsigned char *append(Opcode opcode, size_t argumentBytes)
+        {
+            size_t offset = data.size();
+            data.resize(offset + 1 + argumentBytes);
+            data[offset] = (unsigned char)opcode;
+            commands++;
+            return &data[offset + 1];
+        }
+
+        template<typename A>
+        void record(Opcode opcode, const A &a)
+        {
+            unsigned char *p = append(opcode, sizeof(A));
+            memcpy(p, &a, sizeof(A));
+        }
+
+        template<typename A, typename B>
+        void record(Opcode opcode, const A &a, const B &b)
+        {
+            unsigned char *p = append(opcode, sizeof(A) + sizeof(B));
+            memcpy(p, &a, sizeof(A));
+            memcpy(p + sizeof(A), &b, sizeof(B));
+        }
+
+        template<typename A, typename B, typename C>
+        void record(Opcode opcode, const A &a, const B &b, const C &c)
+        {
+            unsigned char *p = append(opcode, sizeof(A) + sizeof(B) + sizeof(C));
+            memcpy(p, &a, sizeof(A));
+            memcpy(p + sizeof(A), &b, sizeof(B));
+            memcpy(p + sizeof(A) + sizeof(B), &c, sizeof(C));
+        }
+
+        template<typename T>
+        static T get(const unsigned char *&p)
+        {
+            T value;
+            memcpy(&value, p, sizeof(T));
+            p += sizeof(T);
+            return value;
+        }
+};
+#endif
@@ -0,0 +1,117 @@
+#ifndef DEPTHPREPASS_H
+#define DEPTHPREPASS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <shader.h>
+#include <model.h>
+#include <transforms.h>
+#include <profiler.h>
+
+#include <vector>
+
+using namespace std;
+
+// optional depth pre-pass: visible meshes are first drawn depth-only from their position-only streams
+// with a trivial shader, then the main pass tests with GL_EQUAL and no depth writes, so the expensive
+// fragment shader only runs for the surface that ends up on screen.
+// also counts the main pass's fragment shader invocations (ARB_pipeline_statistics_query), or the
+// samples that passed the depth test where that isn't available, read back without stalling.
+class DepthPrePass
+{
+    public:
+        static const unsigned int QUERIES = 3; // frames a result may take to arrive
+
+        // true when invocations are counted exactly, false when samples passed stand in for them
+        bool statistics;
+
+        // main pass count of the latest frame whose result has arrived
+        GLuint64 invocations;
+
+        DepthPrePass() : statistics(false), invocations(0), frame(0), depthShader("depth.vs", "depth.fs")
+        {
+            statistics = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 6) || GLAD_GL_ARB_pipeline_statistics_query;
+            target = statistics ? GL_FRAGMENT_SHADER_INVOCATIONS_ARB : GL_SAMPLES_PASSED;
+
+            glGenQueries(QUERIES, queries);
+            for(unsigned int i = 0; i < QUERIES; i++)
+                pending[i] = false;
+        }
+
+        // lays down depth for the visible meshes of a model, with the same per-mesh transforms (one per mesh)
+        // the main pass draws them with
+        void Draw(Model &model, const vector<ObjectTransform> &transforms, const vector<unsigned char> &visible)
+        {
+            PROFILE_GPU_ZONE("DepthPrePass::Draw");
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+            depthShader.use();
+            for(unsigned int i = 0; i < model.meshes.size(); i++)
+            {
+                if(i < visible.size() && !visible[i])
+                    continue;
+
+                depthShader.setMat4("modelViewProjection", transforms[i].modelViewProjection);
+                model.meshes[i].DrawDepth();
+            }
+
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        }
+
+        // starts the main pass; after a pre-pass only fragments exactly on the laid down depth are shaded
+        void BeginMainPass(bool prePassed)
+        {
+            if(prePassed)
+            {
+                glDepthFunc(GL_EQUAL);
+                glDepthMask(GL_FALSE);
+            }
+
+            // results arrive a few frames late; a slot still in flight is simply not measured this frame
+            unsigned int slot = frame % QUERIES;
+            collect(slot);
+            counting = !pending[slot];
+            if(counting)
+                glBeginQuery(target, queries[slot]);
+        }
+
+        void EndMainPass()
+        {
+            if(counting)
+            {
+                glEndQuery(target);
+                pending[frame % QUERIES] = true;
+            }
+
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+            frame++;
+        }
+
+    private:
+        unsigned long long frame;
+        GLenum target;
+        unsigned int queries[QUERIES];
+        bool pending[QUERIES];
+        bool counting;
+
+        Shader depthShader;
+
+        // reads the result held by a slot about to be reused, i.e. the oldest one, if it has arrived
+        void collect(unsigned int slot)
+        {
+            if(!pending[slot])
+                return;
+
+            GLuint available = 0;
+            glGetQueryObjectuiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+            if(!available)
+                return;
+
+            glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &invocations);
+            pending[slot] = false;
+        }
+};
+#endif
@@ -0,0 +1,206 @@
+#ifndef DYNAMICRESOLUTION_H
+#define DYNAMICRESOLUTION_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <profiler.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+// renders the scene into an offscreen target at a fraction of the window's size, picked every frame to hold
+// the scene's GPU time at targetMilliseconds, then upscales it into the window with a filtered blit.
+// the passes between Begin and End are timed with GL_TIME_ELAPSED queries, read back a few frames later
+// without stalling. their cost follows the pixel count, so from a frame's time at the scale it was drawn at
+// the controller predicts the scale that meets the target: over budget it drops there at once, under budget
+// it climbs back gradually, and changes smaller than a dead band are ignored so the resolution doesn't hunt.
+// the target is allocated at maxScale once per window size; a scale change only moves the viewport.
+class DynamicResolution
+{
+    public:
+        static const unsigned int TIMER_QUERIES = 4; // frames a GPU time may take to arrive
+        static const unsigned int SCALE_STEPS = 32;  // scales are whole multiples of 1 / SCALE_STEPS
+
+        float targetMilliseconds; // GPU budget of the passes between Begin and End
+        float minScale, maxScale; // of each side of the window
+        bool enabled;             // off: the scene is drawn straight into the window at its full size, still timed
+
+        // controller state
+        float scale;                      // of each side, for the next frame while enabled
+        unsigned int width, height;       // size the scene is drawn at this frame
+        unsigned int outputWidth, outputHeight; // the window's
+        float gpuMilliseconds;            // the latest timed frame
+        float measuredScale;              // the scale that frame was drawn at
+        unsigned int adjustments;         // scale changes so far
+
+        DynamicResolution(float targetMilliseconds = 1000.0f / 60.0f, float minScale = 0.5f, float maxScale = 1.0f)
+            : targetMilliseconds(targetMilliseconds), minScale(minScale), maxScale(maxScale), enabled(true), scale(maxScale),
+              width(0), height(0), outputWidth(0), outputHeight(0), gpuMilliseconds(0.0f), measuredScale(maxScale), adjustments(0),
+              FBO(0), colour(0), depth(0), targetWidth(0), targetHeight(0), frame(0), timing(false)
+        {
+            glGenQueries(TIMER_QUERIES, queries);
+            for(unsigned int q = 0; q < TIMER_QUERIES; q++)
+                pending[q] = false;
+        }
+
+        // picks this frame's size from the GPU times that have arrived; call before anything sized to the scene
+        void Update(unsigned int windowWidth, unsigned int windowHeight)
+        {
+            outputWidth = windowWidth;
+            outputHeight = windowHeight;
+
+            collect();
+
+            float used = enabled ? scale : 1.0f;
+            width = max(1u, (unsigned int)(outputWidth * used + 0.5f));
+            height = max(1u, (unsigned int)(outputHeight * used + 0.5f));
+        }
+
+        // everything drawn until End goes into the scene target at width x height; starts the frame's timer
+        void Begin()
+        {
+            if(enabled)
+            {
+                allocate();
+                glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+            }
+            else
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glViewport(0, 0, width, height);
+
+            unsigned int slot = frame % TIMER_QUERIES;
+            timing = !pending[slot];
+            if(timing)
+            {
+                glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+                scales[slot] = enabled ? scale : 1.0f;
+            }
+        }
+
+        // stops the timer and upscales the scene into the window, leaving it bound with its full viewport
+        void End()
+        {
+            PROFILE_GPU_ZONE("DynamicResolution::End");
+            if(timing)
+            {
+                glEndQuery(GL_TIME_ELAPSED);
+                pending[frame % TIMER_QUERIES] = true;
+            }
+            frame++;
+
+            if(enabled)
+            {
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+                bool same = width == outputWidth && height == outputHeight;
+                glBlitFramebuffer(0, 0, width, height, 0, 0, outputWidth, outputHeight, GL_COLOR_BUFFER_BIT, same ? GL_NEAREST : GL_LINEAR);
+            }
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glViewport(0, 0, outputWidth, outputHeight);
+        }
+
+    private:
+        unsigned int FBO, colour, depth;
+        unsigned int targetWidth, targetHeight; // allocated size of the target
+
+        unsigned int queries[TIMER_QUERIES];
+        bool pending[TIMER_QUERIES];
+        float scales[TIMER_QUERIES]; // scale of the frame each query timed
+        unsigned int frame;
+        bool timing;
+
+        // (re)allocates the target at maxScale of the window when either changed
+        void allocate()
+        {
+            unsigned int neededWidth = max(1u, (unsigned int)ceilf(outputWidth * max(maxScale, 1.0f)));
+            unsigned int neededHeight = max(1u, (unsigned int)ceilf(outputHeight * max(maxScale, 1.0f)));
+            if(FBO && neededWidth == targetWidth && neededHeight == targetHeight)
+                return;
+
+            if(!FBO)
+            {
+                glGenFramebuffers(1, &FBO);
+                glGenTextures(1, &colour);
+                glGenRenderbuffers(1, &depth);
+            }
+            targetWidth = neededWidth;
+            targetHeight = neededHeight;
+
+            // linear filtering isn't used by the blit, but leaves the colour ready for a sampled upscale
+            glBindTexture(GL_TEXTURE_2D, colour);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, targetWidth, targetHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glBindTexture(GL_TEXTURE_2D, 0);
+
+            glBindRenderbuffer(GL_RENDERBUFFER, depth);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, targetWidth, targetHeight);
+            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+            glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colour, 0);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+            if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cout << "ERROR::DYNAMIC_RESOLUTION::FRAMEBUFFER_INCOMPLETE: " << targetWidth << "x" << targetHeight << std::endl;
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        }
+
+        // feeds every GPU time that has arrived to the controller, oldest first
+        void collect()
+        {
+            for(unsigned int i = 0; i < TIMER_QUERIES; i++)
+            {
+                unsigned int q = (frame + i) % TIMER_QUERIES;
+                if(!pending[q])
+                    continue;
+
+                GLuint available = 0;
+                glGetQueryObjectuiv(queries[q], GL_QUERY_RESULT_AVAILABLE, &available);
+                if(!available)
+                    break; // later frames can't have finished first
+
+                GLuint64 nanoseconds = 0;
+                glGetQueryObjectui64v(queries[q], GL_QUERY_RESULT, &nanoseconds);
+                pending[q] = false;
+
+                gpuMilliseconds = nanoseconds / 1e6f;
+                measuredScale = scales[q];
+                control();
+            }
+        }
+
+        void control()
+        {
+            float lowest = max(minScale, 1.0f / SCALE_STEPS), highest = max(maxScale, lowest);
+            if(!enabled)
+            {
+                scale = highest;
+                return;
+            }
+
+            // time goes with the pixel count, the square of the scale
+            float wanted = glm::clamp(measuredScale * sqrtf(targetMilliseconds / max(gpuMilliseconds, 0.01f)), lowest, highest);
+            float next = scale;
+            if(gpuMilliseconds > targetMilliseconds)
+                next = min(wanted, scale);
+            else if(wanted > scale * 1.05f)
+                next = scale + (wanted - scale) * 0.25f;
+
+            // whole steps, so the scene's size only changes when the scale moved by one
+            next = next < scale ? floorf(next * SCALE_STEPS) / SCALE_STEPS : ceilf(next * SCALE_STEPS) / SCALE_STEPS;
+            next = glm::clamp(next, lowest, highest);
+            if(next != scale)
+            {
+                scale = next;
+                adjustments++;
+            }
+        }
+};
+#endif
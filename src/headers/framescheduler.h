@@ -0,0 +1,221 @@
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+
+#include <profiler.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// frame times in fixed width buckets, for pacing and jitter: a steady frame rate is one narrow peak
+class FrameTimeHistogram
+{
+    public:
+        float bucketMilliseconds;
+        vector<unsigned int> buckets; // the last one also holds everything longer
+
+        unsigned int frames;
+        double sum, sumSquares; // of the frame times, in milliseconds
+        float shortest, longest;
+
+        FrameTimeHistogram(float bucketMilliseconds = 0.25f, float rangeMilliseconds = 50.0f)
+            : bucketMilliseconds(bucketMilliseconds), buckets((unsigned int)ceilf(rangeMilliseconds / bucketMilliseconds) + 1, 0)
+        {
+            Reset();
+        }
+
+        void Add(float milliseconds)
+        {
+            unsigned int bucket = min((unsigned int)(max(milliseconds, 0.0f) / bucketMilliseconds), (unsigned int)buckets.size() - 1);
+            buckets[bucket]++;
+
+            frames++;
+            sum += milliseconds;
+            sumSquares += (double)milliseconds * milliseconds;
+            shortest = min(shortest, milliseconds);
+            longest = max(longest, milliseconds);
+        }
+
+        void Reset()
+        {
+            fill(buckets.begin(), buckets.end(), 0u);
+            frames = 0;
+            sum = sumSquares = 0.0;
+            shortest = 1e30f;
+            longest = 0.0f;
+        }
+
+        float Mean() const
+        {
+            return frames ? (float)(sum / frames) : 0.0f;
+        }
+
+        // standard deviation of the frame times
+        float Jitter() const
+        {
+            if(!frames)
+                return 0.0f;
+            double mean = sum / frames;
+            return (float)sqrt(max(sumSquares / frames - mean * mean, 0.0));
+        }
+
+        // the upper edge of the bucket the given fraction of frames (0-1) falls within
+        float Percentile(float fraction) const
+        {
+            unsigned int wanted = (unsigned int)ceilf(fraction * frames), seen = 0;
+            for(unsigned int b = 0; b < buckets.size(); b++)
+            {
+                seen += buckets[b];
+                if(seen >= wanted && seen > 0)
+                    return b + 1 < buckets.size() ? (b + 1) * bucketMilliseconds : longest;
+            }
+            return 0.0f;
+        }
+
+        // the non-empty buckets, one line each with a bar scaled to the fullest
+        void Print(std::ostream &out) const
+        {
+            unsigned int fullest = *max_element(buckets.begin(), buckets.end());
+            for(unsigned int b = 0; b < buckets.size(); b++)
+            {
+                if(!buckets[b])
+                    continue;
+                out << "  " << b * bucketMilliseconds << (b + 1 < buckets.size() ? " ms: " : "+ ms: ") << buckets[b] << " "
+                    << string(max(1u, 40 * buckets[b] / fullest), '#') << std::endl;
+            }
+        }
+};
+
+// paces the render loop: the simulation advances in fixed timesteps, however long frames take, and rendering
+// interpolates between its last two states, so movement is smooth and independent of the frame rate.
+// the swap interval is picked explicitly, and an optional frame cap sleeps most of the remaining frame time
+// away and spins the last stretch, where the OS scheduler is too coarse to wake up on time
+class FrameScheduler
+{
+    public:
+        enum SwapMode { SWAP_VSYNC, SWAP_ADAPTIVE, SWAP_OFF };
+
+        double timestep;            // seconds simulated per update
+        unsigned int maxUpdates;    // per frame; a longer stall drops simulated time rather than spiral
+        double frameCap;            // frames per second, 0 for none
+        double minSpinMilliseconds; // spun before a capped frame ends, at least; grows with the sleeps' lateness
+
+        SwapMode swapMode;
+
+        FrameTimeHistogram recent;  // since the caller last reset it
+        FrameTimeHistogram overall; // every frame
+
+        FrameScheduler(double timestep = 1.0 / 120.0)
+            : timestep(timestep), maxUpdates(8), frameCap(0.0), minSpinMilliseconds(0.5), swapMode(SWAP_VSYNC),
+              accumulator(0.0), alpha(1.0f), started(false), spinMilliseconds(1.0)
+        {
+        }
+
+        // sets the swap interval of the current context. adaptive vsync (swap late frames immediately rather
+        // than wait a whole refresh) needs the swap_control_tear extension, without it this is vsync
+        SwapMode SetSwapMode(SwapMode mode)
+        {
+            if(mode == SWAP_ADAPTIVE && !glfwExtensionSupported("WGL_EXT_swap_control_tear") && !glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+                mode = SWAP_VSYNC;
+            glfwSwapInterval(mode == SWAP_VSYNC ? 1 : mode == SWAP_ADAPTIVE ? -1 : 0);
+            swapMode = mode;
+            return mode;
+        }
+
+        static const char *SwapModeName(SwapMode mode)
+        {
+            return mode == SWAP_VSYNC ? "vsync" : mode == SWAP_ADAPTIVE ? "adaptive vsync" : "off";
+        }
+
+        // starts a frame: records the time since the last one and returns how many fixed updates to run
+        unsigned int BeginFrame()
+        {
+            Clock::time_point now = Clock::now();
+            if(!started)
+            {
+                frameStart = now;
+                started = true;
+                return 0;
+            }
+
+            double seconds = std::chrono::duration<double>(now - frameStart).count();
+            frameStart = now;
+            recent.Add((float)(seconds * 1000.0));
+            overall.Add((float)(seconds * 1000.0));
+
+            accumulator += seconds;
+            unsigned int updates = (unsigned int)(accumulator / timestep);
+            if(updates > maxUpdates)
+            {
+                updates = maxUpdates;
+                accumulator = fmod(accumulator, timestep);
+            }
+            else
+                accumulator -= updates * timestep;
+
+            alpha = (float)(accumulator / timestep);
+            return updates;
+        }
+
+        // how far the frame is between the previous update's state (0) and the latest one (1)
+        float Alpha() const
+        {
+            return alpha;
+        }
+
+        template<typename T>
+        T Interpolate(const T &previous, const T &current) const
+        {
+            return glm::mix(previous, current, alpha);
+        }
+
+        // holds the frame until 1 / frameCap after it began, if capped; call last in the frame
+        void Limit()
+        {
+            PROFILE_ZONE("FrameScheduler::Limit");
+            if(frameCap <= 0.0 || !started)
+                return;
+
+            Clock::time_point end = frameStart + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / frameCap));
+
+            // sleep until a margin before the end, then learn how late the wake up was
+            Clock::time_point wake = end - std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(spinMilliseconds));
+            Clock::time_point now = Clock::now();
+            if(now < wake)
+            {
+                std::this_thread::sleep_until(wake);
+                double late = std::chrono::duration<double, std::milli>(Clock::now() - wake).count();
+
+                // the margin follows the latest late wake ups up, and decays slowly back down
+                spinMilliseconds = max(minSpinMilliseconds, max(late * 1.5, spinMilliseconds * 0.95));
+            }
+
+            while(Clock::now() < end)
+                std::this_thread::yield();
+        }
+
+        double SpinMilliseconds() const
+        {
+            return spinMilliseconds;
+        }
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        double accumulator; // simulated time owed
+        float alpha;
+        bool started;
+        Clock::time_point frameStart;
+        double spinMilliseconds;
+};
+#endif
@@ -0,0 +1,327 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <profiler.h>
+
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_SSE
+#include <emmintrin.h>
+#endif
+#ifdef __AVX__
+#define FRUSTUM_AVX
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// axis aligned bounding box
+struct AABB
+{
+    glm::vec3 min;
+    glm::vec3 max;
+
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+    glm::vec3 extent() const { return (max - min) * 0.5f; }
+};
+
+struct BoundingSphere
+{
+    glm::vec3 center;
+    float radius;
+};
+
+// the world space box enclosing a transformed box
+inline AABB TransformAABB(const AABB &box, const glm::mat4 &transform)
+{
+    glm::vec3 center = glm::vec3(transform * glm::vec4(box.center(), 1.0f));
+
+    // each world axis gets the extent projected onto it by the absolute rotation/scale
+    glm::mat3 absolute(transform);
+    for(int c = 0; c < 3; c++)
+        absolute[c] = glm::abs(absolute[c]);
+    glm::vec3 extent = absolute * box.extent();
+
+    AABB result;
+    result.min = center - extent;
+    result.max = center + extent;
+    return result;
+}
+
+// the six planes of a view frustum, pointing inwards, with normalised normals (xyz) and distance (w)
+struct Frustum
+{
+    enum { PLANE_LEFT, PLANE_RIGHT, PLANE_BOTTOM, PLANE_TOP, PLANE_NEAR, PLANE_FAR };
+
+    glm::vec4 planes[6];
+
+    Frustum() {}
+
+    // extracts the planes from a (projection * view) matrix, giving world space planes
+    Frustum(const glm::mat4 &viewProjection)
+    {
+        // rows of the matrix (glm is column major)
+        glm::vec4 row[4];
+        for(int i = 0; i < 4; i++)
+            row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+        planes[PLANE_LEFT]   = row[3] + row[0];
+        planes[PLANE_RIGHT]  = row[3] - row[0];
+        planes[PLANE_BOTTOM] = row[3] + row[1];
+        planes[PLANE_TOP]    = row[3] - row[1];
+        planes[PLANE_NEAR]   = row[3] + row[2];
+        planes[PLANE_FAR]    = row[3] - row[2];
+
+        for(int i = 0; i < 6; i++)
+            planes[i] /= glm::length(glm::vec3(planes[i]));
+    }
+
+    bool IntersectsAABB(const glm::vec3 &center, const glm::vec3 &extent) const
+    {
+        for(int i = 0; i < 6; i++)
+        {
+            glm::vec3 normal(planes[i]);
+            float distance = glm::dot(normal, center) + planes[i].w;
+            float radius = glm::dot(glm::abs(normal), extent);
+            if(distance + radius < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    bool IntersectsSphere(const BoundingSphere &sphere) const
+    {
+        for(int i = 0; i < 6; i++)
+            if(glm::dot(glm::vec3(planes[i]), sphere.center) + planes[i].w < -sphere.radius)
+                return false;
+        return true;
+    }
+};
+
+// everything the culling kernels need for one view
+struct CullParams
+{
+    Frustum frustum;
+
+    // clip space w of a point is dot(wRow, (p, 1)), i.e. its distance along the view direction
+    glm::vec4 wRow;
+
+    // projection[1][1]; a sphere of radius r at depth w covers r * projScale / w of the screen height
+    float projScale;
+
+    // boxes covering less than this fraction of the screen height are rejected (0 disables)
+    float minScreenSize;
+
+    CullParams() : projScale(1.0f), minScreenSize(0.0f) {}
+
+    CullParams(const glm::mat4 &projection, const glm::mat4 &view, float minSize = 0.0f) : minScreenSize(minSize)
+    {
+        glm::mat4 viewProjection = projection * view;
+        frustum = Frustum(viewProjection);
+        wRow = glm::vec4(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+        projScale = projection[1][1];
+    }
+};
+
+// boxes stored as structure of arrays (centre/extent) so the kernels can test 4 or 8 at a time.
+// the arrays are padded to a multiple of 8 with empty boxes so the kernels never need a scalar tail
+struct AABBSoA
+{
+    static const unsigned int LANES = 8;
+
+    vector<float> centerX, centerY, centerZ;
+    vector<float> extentX, extentY, extentZ;
+
+    AABBSoA() : count(0) {}
+
+    unsigned int size() const { return count; }
+    unsigned int paddedSize() const { return centerX.size(); }
+
+    void clear()
+    {
+        count = 0;
+        centerX.clear(); centerY.clear(); centerZ.clear();
+        extentX.clear(); extentY.clear(); extentZ.clear();
+    }
+
+    void reserve(unsigned int n)
+    {
+        n = (n + LANES - 1) / LANES * LANES;
+        centerX.reserve(n); centerY.reserve(n); centerZ.reserve(n);
+        extentX.reserve(n); extentY.reserve(n); extentZ.reserve(n);
+    }
+
+    void Add(const AABB &box)
+    {
+        Add(box.center(), box.extent());
+    }
+
+    void Add(const glm::vec3 &center, const glm::vec3 &extent)
+    {
+        // overwrite padding left by the previous Add, or grow by a full block of lanes
+        if(count == centerX.size())
+            pad(count + LANES);
+
+        centerX[count] = center.x; centerY[count] = center.y; centerZ[count] = center.z;
+        extentX[count] = extent.x; extentY[count] = extent.y; extentZ[count] = extent.z;
+        count++;
+    }
+
+private:
+    unsigned int count;
+
+    // padding boxes sit far behind every plane and are always culled
+    void pad(unsigned int n)
+    {
+        centerX.resize(n, -1e30f); centerY.resize(n, -1e30f); centerZ.resize(n, -1e30f);
+        extentX.resize(n, 0.0f); extentY.resize(n, 0.0f); extentZ.resize(n, 0.0f);
+    }
+};
+
+// reference implementation, one box at a time. writes 1/0 per box and returns the number visible
+inline unsigned int CullAABBsScalar(const CullParams &params, const AABBSoA &boxes, unsigned char *visible)
+{
+    unsigned int visibleCount = 0;
+    float minSize = params.minScreenSize;
+
+    for(unsigned int i = 0; i < boxes.size(); i++)
+    {
+        glm::vec3 center(boxes.centerX[i], boxes.centerY[i], boxes.centerZ[i]);
+        glm::vec3 extent(boxes.extentX[i], boxes.extentY[i], boxes.extentZ[i]);
+
+        bool inside = params.frustum.IntersectsAABB(center, extent);
+
+        // screen size test on the box's bounding sphere; never rejects boxes the camera is inside of
+        float radius = glm::length(extent);
+        float w = glm::dot(glm::vec3(params.wRow), center) + params.wRow.w;
+        bool bigEnough = w <= radius || radius * params.projScale >= minSize * w;
+
+        visible[i] = inside && bigEnough;
+        visibleCount += visible[i];
+    }
+    return visibleCount;
+}
+
+#ifdef FRUSTUM_SSE
+// four boxes per test
+inline unsigned int CullAABBsSSE(const CullParams &params, const AABBSoA &boxes, unsigned char *visible)
+{
+    __m128 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+    for(int p = 0; p < 6; p++)
+    {
+        const glm::vec4 &plane = params.frustum.planes[p];
+        planeX[p] = _mm_set1_ps(plane.x); absX[p] = _mm_set1_ps(fabsf(plane.x));
+        planeY[p] = _mm_set1_ps(plane.y); absY[p] = _mm_set1_ps(fabsf(plane.y));
+        planeZ[p] = _mm_set1_ps(plane.z); absZ[p] = _mm_set1_ps(fabsf(plane.z));
+        planeW[p] = _mm_set1_ps(plane.w);
+    }
+    __m128 wX = _mm_set1_ps(params.wRow.x), wY = _mm_set1_ps(params.wRow.y), wZ = _mm_set1_ps(params.wRow.z), wW = _mm_set1_ps(params.wRow.w);
+    __m128 projScale = _mm_set1_ps(params.projScale);
+    __m128 minSize = _mm_set1_ps(params.minScreenSize);
+
+    unsigned int visibleCount = 0;
+    unsigned int count = boxes.size();
+
+    for(unsigned int i = 0; i < count; i += 4)
+    {
+        __m128 cx = _mm_loadu_ps(&boxes.centerX[i]), cy = _mm_loadu_ps(&boxes.centerY[i]), cz = _mm_loadu_ps(&boxes.centerZ[i]);
+        __m128 ex = _mm_loadu_ps(&boxes.extentX[i]), ey = _mm_loadu_ps(&boxes.extentY[i]), ez = _mm_loadu_ps(&boxes.extentZ[i]);
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for(int p = 0; p < 6; p++)
+        {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], cx), _mm_mul_ps(planeY[p], cy)), _mm_add_ps(_mm_mul_ps(planeZ[p], cz), planeW[p]));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absX[p], ex), _mm_mul_ps(absY[p], ey)), _mm_mul_ps(absZ[p], ez));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+        }
+
+        __m128 radius = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)), _mm_mul_ps(ez, ez)));
+        __m128 w = _mm_add_ps(_mm_add_ps(_mm_mul_ps(wX, cx), _mm_mul_ps(wY, cy)), _mm_add_ps(_mm_mul_ps(wZ, cz), wW));
+        __m128 bigEnough = _mm_or_ps(_mm_cmple_ps(w, radius), _mm_cmpge_ps(_mm_mul_ps(radius, projScale), _mm_mul_ps(minSize, w)));
+
+        int mask = _mm_movemask_ps(_mm_and_ps(inside, bigEnough));
+
+        unsigned int lanes = count - i < 4 ? count - i : 4;
+        for(unsigned int lane = 0; lane < lanes; lane++)
+        {
+            visible[i + lane] = (mask >> lane) & 1;
+            visibleCount += visible[i + lane];
+        }
+    }
+    return visibleCount;
+}
+#endif
+
+#ifdef FRUSTUM_AVX
+// eight boxes per test
+inline unsigned int CullAABBsAVX(const CullParams &params, const AABBSoA &boxes, unsigned char *visible)
+{
+    __m256 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+    for(int p = 0; p < 6; p++)
+    {
+        const glm::vec4 &plane = params.frustum.planes[p];
+        planeX[p] = _mm256_set1_ps(plane.x); absX[p] = _mm256_set1_ps(fabsf(plane.x));
+        planeY[p] = _mm256_set1_ps(plane.y); absY[p] = _mm256_set1_ps(fabsf(plane.y));
+        planeZ[p] = _mm256_set1_ps(plane.z); absZ[p] = _mm256_set1_ps(fabsf(plane.z));
+        planeW[p] = _mm256_set1_ps(plane.w);
+    }
+    __m256 wX = _mm256_set1_ps(params.wRow.x), wY = _mm256_set1_ps(params.wRow.y), wZ = _mm256_set1_ps(params.wRow.z), wW = _mm256_set1_ps(params.wRow.w);
+    __m256 projScale = _mm256_set1_ps(params.projScale);
+    __m256 minSize = _mm256_set1_ps(params.minScreenSize);
+
+    unsigned int visibleCount = 0;
+    unsigned int count = boxes.size();
+
+    for(unsigned int i = 0; i < count; i += 8)
+    {
+        __m256 cx = _mm256_loadu_ps(&boxes.centerX[i]), cy = _mm256_loadu_ps(&boxes.centerY[i]), cz = _mm256_loadu_ps(&boxes.centerZ[i]);
+        __m256 ex = _mm256_loadu_ps(&boxes.extentX[i]), ey = _mm256_loadu_ps(&boxes.extentY[i]), ez = _mm256_loadu_ps(&boxes.extentZ[i]);
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for(int p = 0; p < 6; p++)
+        {
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], cx), _mm256_mul_ps(planeY[p], cy)), _mm256_add_ps(_mm256_mul_ps(planeZ[p], cz), planeW[p]));
+            __m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(absX[p], ex), _mm256_mul_ps(absY[p], ey)), _mm256_mul_ps(absZ[p], ez));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+
+        __m256 radius = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, ex), _mm256_mul_ps(ey, ey)), _mm256_mul_ps(ez, ez)));
+        __m256 w = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(wX, cx), _mm256_mul_ps(wY, cy)), _mm256_add_ps(_mm256_mul_ps(wZ, cz), wW));
+        __m256 bigEnough = _mm256_or_ps(_mm256_cmp_ps(w, radius, _CMP_LE_OQ), _mm256_cmp_ps(_mm256_mul_ps(radius, projScale), _mm256_mul_ps(minSize, w), _CMP_GE_OQ));
+
+        int mask = _mm256_movemask_ps(_mm256_and_ps(inside, bigEnough));
+
+        unsigned int lanes = count - i < 8 ? count - i : 8;
+        for(unsigned int lane = 0; lane < lanes; lane++)
+        {
+            visible[i + lane] = (mask >> lane) & 1;
+            visibleCount += visible[i + lane];
+        }
+    }
+    return visibleCount;
+}
+#endif
+
+// culls with the widest kernel the build supports. visible must hold boxes.size() entries
+inline unsigned int CullAABBs(const CullParams &params, const AABBSoA &boxes, unsigned char *visible)
+{
+#if defined(FRUSTUM_AVX)
+    return CullAABBsAVX(params, boxes, visible);
+#elif defined(FRUSTUM_SSE)
+    return CullAABBsSSE(params, boxes, visible);
+#else
+    return CullAABBsScalar(params, boxes, visible);
+#endif
+}
+
+inline unsigned int CullAABBs(const CullParams &params, const AABBSoA &boxes, vector<unsigned char> &visible)
+{
+    PROFILE_ZONE("CullAABBs");
+    visible.resize(boxes.size());
+    return boxes.size() ? CullAABBs(params, boxes, &visible[0]) : 0;
+}
+#endif
@@ -0,0 +1,144 @@
+#ifndef GBUFFER_H
+#define GBUFFER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <shader.h>
+#include <profiler.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// render targets for deferred shading. the geometry pass (gbuffer.fs) samples every material once into
+//   attachment 0, RGBA8:    diffuse colour, specular intensity
+//   attachment 1, RGB10_A2: octahedral normal, shininess
+//   depth, 24 bit:          world positions are reconstructed from it, so none are stored
+// 8 bytes a pixel plus depth. the lighting pass (deferred.fs) then runs once per pixel over a full screen
+// triangle with the same lighting code as the forward shaders, the cluster lists included.
+// like DynamicResolution's target, the targets are allocated at maxScale once per window size and the scene
+// takes their lower left corner at whatever size it's drawn at, so a scale change only moves the viewport.
+class GBuffer
+{
+    public:
+        // texture units the lighting pass reads the targets from
+        static const unsigned int ALBEDO_UNIT = 10, NORMAL_UNIT = 11, DEPTH_UNIT = 12;
+
+        unsigned int FBO;
+        unsigned int width, height;           // allocated size of the targets
+        unsigned int sceneWidth, sceneHeight; // the part of them drawn this frame
+
+        GBuffer() : FBO(0), width(0), height(0), sceneWidth(0), sceneHeight(0), emptyVAO(0), previousFBO(0)
+        {
+            textures[0] = textures[1] = textures[2] = 0;
+        }
+
+        // (re)allocates the targets at maxScale of the window when either changed; call before Begin
+        void Resize(unsigned int windowWidth, unsigned int windowHeight, float maxScale)
+        {
+            unsigned int newWidth = std::max(1u, (unsigned int)ceilf(windowWidth * std::max(maxScale, 1.0f)));
+            unsigned int newHeight = std::max(1u, (unsigned int)ceilf(windowHeight * std::max(maxScale, 1.0f)));
+            if(FBO && newWidth == width && newHeight == height)
+                return;
+
+            if(!FBO)
+            {
+                glGenFramebuffers(1, &FBO);
+                glGenTextures(3, textures);
+                glGenVertexArrays(1, &emptyVAO);
+            }
+
+            width = newWidth;
+            height = newHeight;
+
+            allocate(textures[0], GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+            allocate(textures[1], GL_RGB10_A2, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV);
+            allocate(textures[2], GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT);
+
+            GLint bound = 0;
+            glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &bound);
+            glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[0], 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, textures[1], 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, textures[2], 0);
+
+            GLenum attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+            glDrawBuffers(2, attachments);
+
+            if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cout << "ERROR::GBUFFER::FRAMEBUFFER_INCOMPLETE: " << width << "x" << height << std::endl;
+
+            // back to whatever the scene draws into, so Begin returns there
+            glBindFramebuffer(GL_FRAMEBUFFER, bound);
+        }
+
+        // geometry pass: everything drawn until End goes into the lower left sceneWidth x sceneHeight of the
+        // targets. only depth is cleared, pixels left at the far plane are background and never read
+        void Begin(unsigned int drawWidth, unsigned int drawHeight)
+        {
+            sceneWidth = std::min(drawWidth, width);
+            sceneHeight = std::min(drawHeight, height);
+
+            glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFBO);
+            glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+            glViewport(0, 0, sceneWidth, sceneHeight);
+            glClear(GL_DEPTH_BUFFER_BIT);
+        }
+
+        // back to the framebuffer bound at Begin, for the lighting pass
+        void End()
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, previousFBO);
+        }
+
+        // lighting pass into the bound framebuffer, whose viewport must be the scene's size. the lighting
+        // program (deferred.fs) must be in use
+        void Resolve(const Shader &lighting, const glm::mat4 &viewProjection)
+        {
+            PROFILE_GPU_ZONE("GBuffer::Resolve");
+            for(unsigned int i = 0; i < 3; i++)
+            {
+                glActiveTexture(GL_TEXTURE0 + ALBEDO_UNIT + i);
+                glBindTexture(GL_TEXTURE_2D, textures[i]);
+            }
+            glActiveTexture(GL_TEXTURE0);
+
+            lighting.setInt("gAlbedoSpecular", ALBEDO_UNIT);
+            lighting.setInt("gNormalShininess", NORMAL_UNIT);
+            lighting.setInt("gDepth", DEPTH_UNIT);
+            lighting.setVec2("sceneSize", glm::vec2(sceneWidth, sceneHeight));
+            lighting.setMat4("inverseViewProjection", glm::inverse(viewProjection));
+
+            // one filled triangle over every pixel, whatever the polygon mode of the scene
+            GLint polygonMode[2];
+            glGetIntegerv(GL_POLYGON_MODE, polygonMode);
+            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+            glDisable(GL_DEPTH_TEST);
+
+            glBindVertexArray(emptyVAO);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glBindVertexArray(0);
+
+            glEnable(GL_DEPTH_TEST);
+            glPolygonMode(GL_FRONT_AND_BACK, polygonMode[0]);
+        }
+
+    private:
+        unsigned int textures[3];
+        unsigned int emptyVAO; // the full screen triangle comes from gl_VertexID, but core needs a vertex array bound
+        GLint previousFBO;
+
+        void allocate(unsigned int texture, GLint format, GLenum pixelFormat, GLenum type)
+        {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, pixelFormat, type, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+};
+#endif
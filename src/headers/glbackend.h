@@ -0,0 +1,77 @@
+#ifndef GLBACKEND_H
+#define GLBACKEND_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <shader.h>
+#include <commandlist.h>
+#include <profiler.h>
+
+#include <vector>
+
+using namespace std;
+
+// replays command lists as GL calls; only ever used on the thread that owns the context
+struct GLBackend
+{
+    void BindProgram(unsigned int id)
+    {
+        glUseProgram(id);
+    }
+
+    void BindVertexArray(unsigned int id)
+    {
+        glBindVertexArray(id);
+    }
+
+    void BindTexture(unsigned int unit, unsigned int id)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, id);
+    }
+
+    void SetInt(int location, int value)
+    {
+        Shader::uniformCalls()++;
+        glUniform1i(location, value);
+    }
+
+    void SetFloat(int location, float value)
+    {
+        Shader::uniformCalls()++;
+        glUniform1f(location, value);
+    }
+
+    void SetMat3(int location, const glm::mat3 &value)
+    {
+        Shader::uniformCalls()++;
+        glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(value));
+    }
+
+    void SetMat4(int location, const glm::mat4 &value)
+    {
+        Shader::uniformCalls()++;
+        glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+    }
+
+    void DrawElements(unsigned int count, unsigned int firstIndex, int baseVertex)
+    {
+        glDrawElementsBaseVertex(GL_TRIANGLES, count, GL_UNSIGNED_INT, (void*)(firstIndex * sizeof(unsigned int)), baseVertex);
+    }
+};
+
+// replays the lists in recording order, then resets the bindings the way Mesh::Draw leaves them
+inline void SubmitCommandLists(const vector<CommandList> &lists)
+{
+    PROFILE_GPU_ZONE("SubmitCommandLists");
+    GLBackend backend;
+    for(unsigned int i = 0; i < lists.size(); i++)
+        lists[i].Replay(backend);
+
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+}
+#endif
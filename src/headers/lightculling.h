@@ -0,0 +1,137 @@
+#ifndef LIGHTCULLING_H
+#define LIGHTCULLING_H
+
+#include <glm/glm.hpp>
+
+#include <clusteredlights.h>
+#include <frustum.h>
+#include <uniformblocks.h>
+#include <profiler.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace std;
+
+// per-draw light lists for the point and spot lights of the Lights block. every light gets a range from its
+// attenuation (the distance where it falls below LIGHT_CUTOFF, as for the clustered lights) and the spot light
+// its cone as well; each object then lists only the lights whose range and cone reach its bounds, so its
+// fragments skip the rest. a list is packed into one int, so it travels as a single uniform or vertex attribute:
+//   bits 0-2   number of point lights listed
+//   bits 3-10  their indices into pointLights, 2 bits each, in order
+//   bit 11     the spot light
+// LIGHT_LISTS permutations unpack it in lighting.glsl
+const int DRAW_LIGHT_COUNT_MASK = 7;
+const int DRAW_LIGHT_INDEX_SHIFT = 3;
+const int DRAW_LIGHT_INDEX_BITS = 2;
+const int DRAW_LIGHT_SPOT = 1 << 11;
+
+static_assert(MAX_POINT_LIGHTS <= (1 << DRAW_LIGHT_INDEX_BITS), "point light indices don't fit a draw light list");
+
+// the first pointLights point lights, and the spot light if spot: what a draw gets without culling
+inline int AllDrawLights(unsigned int pointLights, bool spot)
+{
+    unsigned int count = min(pointLights, MAX_POINT_LIGHTS);
+    int list = count;
+    for(unsigned int i = 0; i < count; i++)
+        list |= i << (DRAW_LIGHT_INDEX_SHIFT + DRAW_LIGHT_INDEX_BITS * i);
+    return spot ? list | DRAW_LIGHT_SPOT : list;
+}
+
+inline float PointLightRadius(const PointLightBlock &light)
+{
+    return AttenuationRadius(light.ambient + light.diffuse + light.specular, light.constant, light.linear, light.quadratic);
+}
+
+// ambient is left out of the cone in the shaders, but falls off with distance
+inline float SpotLightRadius(const SpotLightBlock &light)
+{
+    return AttenuationRadius(light.ambient + light.diffuse + light.specular, light.constant, light.linear, light.quadratic);
+}
+
+// squared distance from a point to a box, 0 inside it
+inline float DistanceSquared(const glm::vec3 &point, const AABB &box)
+{
+    glm::vec3 outside = glm::max(box.min - point, glm::vec3(0.0f)) + glm::max(point - box.max, glm::vec3(0.0f));
+    return glm::dot(outside, outside);
+}
+
+// whether a sphere reaches into a cone of the given range and half angle (cosine and sine). the sphere is
+// tested against the cone's surface in the plane through the axis and the sphere's centre
+inline bool SphereInCone(const glm::vec3 &center, float radius, const glm::vec3 &apex, const glm::vec3 &axis, float range, float cosAngle, float sinAngle)
+{
+    glm::vec3 toCenter = center - apex;
+    float along = glm::dot(toCenter, axis);
+    float across = sqrtf(max(glm::dot(toCenter, toCenter) - along * along, 0.0f));
+
+    // signed distance from the centre to the cone's side
+    float outside = cosAngle * across - sinAngle * along;
+    return outside <= radius && along <= range + radius && along >= -radius;
+}
+
+// builds the packed light list of every object from its world space bounds
+class DrawLightLists
+{
+    public:
+        vector<int> lists; // one per object
+
+        // of the last Build, over the objects it listed lights for
+        unsigned int objects;
+        unsigned int pointLightsListed, spotLightsListed;
+
+        DrawLightLists() : objects(0), pointLightsListed(0), spotLightsListed(0) {}
+
+        // the first pointLights point lights and, if spot, the spot light are considered. objects flagged 0 in
+        // visible (optional) aren't drawn and get every light, without being counted
+        void Build(const LightsBlock &lights, unsigned int pointLights, bool spot, const vector<AABB> &bounds, const vector<unsigned char> *visible = NULL)
+        {
+            PROFILE_ZONE("DrawLightLists::Build");
+            pointLights = min(pointLights, MAX_POINT_LIGHTS);
+
+            float pointRadii[MAX_POINT_LIGHTS];
+            for(unsigned int i = 0; i < pointLights; i++)
+                pointRadii[i] = PointLightRadius(lights.pointLights[i]);
+
+            // the spot's range and the half angle of its outer cone
+            const SpotLightBlock &spotLight = lights.spotLight;
+            float spotRadius = spot ? SpotLightRadius(spotLight) : 0.0f;
+            glm::vec3 spotAxis = glm::length(spotLight.direction) > 0.0f ? glm::normalize(spotLight.direction) : glm::vec3(0.0f, 0.0f, -1.0f);
+            float cosAngle = glm::clamp(spotLight.outerCutOff, -1.0f, 1.0f);
+            float sinAngle = sqrtf(1.0f - cosAngle * cosAngle);
+
+            int everything = AllDrawLights(pointLights, spot);
+
+            lists.resize(bounds.size());
+            objects = pointLightsListed = spotLightsListed = 0;
+            for(unsigned int o = 0; o < bounds.size(); o++)
+            {
+                if(visible && o < visible->size() && !(*visible)[o])
+                {
+                    lists[o] = everything;
+                    continue;
+                }
+
+                const AABB &box = bounds[o];
+                int list = 0, count = 0;
+                for(unsigned int i = 0; i < pointLights; i++)
+                {
+                    if(DistanceSquared(lights.pointLights[i].position, box) >= pointRadii[i] * pointRadii[i])
+                        continue;
+                    list |= i << (DRAW_LIGHT_INDEX_SHIFT + DRAW_LIGHT_INDEX_BITS * count);
+                    count++;
+                }
+                list |= count;
+
+                if(spot && DistanceSquared(spotLight.position, box) < spotRadius * spotRadius &&
+                   SphereInCone(box.center(), glm::length(box.extent()), spotLight.position, spotAxis, spotRadius, cosAngle, sinAngle))
+                    list |= DRAW_LIGHT_SPOT;
+
+                lists[o] = list;
+                objects++;
+                pointLightsListed += count;
+                spotLightsListed += (list & DRAW_LIGHT_SPOT) != 0;
+            }
+        }
+};
+#endif
@@ -7,6 +7,8 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <shader.h>
+#include <frustum.h>
+#include <commandlist.h>
 
 #include <string>
 #include <vector>
@@ -28,6 +30,40 @@ struct Texture {
     string path;
 };
 
+// uniform locations Mesh::Record needs, looked up once on the GL thread so recording never touches GL
+struct MaterialLocations {
+    int modelViewProjection, model, normalMatrix; // see transforms.h
+    int drawLights;                               // the draw's light list, see lightculling.h
+    vector<int> diffuse;  // material.texture_diffuse1, 2, ...
+    vector<int> specular; // material.texture_specular1, 2, ...
+
+    MaterialLocations() : modelViewProjection(-1), model(-1), normalMatrix(-1), drawLights(-1) {}
+
+    MaterialLocations(const Shader &shader, unsigned int maxTextures = 4)
+    {
+        modelViewProjection = shader.uniformLocation("modelViewProjection");
+        model = shader.uniformLocation("model");
+        normalMatrix = shader.uniformLocation("normalMatrix");
+        drawLights = shader.hasUniform("drawLights") ? shader.uniformLocation("drawLights") : -1; // LIGHT_LISTS only
+
+        // as many texture slots as the program declares, so the unused ones don't warn
+        for (unsigned int i = 1; i <= maxTextures; i++)
+        {
+            string name = "material.texture_diffuse" + to_string(i);
+            if (!shader.hasUniform(name))
+                break;
+            diffuse.push_back(shader.uniformLocation(name));
+        }
+        for (unsigned int i = 1; i <= maxTextures; i++)
+        {
+            string name = "material.texture_specular" + to_string(i);
+            if (!shader.hasUniform(name))
+                break;
+            specular.push_back(shader.uniformLocation(name));
+        }
+    }
+};
+
 class Mesh {
 public:
     // mesh Data
@@ -35,19 +71,83 @@ public:
     vector<unsigned int> indices;
     vector<Texture>      textures;
 
+    // model space bounds, filled in by the loader
+    AABB                 bounds;
+    BoundingSphere       sphere;
+
+    // rasterized into the software occlusion buffer to hide the meshes behind it
+    bool                 occluder;
+
     // constructor
     Mesh(vector<Vertex> _vertices, vector<unsigned int> _indices, vector<Texture> _textures)
     {
         this->vertices = _vertices;
         this->indices = _indices;
         this->textures = _textures;
+        this->occluder = false;
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
     }
 
+    // whether the mesh has a texture of a type ("texture_diffuse", "texture_specular", ...), e.g. to pick a shader permutation
+    bool HasTexture(const string &type) const
+        {
+            for (unsigned int i = 0; i < textures.size(); i++)
+                if (textures[i].type == type)
+                    return true;
+            return false;
+        }
+
     // render the mesh
     void Draw(Shader &shader)
+        {
+            BindTextures(shader);
+
+            // draw mesh
+            glBindVertexArray(VAO);
+            glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+
+            // always good practice to set everything back to defaults once configured.
+            glBindVertexArray(0);
+            glActiveTexture(GL_TEXTURE0);
+        }
+
+    // records what Draw does into a command list; safe on any thread, as nothing here calls GL
+    void Record(CommandList &list, const MaterialLocations &locations) const
+        {
+            unsigned int diffuseNum = 0;
+            unsigned int specularNum = 0;
+
+            for (unsigned int i = 0; i < textures.size(); i++)
+            {
+                const string &name = textures[i].type;
+                int location = -1;
+
+                if (name == "texture_diffuse" && diffuseNum < locations.diffuse.size())
+                    location = locations.diffuse[diffuseNum++];
+                else if (name == "texture_specular" && specularNum < locations.specular.size())
+                    location = locations.specular[specularNum++];
+
+                if (location >= 0)
+                    list.SetInt(location, i);
+                list.BindTexture(i, textures[i].id);
+            }
+
+            list.BindVertexArray(VAO);
+            list.DrawElements(indices.size());
+        }
+
+    // depth only render from the position-only stream, for depth pre-passes
+    void DrawDepth()
+        {
+            glBindVertexArray(depthVAO);
+            glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+            glBindVertexArray(0);
+        }
+
+    // binds the mesh's textures and points the shader's material samplers at them
+    void BindTextures(Shader &shader)
         {
             unsigned int diffuseNum = 1;
             unsigned int specularNum = 1;
@@ -83,19 +183,12 @@ public:
                     continue;
                 }
             }
-
-            // draw mesh
-            glBindVertexArray(VAO);
-            glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-
-            // always good practice to set everything back to defaults once configured.
-            glBindVertexArray(0);
-            glActiveTexture(GL_TEXTURE0);
         }
 
 private:
     // render data 
     unsigned int VAO, VBO, EBO;
+    unsigned int depthVAO, positionVBO;
 
     // initializes all the buffer objects/arrays
     void setupMesh()
@@ -131,6 +224,26 @@ private:
         
         // unbind VAO to prevent accidental changes (not unbinding EBO because it is bound to VAO)
         glBindVertexArray(0);
+
+        // positions only, so depth passes fetch 12 bytes per vertex instead of a whole Vertex
+        vector<glm::vec3> positions(vertices.size());
+        for (unsigned int i = 0; i < vertices.size(); i++)
+            positions[i] = vertices[i].Position;
+
+        glGenVertexArrays(1, &depthVAO);
+        glGenBuffers(1, &positionVBO);
+
+        glBindVertexArray(depthVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), &positions[0], GL_STATIC_DRAW);
+
+        // the index buffer is shared with the full vertex stream
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+
+        glBindVertexArray(0);
     }
 };
 #endif
\ No newline at end of file
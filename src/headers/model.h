@@ -19,6 +19,7 @@
 #include <iostream>
 #include <map>
 #include <vector>
+#include <cfloat>
 using namespace std;
 
 unsigned int TextureFromFile(const char *path, const string &dir);
@@ -38,6 +39,11 @@ public:
         loadModel(path);
     }
 
+    // an empty model, for meshes built in code
+    Model() : gammaCorrection(false)
+    {
+    }
+
     // draws the model, and thus all its meshes
     void Draw(Shader &shader)
     {
@@ -91,6 +97,11 @@ private:
         vector<unsigned int> indices;
         vector<Texture> textures;
 
+        // bounds, grown as the vertices are walked
+        AABB bounds;
+        bounds.min = glm::vec3(FLT_MAX);
+        bounds.max = glm::vec3(-FLT_MAX);
+
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
@@ -99,6 +110,8 @@ private:
                 // vertex position
                 glm::vec3 position(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
                 vertex.Position = position;
+                bounds.min = glm::min(bounds.min, position);
+                bounds.max = glm::max(bounds.max, position);
 
                 // vertex normal
                 glm::vec3 normal(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
@@ -138,8 +151,21 @@ private:
             vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
             textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
         }
+        if(vertices.empty())
+            bounds.min = bounds.max = glm::vec3(0.0f);
+
+        // bounding sphere around the box centre, tight to the actual vertices
+        BoundingSphere sphere;
+        sphere.center = bounds.center();
+        sphere.radius = 0.0f;
+        for(unsigned int i = 0; i < vertices.size(); i++)
+            sphere.radius = glm::max(sphere.radius, glm::length(vertices[i].Position - sphere.center));
+
         // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        Mesh result(vertices, indices, textures);
+        result.bounds = bounds;
+        result.sphere = sphere;
+        return result;
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
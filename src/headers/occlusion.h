@@ -0,0 +1,391 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <glm/glm.hpp>
+
+#include <frustum.h>
+#include <parallel.h>
+#include <profiler.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace std;
+
+// software occlusion culling.
+// occluder triangles are rasterized on the CPU into a small depth buffer split into tiles; every tile is
+// owned by one thread, so tiles rasterize in parallel without locking. the buffer then gets a max-depth
+// mip chain, and a box is occluded when its nearest depth lies behind the farthest occluder depth over
+// the few texels its screen rectangle covers. depth is NDC depth mapped to [0, 1], 1 being the far plane.
+// rasterization is conservative: a texel only takes a triangle's depth when the triangle covers all of it,
+// and then the farthest depth the triangle has over it, so the buffer never hides more than the occluders do.
+// no GL involved, so the whole thing runs (and can be benchmarked) headless.
+class OcclusionBuffer
+{
+    public:
+        static const unsigned int TILE_WIDTH = 32;
+        static const unsigned int TILE_HEIGHT = 16;
+
+        // mip levels that stay inside a tile, and can be built by the tile's own thread
+        static const unsigned int TILE_LEVELS = 4;
+
+        unsigned int width, height;
+        unsigned int tilesX, tilesY;
+        unsigned int threads;
+
+        // levels[0] is the depth buffer, each following level holds the max of 2x2 texels of the one before
+        vector<vector<float> > levels;
+        vector<unsigned int> levelWidth, levelHeight;
+
+        // triangles submitted this frame, and how many survived clipping and back face culling
+        unsigned int submittedTriangles, rasterizedTriangles;
+
+        // the size is rounded up to whole tiles
+        OcclusionBuffer(unsigned int _width = 256, unsigned int _height = 128, unsigned int _threads = HardwareThreads())
+            : threads(_threads), submittedTriangles(0), rasterizedTriangles(0)
+        {
+            width = (_width + TILE_WIDTH - 1) / TILE_WIDTH * TILE_WIDTH;
+            height = (_height + TILE_HEIGHT - 1) / TILE_HEIGHT * TILE_HEIGHT;
+            tilesX = width / TILE_WIDTH;
+            tilesY = height / TILE_HEIGHT;
+            bins.resize(tilesX * tilesY);
+
+            unsigned int w = width, h = height;
+            while(true)
+            {
+                levels.push_back(vector<float>(w * h, 1.0f));
+                levelWidth.push_back(w);
+                levelHeight.push_back(h);
+                if(w == 1 && h == 1)
+                    break;
+                w = (w + 1) / 2;
+                h = (h + 1) / 2;
+            }
+        }
+
+        // starts a new frame seen through the given (projection * view) matrix
+        void Begin(const glm::mat4 &_viewProjection)
+        {
+            viewProjection = _viewProjection;
+            triangles.clear();
+            for(unsigned int i = 0; i < bins.size(); i++)
+                bins[i].clear();
+            submittedTriangles = rasterizedTriangles = 0;
+        }
+
+        // transforms an occluder's triangles to screen space and bins them into the tiles they touch.
+        // positions are read with the given stride, so the vertices of a Mesh can be passed directly
+        void AddOccluder(const glm::vec3 *positions, unsigned int stride, unsigned int vertexCount, const unsigned int *indices, unsigned int indexCount, const glm::mat4 &model)
+        {
+            glm::mat4 transform = viewProjection * model;
+
+            clip.resize(vertexCount);
+            const char *vertex = (const char*)positions;
+            for(unsigned int i = 0; i < vertexCount; i++, vertex += stride)
+                clip[i] = transform * glm::vec4(*(const glm::vec3*)vertex, 1.0f);
+
+            submittedTriangles += indexCount / 3;
+            for(unsigned int i = 0; i + 2 < indexCount; i += 3)
+            {
+                const glm::vec4 &a = clip[indices[i]];
+                const glm::vec4 &b = clip[indices[i + 1]];
+                const glm::vec4 &c = clip[indices[i + 2]];
+
+                // triangles crossing the near plane are dropped rather than clipped; an occluder
+                // missing a few triangles only hides less, it never hides something visible
+                if(a.z < -a.w || b.z < -b.w || c.z < -c.w)
+                    continue;
+
+                ScreenTriangle triangle;
+                toScreen(a, triangle.x[0], triangle.y[0], triangle.z[0]);
+                toScreen(b, triangle.x[1], triangle.y[1], triangle.z[1]);
+                toScreen(c, triangle.x[2], triangle.y[2], triangle.z[2]);
+
+                // counter-clockwise is front facing, as in GL
+                float area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) - (triangle.y[1] - triangle.y[0]) * (triangle.x[2] - triangle.x[0]);
+                if(!(area > 0.0f))
+                    continue;
+
+                float minX = std::min(triangle.x[0], std::min(triangle.x[1], triangle.x[2]));
+                float maxX = std::max(triangle.x[0], std::max(triangle.x[1], triangle.x[2]));
+                float minY = std::min(triangle.y[0], std::min(triangle.y[1], triangle.y[2]));
+                float maxY = std::max(triangle.y[0], std::max(triangle.y[1], triangle.y[2]));
+                if(maxX < 0.0f || maxY < 0.0f || minX >= (float)width || minY >= (float)height)
+                    continue;
+
+                // clamped as floats first; vertices close to the camera plane project very far out
+                int tx0 = (int)std::max(minX, 0.0f) / TILE_WIDTH, tx1 = (int)std::min(maxX, width - 1.0f) / TILE_WIDTH;
+                int ty0 = (int)std::max(minY, 0.0f) / TILE_HEIGHT, ty1 = (int)std::min(maxY, height - 1.0f) / TILE_HEIGHT;
+
+                unsigned int index = triangles.size();
+                triangles.push_back(triangle);
+                rasterizedTriangles++;
+
+                for(int ty = ty0; ty <= ty1; ty++)
+                    for(int tx = tx0; tx <= tx1; tx++)
+                        bins[ty * tilesX + tx].push_back(index);
+            }
+        }
+
+        // rasterizes the binned triangles and builds the max-depth mip chain
+        void Rasterize()
+        {
+            PROFILE_ZONE("OcclusionBuffer::Rasterize");
+            ParallelFor(tilesX * tilesY, threads, [this](unsigned int begin, unsigned int end, unsigned int)
+            {
+                PROFILE_ZONE("OcclusionBuffer tiles");
+                for(unsigned int tile = begin; tile < end; tile++)
+                {
+                    rasterizeTile(tile);
+                    downsampleTile(tile);
+                }
+            });
+
+            // the remaining levels are a handful of texels
+            for(unsigned int level = TILE_LEVELS + 1; level < levels.size(); level++)
+                downsample(level, 0, 0, levelWidth[level], levelHeight[level]);
+        }
+
+        // false when the box is certainly hidden behind the rasterized occluders
+        bool IsVisible(const AABB &box) const
+        {
+            int x0, y0, x1, y1;
+            float minZ;
+            int result = screenRect(box, x0, y0, x1, y1, minZ);
+            if(result >= 0)
+                return result != 0;
+
+            // the finest level at which the rectangle covers at most 2x2 texels
+            unsigned int level = 0;
+            while(level + 1 < levels.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+                level++;
+
+            const vector<float> &depth = levels[level];
+            unsigned int w = levelWidth[level];
+            for(int y = y0 >> level; y <= y1 >> level; y++)
+                for(int x = x0 >> level; x <= x1 >> level; x++)
+                    if(minZ <= depth[y * w + x])
+                        return true;
+            return false;
+        }
+
+        // the same test against every pixel of the depth buffer the box covers; the reference the mip chain is measured against
+        bool IsVisibleBruteForce(const AABB &box) const
+        {
+            int x0, y0, x1, y1;
+            float minZ;
+            int result = screenRect(box, x0, y0, x1, y1, minZ);
+            if(result >= 0)
+                return result != 0;
+
+            const vector<float> &depth = levels[0];
+            for(int y = y0; y <= y1; y++)
+                for(int x = x0; x <= x1; x++)
+                    if(minZ <= depth[y * width + x])
+                        return true;
+            return false;
+        }
+
+        // tests every box in parallel, clearing the flags of occluded ones; returns how many stay visible.
+        // boxes already flagged invisible (e.g. by frustum culling) are skipped
+        unsigned int TestAABBs(const vector<AABB> &boxes, vector<unsigned char> &visible) const
+        {
+            visible.resize(boxes.size(), 1);
+            vector<unsigned int> counts(threads > 0 ? threads : 1, 0);
+
+            ParallelFor(boxes.size(), threads, [&](unsigned int begin, unsigned int end, unsigned int thread)
+            {
+                unsigned int count = 0;
+                for(unsigned int i = begin; i < end; i++)
+                {
+                    if(visible[i])
+                        visible[i] = IsVisible(boxes[i]);
+                    count += visible[i];
+                }
+                counts[thread] = count;
+            });
+
+            unsigned int total = 0;
+            for(unsigned int i = 0; i < counts.size(); i++)
+                total += counts[i];
+            return total;
+        }
+
+    private:
+        struct ScreenTriangle
+        {
+            float x[3], y[3], z[3];
+        };
+
+        glm::mat4 viewProjection;
+        vector<glm::vec4> clip;             // scratch for transformed occluder vertices
+        vector<ScreenTriangle> triangles;
+        vector<vector<unsigned int> > bins; // triangles touching each tile
+
+        void toScreen(const glm::vec4 &p, float &x, float &y, float &z) const
+        {
+            float invW = 1.0f / p.w;
+            x = (p.x * invW * 0.5f + 0.5f) * width;
+            y = (p.y * invW * 0.5f + 0.5f) * height;
+            z = p.z * invW * 0.5f + 0.5f;
+        }
+
+        // inclusive pixel rectangle and nearest depth of a box.
+        // returns 1 (visible) when the box crosses the near plane, 0 when it is off screen, -1 when it needs testing
+        int screenRect(const AABB &box, int &x0, int &y0, int &x1, int &y1, float &minZ) const
+        {
+            float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f;
+            minZ = 1e30f;
+
+            // the corners are the min corner plus any combination of the box's three edges
+            glm::vec3 size = box.max - box.min;
+            glm::vec4 origin = viewProjection * glm::vec4(box.min, 1.0f);
+            glm::vec4 edgeX = viewProjection[0] * size.x, edgeY = viewProjection[1] * size.y, edgeZ = viewProjection[2] * size.z;
+            for(int i = 0; i < 8; i++)
+            {
+                glm::vec4 p = origin;
+                if(i & 1) p += edgeX;
+                if(i & 2) p += edgeY;
+                if(i & 4) p += edgeZ;
+                if(p.z < -p.w)
+                    return 1;
+
+                float x, y, z;
+                toScreen(p, x, y, z);
+                minX = std::min(minX, x); maxX = std::max(maxX, x);
+                minY = std::min(minY, y); maxY = std::max(maxY, y);
+                minZ = std::min(minZ, z);
+            }
+
+            if(maxX < 0.0f || maxY < 0.0f || minX >= (float)width || minY >= (float)height)
+                return 0;
+
+            x0 = (int)std::max(minX, 0.0f); x1 = (int)std::min(maxX, width - 1.0f);
+            y0 = (int)std::max(minY, 0.0f); y1 = (int)std::min(maxY, height - 1.0f);
+            return -1;
+        }
+
+        void rasterizeTile(unsigned int tile)
+        {
+            int tileX = (tile % tilesX) * TILE_WIDTH;
+            int tileY = (tile / tilesX) * TILE_HEIGHT;
+
+            float *depth = &levels[0][0];
+            for(int y = tileY; y < tileY + (int)TILE_HEIGHT; y++)
+                std::fill(depth + y * width + tileX, depth + y * width + tileX + TILE_WIDTH, 1.0f);
+
+            const vector<unsigned int> &bin = bins[tile];
+            for(unsigned int i = 0; i < bin.size(); i++)
+            {
+                const ScreenTriangle &t = triangles[bin[i]];
+
+                // edge functions, positive inside a counter-clockwise triangle: e = a * x + b * y + c. each is
+                // moved inwards by half a texel along both axes, so at a texel's centre it gives the value at the
+                // texel's innermost corner: non-negative there means the whole texel is inside
+                float a[3], b[3], c[3];
+                for(int e = 0; e < 3; e++)
+                {
+                    int n = (e + 1) % 3;
+                    a[e] = t.y[e] - t.y[n];
+                    b[e] = t.x[n] - t.x[e];
+                    c[e] = -(a[e] * t.x[e] + b[e] * t.y[e]) - 0.5f * (fabsf(a[e]) + fabsf(b[e]));
+                }
+
+                // depth is linear in screen space: z = dzdx * x + dzdy * y + zc
+                float area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.y[1] - t.y[0]) * (t.x[2] - t.x[0]);
+                float dzdx = ((t.z[1] - t.z[0]) * (t.y[2] - t.y[0]) - (t.z[2] - t.z[0]) * (t.y[1] - t.y[0])) / area;
+                float dzdy = ((t.z[2] - t.z[0]) * (t.x[1] - t.x[0]) - (t.z[1] - t.z[0]) * (t.x[2] - t.x[0])) / area;
+                // evaluated at a texel's centre, the depth at its farthest corner
+                float zc = t.z[0] - dzdx * t.x[0] - dzdy * t.y[0] + 0.5f * (fabsf(dzdx) + fabsf(dzdy));
+
+                // triangle bounds clipped to the tile, x snapped down to a group of 4 pixels
+                int x0 = (int)std::max(std::min(t.x[0], std::min(t.x[1], t.x[2])), (float)tileX) & ~3;
+                int x1 = (int)std::min(std::max(t.x[0], std::max(t.x[1], t.x[2])), tileX + TILE_WIDTH - 1.0f);
+                int y0 = (int)std::max(std::min(t.y[0], std::min(t.y[1], t.y[2])), (float)tileY);
+                int y1 = (int)std::min(std::max(t.y[0], std::max(t.y[1], t.y[2])), tileY + TILE_HEIGHT - 1.0f);
+
+#ifdef FRUSTUM_SSE
+                // four pixels of a row per step
+                __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+                __m128 a0 = _mm_set1_ps(a[0]), a1 = _mm_set1_ps(a[1]), a2 = _mm_set1_ps(a[2]);
+                __m128 dz = _mm_set1_ps(dzdx);
+                __m128 zero = _mm_setzero_ps();
+
+                for(int y = y0; y <= y1; y++)
+                {
+                    float py = y + 0.5f;
+                    __m128 r0 = _mm_set1_ps(b[0] * py + c[0]);
+                    __m128 r1 = _mm_set1_ps(b[1] * py + c[1]);
+                    __m128 r2 = _mm_set1_ps(b[2] * py + c[2]);
+                    __m128 rz = _mm_set1_ps(dzdy * py + zc);
+                    float *row = depth + y * width;
+
+                    for(int x = x0; x <= x1; x += 4)
+                    {
+                        __m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+                        __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, px), r0);
+                        __m128 e1 = _mm_add_ps(_mm_mul_ps(a1, px), r1);
+                        __m128 e2 = _mm_add_ps(_mm_mul_ps(a2, px), r2);
+
+                        __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+                        if(_mm_movemask_ps(inside) == 0)
+                            continue;
+
+                        __m128 z = _mm_add_ps(_mm_mul_ps(dz, px), rz);
+                        __m128 old = _mm_loadu_ps(row + x);
+                        __m128 nearest = _mm_min_ps(old, z);
+                        _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+                    }
+                }
+#else
+                for(int y = y0; y <= y1; y++)
+                {
+                    float py = y + 0.5f;
+                    float *row = depth + y * width;
+                    for(int x = x0; x <= x1; x++)
+                    {
+                        float px = x + 0.5f;
+                        if(a[0] * px + b[0] * py + c[0] < 0.0f || a[1] * px + b[1] * py + c[1] < 0.0f || a[2] * px + b[2] * py + c[2] < 0.0f)
+                            continue;
+
+                        float z = dzdx * px + dzdy * py + zc;
+                        if(z < row[x])
+                            row[x] = z;
+                    }
+                }
+#endif
+            }
+        }
+
+        // the mip levels covering a tile only depend on the tile's own pixels
+        void downsampleTile(unsigned int tile)
+        {
+            unsigned int tileX = tile % tilesX, tileY = tile / tilesX;
+            for(unsigned int level = 1; level <= TILE_LEVELS && level < levels.size(); level++)
+            {
+                unsigned int w = TILE_WIDTH >> level, h = TILE_HEIGHT >> level;
+                downsample(level, tileX * w, tileY * h, tileX * w + w, tileY * h + h);
+            }
+        }
+
+        // fills a rectangle of a level with the max of 2x2 texels of the level above; odd edges reuse the last texel
+        void downsample(unsigned int level, unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1)
+        {
+            const vector<float> &src = levels[level - 1];
+            vector<float> &dst = levels[level];
+            unsigned int srcWidth = levelWidth[level - 1], srcHeight = levelHeight[level - 1];
+
+            for(unsigned int y = y0; y < y1; y++)
+            {
+                unsigned int sy0 = y * 2, sy1 = std::min(y * 2 + 1, srcHeight - 1);
+                for(unsigned int x = x0; x < x1; x++)
+                {
+                    unsigned int sx0 = x * 2, sx1 = std::min(x * 2 + 1, srcWidth - 1);
+                    dst[y * levelWidth[level] + x] = std::max(std::max(src[sy0 * srcWidth + sx0], src[sy0 * srcWidth + sx1]),
+                                                              std::max(src[sy1 * srcWidth + sx0], src[sy1 * srcWidth + sx1]));
+                }
+            }
+        }
+};
+#endif
@@ -0,0 +1,210 @@
+#ifndef OCCLUSIONQUERY_H
+#define OCCLUSIONQUERY_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <shader.h>
+#include <frustum.h>
+#include <uniformblocks.h>
+
+#include <vector>
+
+using namespace std;
+
+// hardware occlusion queries against mesh bounding boxes, with temporal coherence.
+// every frame each candidate's box is drawn (colour and depth writes off) inside an any-samples-passed
+// query once the visible meshes have filled the depth buffer. results are collected at the start of a
+// later frame, only once GL reports them available, so the CPU never waits on the GPU; until then a mesh
+// keeps the visibility it had. meshes last seen occluded are drawn under conditional rendering on their
+// query, so the GPU drops them without the CPU ever reading the result.
+class OcclusionQueries
+{
+    public:
+        // per frame counters
+        unsigned int queriesIssued;  // boxes drawn inside a query
+        unsigned int resultsPending; // queries still in flight when results were collected
+        unsigned int drawsSkipped;   // occluded meshes not drawn, by the CPU or by conditional rendering
+
+        OcclusionQueries() : queriesIssued(0), resultsPending(0), drawsSkipped(0), rendering(false), boxShader("boundingBox.vs", "boundingBox.fs")
+        {
+            boxShader.bindUniformBlock("Camera", CAMERA_BLOCK_BINDING);
+
+            // part of GL 3.0, but still checked so a stripped down loader degrades to CPU skipping
+            conditional = glad_glBeginConditionalRender != NULL;
+
+            // unit cube, drawn with the triangles of its six faces
+            float corners[8 * 3];
+            for(int i = 0; i < 8; i++)
+            {
+                corners[i * 3 + 0] = (float)(i & 1);
+                corners[i * 3 + 1] = (float)((i >> 1) & 1);
+                corners[i * 3 + 2] = (float)((i >> 2) & 1);
+            }
+            unsigned int indices[36] = { 0, 2, 6, 0, 6, 4,   1, 5, 7, 1, 7, 3,   0, 4, 5, 0, 5, 1,
+                                         2, 3, 7, 2, 7, 6,   0, 1, 3, 0, 3, 2,   4, 6, 7, 4, 7, 5 };
+
+            glGenVertexArrays(1, &VAO);
+            glGenBuffers(1, &VBO);
+            glGenBuffers(1, &EBO);
+
+            glBindVertexArray(VAO);
+            glBindBuffer(GL_ARRAY_BUFFER, VBO);
+            glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+
+            glBindVertexArray(0);
+        }
+
+        bool SupportsConditionalRender() const { return conditional; }
+
+        // reads back every query whose result has arrived, never waiting for the rest
+        void Collect(unsigned int meshCount)
+        {
+            if(queries.size() < meshCount)
+            {
+                unsigned int first = queries.size();
+                queries.resize(meshCount);
+                for(unsigned int i = first; i < meshCount; i++)
+                    glGenQueries(1, &queries[i].id);
+            }
+
+            queriesIssued = resultsPending = drawsSkipped = 0;
+
+            for(unsigned int i = 0; i < queries.size(); i++)
+            {
+                Query &query = queries[i];
+                if(!query.pending)
+                    continue;
+
+                GLuint available = 0;
+                glGetQueryObjectuiv(query.id, GL_QUERY_RESULT_AVAILABLE, &available);
+                if(!available)
+                {
+                    resultsPending++;
+                    continue;
+                }
+
+                GLuint passed = 0;
+                glGetQueryObjectuiv(query.id, GL_QUERY_RESULT, &passed);
+                query.pending = false;
+                query.visible = passed != 0;
+
+                // a conditional draw behind a failed query was thrown away by the GPU
+                if(query.conditional && !query.visible)
+                    drawsSkipped++;
+            }
+        }
+
+        // visibility from the latest result; meshes never queried count as visible
+        bool WasVisible(unsigned int mesh) const
+        {
+            return mesh >= queries.size() || queries[mesh].visible;
+        }
+
+        // forgets what is known about a mesh, e.g. once it leaves the frustum, so it is drawn when it comes back
+        void Invalidate(unsigned int mesh)
+        {
+            if(mesh < queries.size())
+                queries[mesh].visible = true;
+        }
+
+        // state for drawing query boxes: no colour or depth writes, depth testing against the scene drawn so far
+        void BeginBoxes()
+        {
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            glDepthMask(GL_FALSE);
+
+            boxShader.use();
+            glBindVertexArray(VAO);
+        }
+
+        // queries a mesh's world space box unless its previous query is still in flight; returns whether one was issued.
+        // boxes around the camera would be clipped by the near plane, so those meshes are simply marked visible
+        bool QueryBox(unsigned int mesh, const AABB &box, const glm::vec3 &cameraPosition, float nearPlane)
+        {
+            Query &query = queries[mesh];
+            if(query.pending)
+                return false;
+
+            glm::vec3 margin(nearPlane * 2.0f);
+            if(glm::all(glm::greaterThanEqual(cameraPosition, box.min - margin)) && glm::all(glm::lessThanEqual(cameraPosition, box.max + margin)))
+            {
+                query.visible = true;
+                return false;
+            }
+
+            boxShader.setVec3("boxMin", box.min);
+            boxShader.setVec3("boxSize", box.max - box.min);
+
+            glBeginQuery(GL_ANY_SAMPLES_PASSED, query.id);
+            glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+            glEndQuery(GL_ANY_SAMPLES_PASSED);
+
+            query.pending = true;
+            query.conditional = false;
+            queriesIssued++;
+            return true;
+        }
+
+        void EndBoxes()
+        {
+            glBindVertexArray(0);
+            glDepthMask(GL_TRUE);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        }
+
+        // starts drawing a mesh last seen occluded; returns false if it should be skipped instead.
+        // with conditional rendering the GPU decides from the mesh's latest query, drawing it if that isn't finished.
+        // a mesh QueryBox marked visible without a query (its box encloses the camera) is drawn unconditionally
+        bool BeginConditional(unsigned int mesh)
+        {
+            Query &query = queries[mesh];
+            if(!query.pending && query.visible)
+            {
+                rendering = false;
+                return true;
+            }
+            if(!conditional || !query.pending)
+            {
+                drawsSkipped++;
+                return false;
+            }
+
+            query.conditional = true;
+            glBeginConditionalRender(query.id, GL_QUERY_NO_WAIT);
+            rendering = true;
+            return true;
+        }
+
+        void EndConditional()
+        {
+            if(rendering)
+                glEndConditionalRender();
+            rendering = false;
+        }
+
+    private:
+        struct Query
+        {
+            unsigned int id;
+            bool pending;     // issued, result not read yet
+            bool visible;     // latest result
+            bool conditional; // a draw was made conditional on this query
+
+            Query() : id(0), pending(false), visible(true), conditional(false) {}
+        };
+
+        vector<Query> queries; // one per mesh
+        bool conditional;
+        bool rendering;        // a BeginConditional draw is under conditional rendering
+
+        Shader boxShader;
+        unsigned int VAO, VBO, EBO;
+};
+#endif
@@ -0,0 +1,177 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// number of threads worth using on this machine (hardware_concurrency may report 0)
+inline unsigned int HardwareThreads()
+{
+    unsigned int threads = std::thread::hardware_concurrency();
+    return threads > 0 ? threads : 1;
+}
+
+// worker threads started once and kept waiting, so handing out work every frame costs a wake up rather than
+// a thread's creation. a job is a number of tasks, claimed one at a time by the workers and the thread that
+// runs it; one job runs at a time, and a job started from inside a task runs on that task's thread
+class WorkerPool
+{
+    public:
+        static WorkerPool &Get()
+        {
+            static WorkerPool pool;
+            return pool;
+        }
+
+        // calls task(context, i) for every i in [0, count) on up to helpers workers and the calling thread,
+        // and returns once all of them are done
+        void Run(unsigned int count, unsigned int helpers, void (*task)(void*, unsigned int), void *context)
+        {
+            if(count == 0)
+                return;
+            if(helpers == 0 || count == 1 || insideTask())
+            {
+                for(unsigned int i = 0; i < count; i++)
+                    task(context, i);
+                return;
+            }
+
+            std::lock_guard<std::mutex> serial(runMutex);
+            std::unique_lock<std::mutex> lock(mutex);
+            while(workers.size() < helpers)
+                workers.push_back(std::thread(&WorkerPool::workerLoop, this));
+
+            job.task = task;
+            job.context = context;
+            job.count = count;
+            next.store(0, std::memory_order_relaxed);
+            open = true;
+            generation++;
+            lock.unlock();
+            wake.notify_all();
+
+            work(job);
+
+            // every task is claimed; wait for the workers still running one
+            lock.lock();
+            open = false;
+            done.wait(lock, [this]() { return active == 0; });
+        }
+
+        ~WorkerPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for(unsigned int i = 0; i < workers.size(); i++)
+                workers[i].join();
+        }
+
+    private:
+        struct Job
+        {
+            void (*task)(void*, unsigned int);
+            void *context;
+            unsigned int count;
+        };
+
+        std::vector<std::thread> workers;
+        std::mutex runMutex;             // one job at a time
+        std::mutex mutex;                // guards the job, open, generation, active and stopping
+        std::condition_variable wake, done;
+        Job job;
+        std::atomic<unsigned int> next;  // the job's next unclaimed task
+        bool open;                       // workers may still join the job
+        unsigned int generation;         // jobs started so far
+        unsigned int active;             // workers inside the job
+        bool stopping;
+
+        WorkerPool() : next(0), open(false), generation(0), active(0), stopping(false)
+        {
+            job.task = NULL;
+            job.context = NULL;
+            job.count = 0;
+        }
+
+        static bool &insideTask()
+        {
+            static thread_local bool inside = false;
+            return inside;
+        }
+
+        void work(const Job &current)
+        {
+            insideTask() = true;
+            for(unsigned int i = next.fetch_add(1); i < current.count; i = next.fetch_add(1))
+                current.task(current.context, i);
+            insideTask() = false;
+        }
+
+        void workerLoop()
+        {
+            unsigned int seen = 0;
+            std::unique_lock<std::mutex> lock(mutex);
+            while(true)
+            {
+                wake.wait(lock, [&]() { return stopping || generation != seen; });
+                if(stopping)
+                    return;
+                seen = generation;
+                if(!open)
+                    continue; // woke after the job was over
+
+                active++;
+                Job current = job;
+                lock.unlock();
+                work(current);
+                lock.lock();
+                if(--active == 0)
+                    done.notify_all();
+            }
+        }
+};
+
+// splits [0, count) into one contiguous chunk per thread and calls function(begin, end, chunkIndex) on each,
+// on the worker pool with the calling thread taking chunks too. chunk indices are unique within the call, so
+// they can index per-thread state. the call returns once every chunk is done
+template<typename Function>
+void ParallelFor(unsigned int count, unsigned int threads, Function function)
+{
+    if(threads > count)
+        threads = count;
+    if(threads <= 1)
+    {
+        if(count > 0)
+            function(0u, count, 0u);
+        return;
+    }
+
+    struct Chunks
+    {
+        Function *function;
+        unsigned int count, size;
+
+        static void run(void *context, unsigned int chunk)
+        {
+            Chunks *chunks = (Chunks*)context;
+            unsigned int begin = chunk * chunks->size;
+            unsigned int end = begin + chunks->size < chunks->count ? begin + chunks->size : chunks->count;
+            (*chunks->function)(begin, end, chunk);
+        }
+    };
+
+    Chunks chunks;
+    chunks.function = &function;
+    chunks.count = count;
+    chunks.size = (count + threads - 1) / threads;
+
+    // the last chunks may be empty when count doesn't divide evenly
+    unsigned int used = (count + chunks.size - 1) / chunks.size;
+    WorkerPool::Get().Run(used, used - 1, &Chunks::run, &chunks);
+}
+#endif
@@ -0,0 +1,476 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// frame profiler, built in with RENDERER_PROFILER; without it every PROFILE_ macro expands to nothing and
+// none of this is compiled.
+//   PROFILE_ZONE("name")           times the rest of the enclosing scope on the calling thread
+//   PROFILE_GPU_ZONE("name")       the same, and the GL commands issued in it on the GPU (GL thread only)
+//   PROFILE_THREAD("name")         names the calling thread in captures
+//   PROFILE_FRAME()                ends a frame (GL thread only)
+//   PROFILE_CAPTURE(frames, path)  records the zones of the next frames, then writes them to path as
+//                                  Chrome trace JSON, for chrome://tracing or ui.perfetto.dev
+// zones are only recorded during a capture. names must outlive it (string literals): only the pointer is kept
+#ifdef RENDERER_PROFILER
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct ProfileEvent
+{
+    const char *name;
+    int64_t start, end; // nanoseconds since the profiler started
+};
+
+// the zones one thread ended, until the frame collects them. only the owning thread pushes and only the
+// collecting thread pops, so neither locks: each side owns one index and publishes it to the other
+class ProfileRing
+{
+    public:
+        static const uint32_t CAPACITY = 1 << 13; // events per thread per frame, a power of two; more are dropped
+
+        unsigned int id;                // tid in the trace
+        std::atomic<const char*> name;  // set by the owner, NULL for unnamed
+        std::atomic<bool> owned;        // by a live thread; a thread's ring is reused once it exits
+        std::atomic<uint32_t> dropped;
+        ProfileRing *next;              // every ring ever made, newest first
+
+        ProfileRing(unsigned int id) : id(id), name((const char*)NULL), owned(true), dropped(0), next(NULL), head(0), tail(0)
+        {
+        }
+
+        void Push(const char *zone, int64_t start, int64_t end)
+        {
+            uint32_t h = head.load(std::memory_order_relaxed);
+            if(h - tail.load(std::memory_order_acquire) >= CAPACITY)
+            {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            ProfileEvent &event = events[h & (CAPACITY - 1)];
+            event.name = zone;
+            event.start = start;
+            event.end = end;
+            head.store(h + 1, std::memory_order_release);
+        }
+
+        // hands every event pushed so far to function, oldest first
+        template<typename Function>
+        void Drain(Function function)
+        {
+            uint32_t t = tail.load(std::memory_order_relaxed), h = head.load(std::memory_order_acquire);
+            for(; t != h; t++)
+                function(events[t & (CAPACITY - 1)]);
+            tail.store(t, std::memory_order_release);
+        }
+
+    private:
+        ProfileEvent events[CAPACITY];
+        std::atomic<uint32_t> head; // next slot the owner writes
+        std::atomic<uint32_t> tail; // next slot the collector reads
+};
+
+class Profiler
+{
+    public:
+        static const unsigned int GPU_FRAMES = 4; // frames a GPU zone's timestamps may take to arrive
+
+        static Profiler &Get()
+        {
+            static Profiler profiler;
+            return profiler;
+        }
+
+        static int64_t Now()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - Get().epoch).count();
+        }
+
+        // whether zones are recorded; read once by every zone as it opens
+        bool Recording() const
+        {
+            return recording.load(std::memory_order_relaxed);
+        }
+
+        // the calling thread's ring, made or taken over from an exited thread the first time it's needed
+        ProfileRing *ThreadRing()
+        {
+            struct Handle
+            {
+                ProfileRing *ring;
+                Handle() : ring(NULL) {}
+                ~Handle()
+                {
+                    if(ring)
+                    {
+                        ring->name.store(NULL, std::memory_order_relaxed);
+                        ring->owned.store(false, std::memory_order_release);
+                    }
+                }
+            };
+            static thread_local Handle handle;
+            if(!handle.ring)
+                handle.ring = acquireRing();
+            return handle.ring;
+        }
+
+        void NameThread(const char *name)
+        {
+            ThreadRing()->name.store(name, std::memory_order_relaxed);
+        }
+
+        // starts capturing the given number of frames at the next frame boundary, written to path once the
+        // last of their GPU times arrived. ignored while a capture is running
+        void Capture(unsigned int frames, const string &path)
+        {
+            if(recording.load(std::memory_order_relaxed) || finishing || frames == 0)
+                return;
+            requestedFrames = frames;
+            capturePath = path;
+        }
+
+        // ---- GPU zones: two GL_TIMESTAMP queries each, read without waiting GPU_FRAMES frames later ----
+        // returns the zone's index in this frame, or -1 when not recording
+        int BeginGpuZone(const char *name)
+        {
+            if(!Recording())
+                return -1;
+
+            GpuFrame &slot = gpuFrames[gpuFrame % GPU_FRAMES];
+            unsigned int first = slot.zones.size() * 2;
+            if(first + 2 > slot.queries.size())
+            {
+                slot.queries.resize(first + 2);
+                glGenQueries(2, &slot.queries[first]);
+            }
+            glQueryCounter(slot.queries[first], GL_TIMESTAMP);
+
+            GpuZone zone;
+            zone.name = name;
+            zone.ended = false;
+            slot.zones.push_back(zone);
+            return slot.zones.size() - 1;
+        }
+
+        void EndGpuZone(int zone)
+        {
+            GpuFrame &slot = gpuFrames[gpuFrame % GPU_FRAMES];
+            if(zone < 0 || zone >= (int)slot.zones.size())
+                return;
+            glQueryCounter(slot.queries[zone * 2 + 1], GL_TIMESTAMP);
+            slot.zones[zone].ended = true;
+        }
+
+        // closes the frame's zones, collects the GPU times that arrived and every thread's CPU zones, and
+        // starts or finishes a capture
+        void EndFrame()
+        {
+            int64_t now = Now();
+            bool capturing = Recording();
+            if(capturing)
+                ThreadRing()->Push("Frame", frameStart, now);
+            frameStart = now;
+
+            // the next slot is reused: whatever of it is still in flight is given up on
+            GpuFrame &closed = gpuFrames[gpuFrame % GPU_FRAMES];
+            closed.pending = !closed.zones.empty();
+            gpuFrame++;
+            collectGpu();
+            GpuFrame &next = gpuFrames[gpuFrame % GPU_FRAMES];
+            if(next.pending)
+                gpuDropped += next.zones.size();
+            next.pending = false;
+            next.zones.clear();
+
+            collectRings(capturing || finishing);
+
+            if(capturing)
+            {
+                capturedFrames++;
+                if(--framesLeft == 0)
+                {
+                    recording.store(false, std::memory_order_relaxed);
+                    finishing = GPU_FRAMES;
+                }
+            }
+            else if(finishing)
+            {
+                if(!gpuPending() || --finishing == 0)
+                {
+                    finishing = 0;
+                    write();
+                }
+            }
+            else if(requestedFrames)
+                begin();
+        }
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        struct GpuZone
+        {
+            const char *name;
+            bool ended;
+        };
+
+        // the GPU zones of one frame; zone i owns queries 2i (start) and 2i + 1 (end)
+        struct GpuFrame
+        {
+            vector<GLuint> queries;
+            vector<GpuZone> zones;
+            bool pending;
+            GpuFrame() : pending(false) {}
+        };
+
+        struct CapturedEvent
+        {
+            const char *name;
+            int64_t start, end;
+            int tid; // -1 for the GPU
+        };
+
+        Clock::time_point epoch;
+        std::atomic<bool> recording;
+        std::atomic<ProfileRing*> rings;
+        std::atomic<unsigned int> ringCount;
+
+        int64_t frameStart;
+        unsigned int requestedFrames, framesLeft, capturedFrames, finishing;
+        string capturePath;
+
+        GpuFrame gpuFrames[GPU_FRAMES];
+        unsigned int gpuFrame;
+        int64_t gpuOffset; // GPU timestamp minus the profiler's clock, measured as a capture starts
+        unsigned int gpuDropped;
+
+        vector<CapturedEvent> captured;
+        vector<string> threadNames; // by ring id, as last seen during the capture
+        unsigned int cpuDropped;
+
+        Profiler() : epoch(Clock::now()), recording(false), rings((ProfileRing*)NULL), ringCount(0), frameStart(0), requestedFrames(0),
+                     framesLeft(0), capturedFrames(0), finishing(0), gpuFrame(0), gpuOffset(0), gpuDropped(0), cpuDropped(0)
+        {
+        }
+
+        // an exited thread's ring if there is one, else a new one pushed onto the list
+        ProfileRing *acquireRing()
+        {
+            for(ProfileRing *ring = rings.load(std::memory_order_acquire); ring; ring = ring->next)
+            {
+                bool expected = false;
+                if(!ring->owned.load(std::memory_order_relaxed) && ring->owned.compare_exchange_strong(expected, true, std::memory_order_acquire))
+                    return ring;
+            }
+
+            ProfileRing *ring = new ProfileRing(ringCount.fetch_add(1));
+            ProfileRing *head = rings.load(std::memory_order_relaxed);
+            do
+                ring->next = head;
+            while(!rings.compare_exchange_weak(head, ring, std::memory_order_release, std::memory_order_relaxed));
+            return ring;
+        }
+
+        void collectRings(bool keep)
+        {
+            for(ProfileRing *ring = rings.load(std::memory_order_acquire); ring; ring = ring->next)
+            {
+                unsigned int drained = 0;
+                ring->Drain([&](const ProfileEvent &event)
+                {
+                    drained++;
+                    if(!keep)
+                        return;
+                    CapturedEvent e = { event.name, event.start, event.end, (int)ring->id };
+                    captured.push_back(e);
+                });
+
+                if(keep)
+                {
+                    cpuDropped += ring->dropped.exchange(0);
+                    const char *name = ring->name.load(std::memory_order_relaxed);
+                    if(ring->id >= threadNames.size())
+                        threadNames.resize(ring->id + 1);
+                    if(name)
+                        threadNames[ring->id] = name;
+                    else if(drained && threadNames[ring->id].empty())
+                        threadNames[ring->id] = "thread " + std::to_string(ring->id);
+                }
+                else
+                    ring->dropped.store(0);
+            }
+        }
+
+        // reads the pending frames whose last query finished, oldest first (from the slot about to be reused),
+        // onto the profiler's clock
+        void collectGpu()
+        {
+            for(unsigned int i = 0; i < GPU_FRAMES; i++)
+            {
+                GpuFrame &slot = gpuFrames[(gpuFrame + i) % GPU_FRAMES];
+                if(!slot.pending)
+                    continue;
+
+                // the frame is done when its last timestamp is; a zone left open by the frame never gets one
+                int last = slot.zones.size() - 1;
+                while(last >= 0 && !slot.zones[last].ended)
+                    last--;
+                GLuint available = 1;
+                if(last >= 0)
+                    glGetQueryObjectuiv(slot.queries[last * 2 + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+                if(!available)
+                    break; // later frames can't have finished first
+
+                for(unsigned int z = 0; z < slot.zones.size(); z++)
+                {
+                    if(!slot.zones[z].ended)
+                        continue;
+                    GLuint64 start = 0, end = 0;
+                    glGetQueryObjectui64v(slot.queries[z * 2], GL_QUERY_RESULT, &start);
+                    glGetQueryObjectui64v(slot.queries[z * 2 + 1], GL_QUERY_RESULT, &end);
+                    CapturedEvent e = { slot.zones[z].name, (int64_t)start - gpuOffset, (int64_t)end - gpuOffset, -1 };
+                    captured.push_back(e);
+                }
+                slot.pending = false;
+                slot.zones.clear();
+            }
+        }
+
+        bool gpuPending() const
+        {
+            for(unsigned int i = 0; i < GPU_FRAMES; i++)
+                if(gpuFrames[i].pending)
+                    return true;
+            return false;
+        }
+
+        void begin()
+        {
+            // the GPU's clock against ours; the query's latency is small next to the zones it places
+            GLint64 gpuNow = 0;
+            glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+            gpuOffset = gpuNow - Now();
+
+            captured.clear();
+            threadNames.clear();
+            capturedFrames = 0;
+            cpuDropped = gpuDropped = 0;
+            framesLeft = requestedFrames;
+            requestedFrames = 0;
+            frameStart = Now();
+            recording.store(true, std::memory_order_relaxed);
+        }
+
+        static string escape(const char *text)
+        {
+            string escaped;
+            for(; *text; text++)
+            {
+                if(*text == '"' || *text == '\\')
+                    escaped += '\\';
+                escaped += *text;
+            }
+            return escaped;
+        }
+
+        void write()
+        {
+            std::ofstream out(capturePath.c_str());
+            if(!out)
+            {
+                std::cout << "ERROR::PROFILER::CAPTURE_NOT_WRITTEN: " << capturePath << std::endl;
+                captured.clear();
+                return;
+            }
+
+            // complete ("X") events in microseconds, the CPU threads in one process and the GPU in another
+            out << std::fixed << std::setprecision(3);
+            out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+            out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"CPU\"}}," << std::endl;
+            out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"GPU\"}}," << std::endl;
+            out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":2,\"tid\":0,\"args\":{\"name\":\"GL\"}}";
+            for(unsigned int t = 0; t < threadNames.size(); t++)
+                if(!threadNames[t].empty())
+                    out << "," << std::endl << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t << ",\"args\":{\"name\":\"" << escape(threadNames[t].c_str()) << "\"}}";
+
+            unsigned int cpuZones = 0, gpuZones = 0;
+            for(unsigned int i = 0; i < captured.size(); i++)
+            {
+                const CapturedEvent &e = captured[i];
+                bool gpu = e.tid < 0;
+                out << "," << std::endl << "{\"name\":\"" << escape(e.name) << "\",\"cat\":\"" << (gpu ? "gpu" : "cpu") << "\",\"ph\":\"X\",\"pid\":"
+                    << (gpu ? 2 : 1) << ",\"tid\":" << (gpu ? 0 : e.tid) << ",\"ts\":" << e.start / 1000.0 << ",\"dur\":" << max<int64_t>(e.end - e.start, 0) / 1000.0 << "}";
+                (gpu ? gpuZones : cpuZones)++;
+            }
+            out << std::endl << "]}" << std::endl;
+
+            std::cout << "Profile of " << capturedFrames << " frames written to " << capturePath << ": " << cpuZones << " CPU zones, " << gpuZones << " GPU zones";
+            if(cpuDropped || gpuDropped)
+                std::cout << " (" << cpuDropped << " CPU and " << gpuDropped << " GPU zones dropped)";
+            std::cout << std::endl;
+            captured.clear();
+        }
+};
+
+class ProfileZone
+{
+    public:
+        ProfileZone(const char *name) : name(name), ring(Profiler::Get().Recording() ? Profiler::Get().ThreadRing() : NULL), start(ring ? Profiler::Now() : 0)
+        {
+        }
+
+        ~ProfileZone()
+        {
+            if(ring)
+                ring->Push(name, start, Profiler::Now());
+        }
+
+    private:
+        const char *name;
+        ProfileRing *ring;
+        int64_t start;
+};
+
+class ProfileGpuZone
+{
+    public:
+        ProfileGpuZone(const char *name) : cpu(name), zone(Profiler::Get().BeginGpuZone(name))
+        {
+        }
+
+        ~ProfileGpuZone()
+        {
+            Profiler::Get().EndGpuZone(zone);
+        }
+
+    private:
+        ProfileZone cpu;
+        int zone;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_GPU_ZONE(name) ProfileGpuZone PROFILE_CONCAT(profileGpuZone, __LINE__)(name)
+#define PROFILE_THREAD(name) Profiler::Get().NameThread(name)
+#define PROFILE_FRAME() Profiler::Get().EndFrame()
+#define PROFILE_CAPTURE(frames, path) Profiler::Get().Capture(frames, path)
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_GPU_ZONE(name)
+#define PROFILE_THREAD(name) ((void)0)
+#define PROFILE_FRAME() ((void)0)
+#define PROFILE_CAPTURE(frames, path) ((void)0)
+#endif
+#endif
@@ -0,0 +1,209 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <glad/glad.h>
+
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+// on-disk cache of linked program binaries (glGetProgramBinary / glProgramBinary).
+// a program is keyed by a hash of its sources and defines plus the vendor, renderer and version strings,
+// so a driver update or a different GPU simply misses. a binary the driver rejects is ignored and the
+// caller compiles from source as if the cache were empty; the fresh binary then replaces the stale one.
+class ProgramCache
+{
+    public:
+        enum Mode
+        {
+            CACHE_DISABLED, // always compile from source
+            CACHE_REFRESH,  // compile from source and overwrite the cache (a cold start)
+            CACHE_ENABLED   // load from the cache when possible
+        };
+
+        struct Stats
+        {
+            unsigned int hits;     // programs loaded from a binary
+            unsigned int misses;   // programs compiled from source
+            unsigned int rejected; // binaries found but refused by the driver
+            unsigned int saved;    // binaries written
+            double milliseconds;   // spent building programs, from the cache or from source
+        };
+
+        static Mode &mode()
+        {
+            static Mode current = CACHE_ENABLED;
+            return current;
+        }
+
+        // relative to the working directory, which is the repository root while the renderer runs
+        static std::string &directory()
+        {
+            static std::string path = "shadercache";
+            return path;
+        }
+
+        static Stats &stats()
+        {
+            static Stats counters = { 0, 0, 0, 0, 0.0 };
+            return counters;
+        }
+
+        // program binaries are core in 4.1; some drivers expose the entry points but no binary formats
+        static bool IsSupported()
+        {
+            static int supported = -1;
+            if(supported < 0)
+            {
+                GLint formats = 0;
+                bool api = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 1) || GLAD_GL_ARB_get_program_binary;
+                if(api && glad_glGetProgramBinary != NULL && glad_glProgramBinary != NULL)
+                    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+                supported = formats > 0 ? 1 : 0;
+            }
+            return supported == 1;
+        }
+
+        // the cache key of a program built from these sources with these defines on this driver
+        static unsigned long long Key(const std::string &vertexCode, const std::string &fragmentCode, const std::string &defines)
+        {
+            unsigned long long hash = 14695981039346656037ull;
+            hash = hashString(hash, vertexCode);
+            hash = hashString(hash, fragmentCode);
+            hash = hashString(hash, defines);
+            hash = hashString(hash, glString(GL_VENDOR));
+            hash = hashString(hash, glString(GL_RENDERER));
+            hash = hashString(hash, glString(GL_VERSION));
+            return hash;
+        }
+
+        // asks for a retrievable binary; call before linking a program that will be saved
+        static void PrepareLink(unsigned int program)
+        {
+            if(mode() != CACHE_DISABLED && IsSupported())
+                glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+
+        // links the program from its cached binary; false (without complaint) when there is none or it is refused
+        static bool Load(unsigned int program, unsigned long long key)
+        {
+            if(mode() != CACHE_ENABLED || !IsSupported())
+                return false;
+
+            FILE *file = fopen(path(key).c_str(), "rb");
+            if(!file)
+                return false;
+
+            Header header;
+            std::vector<char> binary;
+            bool read = fread(&header, sizeof(header), 1, file) == 1 && header.magic == MAGIC && header.key == key && header.length > 0;
+            if(read)
+            {
+                binary.resize(header.length);
+                read = fread(&binary[0], 1, header.length, file) == header.length;
+            }
+            fclose(file);
+
+            if(!read)
+                return false;
+
+            glProgramBinary(program, header.format, &binary[0], header.length);
+
+            GLint linked = 0;
+            glGetProgramiv(program, GL_LINK_STATUS, &linked);
+            if(!linked)
+            {
+                stats().rejected++;
+                return false;
+            }
+
+            stats().hits++;
+            return true;
+        }
+
+        // writes a freshly linked program's binary
+        static void Save(unsigned int program, unsigned long long key)
+        {
+            stats().misses++;
+            if(mode() == CACHE_DISABLED || !IsSupported())
+                return;
+
+            GLint length = 0;
+            glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+            if(length <= 0)
+                return;
+
+            Header header;
+            header.magic = MAGIC;
+            header.key = key;
+            header.length = length;
+
+            std::vector<char> binary(length);
+            glGetProgramBinary(program, length, NULL, &header.format, &binary[0]);
+
+            makeDirectory(directory());
+
+            FILE *file = fopen(path(key).c_str(), "wb");
+            if(!file)
+                return;
+
+            bool written = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(&binary[0], 1, length, file) == (size_t)length;
+            fclose(file);
+
+            if(written)
+                stats().saved++;
+            else
+                remove(path(key).c_str());
+        }
+
+    private:
+        static const unsigned int MAGIC = 0x42505247; // "GRPB"
+
+        struct Header
+        {
+            unsigned int magic;
+            GLenum format;
+            unsigned long long key;
+            unsigned int length;
+        };
+
+        static unsigned long long hashString(unsigned long long hash, const std::string &text)
+        {
+            // 64-bit FNV-1a, with the terminator included so ("ab", "c") and ("a", "bc") differ
+            for(size_t i = 0; i <= text.size(); i++)
+            {
+                hash ^= (unsigned char)(i < text.size() ? text[i] : 0);
+                hash *= 1099511628211ull;
+            }
+            return hash;
+        }
+
+        static std::string glString(GLenum name)
+        {
+            const GLubyte *value = glGetString(name);
+            return value ? (const char*)value : "";
+        }
+
+        static std::string path(unsigned long long key)
+        {
+            std::ostringstream name;
+            name << directory() << "/" << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+            return name.str();
+        }
+
+        static void makeDirectory(const std::string &name)
+        {
+#ifdef _WIN32
+            _mkdir(name.c_str());
+#else
+            mkdir(name.c_str(), 0755);
+#endif
+        }
+};
+#endif
@@ -0,0 +1,193 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <glad/glad.h>
+
+#include <profiler.h>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+// streams transient per-frame data (draw data, indirect commands, uniform blocks) to the GPU.
+// the buffer is split into one region per frame in flight; each frame sub-allocates linearly from
+// its own region, and a fence guards the region so the CPU never overwrites data the GPU still reads.
+// uses a persistently mapped buffer when ARB_buffer_storage is available, otherwise falls back to
+// orphaning the buffer every frame and writing with unsynchronized maps.
+class RingBuffer
+{
+    public:
+        static const unsigned int FRAMES = 3; // triple buffered
+
+        // the buffer object; bind it to whichever target the upload is consumed from
+        unsigned int ID;
+
+        // true when using the persistently mapped path
+        bool persistent;
+
+        // offset alignment required to bind part of the buffer as a uniform block
+        GLint uniformAlignment;
+
+        // stall reporting for the current frame, and since startup
+        unsigned int frameStalls, totalStalls;
+        double frameStallMs, totalStallMs;
+        unsigned int overflows;
+
+        RingBuffer(GLsizeiptr bytesPerFrame) : ID(0), persistent(false), uniformAlignment(256), frameStalls(0), totalStalls(0), frameStallMs(0.0), totalStallMs(0.0), overflows(0), frameSize(bytesPerFrame), frame(0), head(0), mapped(NULL)
+        {
+            for(unsigned int i = 0; i < FRAMES; i++)
+                fences[i] = 0;
+
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+
+            bool storage = (GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 4)) || GLAD_GL_ARB_buffer_storage;
+            persistent = storage && glad_glBufferStorage != NULL;
+
+            glGenBuffers(1, &ID);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+
+            if(persistent)
+            {
+                GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+                glBufferStorage(GL_COPY_WRITE_BUFFER, frameSize * FRAMES, NULL, flags);
+                mapped = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, frameSize * FRAMES, flags);
+
+                if(!mapped)
+                {
+                    std::cout << "ERROR::RINGBUFFER::PERSISTENT_MAP_FAILED, falling back to orphaning" << std::endl;
+                    persistent = false;
+                    glDeleteBuffers(1, &ID);
+                    glGenBuffers(1, &ID);
+                    glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+                }
+            }
+
+            // the fallback only ever holds one frame; previous frames live on in orphaned storage
+            if(!persistent)
+                glBufferData(GL_COPY_WRITE_BUFFER, frameSize, NULL, GL_STREAM_DRAW);
+
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+
+        // moves on to the next frame's region, waiting for the GPU if it is still reading it
+        void BeginFrame()
+        {
+            PROFILE_ZONE("RingBuffer::BeginFrame");
+            frameStalls = 0;
+            frameStallMs = 0.0;
+
+            if(persistent)
+            {
+                unsigned int region = frame % FRAMES;
+                head = region * frameSize;
+
+                if(fences[region])
+                {
+                    // a zero timeout tells us whether the GPU has caught up without blocking
+                    GLenum status = glClientWaitSync(fences[region], 0, 0);
+                    if(status == GL_TIMEOUT_EXPIRED)
+                    {
+                        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                        do
+                        {
+                            status = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1ms
+                        } while(status == GL_TIMEOUT_EXPIRED);
+
+                        double waited = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                        frameStalls++;
+                        frameStallMs += waited;
+                        totalStalls++;
+                        totalStallMs += waited;
+                    }
+
+                    glDeleteSync(fences[region]);
+                    fences[region] = 0;
+                }
+            }
+            else
+            {
+                // orphan: the driver hands us fresh storage while the GPU keeps reading the old one
+                head = 0;
+                glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+                glBufferData(GL_COPY_WRITE_BUFFER, frameSize, NULL, GL_STREAM_DRAW);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            }
+        }
+
+        // fences the frame's region once all of its draws have been submitted
+        void EndFrame()
+        {
+            if(persistent)
+                fences[frame % FRAMES] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+            frame++;
+        }
+
+        // copies data into this frame's region and returns its offset in the buffer, or -1 if the region is full
+        GLintptr Upload(const void *data, GLsizeiptr size, GLintptr alignment = 4)
+        {
+            GLintptr offset = Allocate(size, alignment);
+            if(offset < 0)
+                return offset;
+
+            if(persistent)
+            {
+                memcpy(mapped + offset, data, size);
+            }
+            else
+            {
+                // unsynchronized is safe: the region was orphaned this frame and nothing in it is reused
+                glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+                void *ptr = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+                if(ptr)
+                {
+                    memcpy(ptr, data, size);
+                    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+                }
+                else
+                {
+                    glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+                }
+                glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            }
+
+            return offset;
+        }
+
+        // bytes still free in this frame's region
+        GLsizeiptr Remaining() const
+        {
+            return regionEnd() - head;
+        }
+
+    private:
+        GLsizeiptr frameSize;
+        unsigned long long frame;
+        GLintptr head; // next free byte
+        char *mapped;
+        GLsync fences[FRAMES];
+
+        GLintptr regionEnd() const
+        {
+            return persistent ? (GLintptr)((frame % FRAMES) + 1) * frameSize : frameSize;
+        }
+
+        // linear sub-allocation from this frame's region
+        GLintptr Allocate(GLsizeiptr size, GLintptr alignment)
+        {
+            if(alignment < 1)
+                alignment = 1;
+
+            GLintptr offset = (head + alignment - 1) / alignment * alignment;
+            if(offset + size > regionEnd())
+            {
+                if(overflows++ == 0)
+                    std::cout << "ERROR::RINGBUFFER::OUT_OF_SPACE: " << size << " bytes requested, frame region is " << frameSize << " bytes" << std::endl;
+                return -1;
+            }
+
+            head = offset + size;
+            return offset;
+        }
+};
+#endif
@@ -1,12 +1,43 @@
 #ifndef SHADER_H
 #define SHADER_H
 #include <glad/glad.h> // include glad to get the required OpenGL headers
+#include <programcache.h>
+#include <shadersource.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <chrono>
 #include <limits.h>
-#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+// FNV-1a hash of a uniform name; constexpr, so the hash of a literal is a constant wherever one is required.
+// a literal passed straight to a setter may be folded by an optimising build but is hashed at run time at -O0;
+// per-draw code hashes at compile time for certain through a constexpr UniformName (see SetTransform)
+constexpr unsigned int HashUniformName(const char *name, unsigned int hash = 2166136261u)
+{
+    return *name ? HashUniformName(name + 1, (hash ^ (unsigned char)*name) * 16777619u) : hash;
+}
+
+// a uniform name and its hash, which is what the shader's location cache is keyed by
+struct UniformName
+{
+    unsigned int hash;
+    const char *name;
+
+    // string literals: usable in constant expressions, e.g. to initialise a constexpr UniformName
+    template<size_t N>
+    constexpr UniformName(const char (&literal)[N]) : hash(HashUniformName(literal)), name(literal) {}
+
+    // names built at runtime are hashed on the spot
+    UniformName(const std::string &string) : hash(HashUniformName(string.c_str())), name(string.c_str()) {}
+};
 
 class Shader
 {
@@ -14,123 +45,503 @@ class Shader
         // the program ID
         unsigned int ID;
 
+        // the source files, relative to src/shaders
+        std::string vertexPath, fragmentPath;
+
+        // preprocessor lines ("#define NAME VALUE\n" ...) injected after the #version line of both stages
+        std::string defines;
+
+        // bumped whenever a reload swaps in a new program, so callers holding locations can refresh them
+        unsigned int generation;
+
         // constructor reads and builds the shader
-        Shader(const char* vertexPath, const char* fragmentPath)
+        Shader(const char* vertexPath, const char* fragmentPath, const std::string &defines = "")
+            : vertexPath(vertexPath), fragmentPath(fragmentPath), defines(defines), generation(0), cacheKey(0), pending(0), pendingKey(0),
+              pendingCached(false), pendingWaited(false), buildVertex(0), buildFragment(0)
         {
-            // move working directory so it can access shaders easily
-            chdir("src/shaders");
-
             // 1. retrieve the vertex/fragment source code from filePath
             std::string vertexCode;
             std::string fragmentCode;
-            std::ifstream vShaderFile;
-            std::ifstream fShaderFile;
+            readSources(vertexCode, fragmentCode);
 
-            // ensure ifstream objects can throw exceptions:
-            vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-            fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+            // 2. link from a cached program binary when there is a valid one
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            ID = glCreateProgram();
 
-            try
+            cacheKey = ProgramCache::Key(vertexCode, fragmentCode, defines);
+            if (!ProgramCache::Load(ID, cacheKey))
             {
-                // open files
-                vShaderFile.open(vertexPath);
-                fShaderFile.open(fragmentPath);
-                std::stringstream vShaderStream, fShaderStream;
-                
-                // read file’s buffer contents into streams
-                vShaderStream << vShaderFile.rdbuf();
-                fShaderStream << fShaderFile.rdbuf();
-
-                // close file handlers
-                vShaderFile.close();
-                fShaderFile.close();
-
-                // convert stream into string
-                vertexCode = vShaderStream.str();
-                fragmentCode = fShaderStream.str();
+                startBuild(ID, vertexCode, fragmentCode);
+                finishBuild(ID, cacheKey);
             }
-            catch(std::ifstream::failure e)
+
+            ProgramCache::stats().milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            reflectUniforms();
+        }
+
+        // use/activate the shader
+        void use()
+        {
+            glUseProgram(ID);
+        }
+
+        // whether the program is built from this file, directly or through an #include
+        bool UsesFile(const std::string &name) const
+        {
+            for (size_t i = 0; i < vertexFiles.size(); i++)
+                if (vertexFiles[i] == name)
+                    return true;
+            for (size_t i = 0; i < fragmentFiles.size(); i++)
+                if (fragmentFiles[i] == name)
+                    return true;
+            return name == vertexPath || name == fragmentPath;
+        }
+
+        // every file either stage was built from, includes too
+        std::vector<std::string> SourceFiles() const
+        {
+            std::vector<std::string> files = vertexFiles;
+            for (size_t i = 0; i < fragmentFiles.size(); i++)
+                if (std::find(files.begin(), files.end(), fragmentFiles[i]) == files.end())
+                    files.push_back(fragmentFiles[i]);
+            return files;
+        }
+
+        // starts rebuilding the program from its files without waiting for the driver; the current program
+        // stays in use until Update() finds the new one linked. returns false if the sources are unchanged
+        bool Reload()
+        {
+            std::string vertexCode, fragmentCode;
+            if (!readSources(vertexCode, fragmentCode))
+                return false;
+
+            unsigned long long key = ProgramCache::Key(vertexCode, fragmentCode, defines);
+            if (key == cacheKey && !pending)
+                return false;
+
+            // an edit while a rebuild is in flight supersedes it
+            discardPending();
+
+            pending = glCreateProgram();
+            pendingKey = key;
+            pendingCached = ProgramCache::Load(pending, key);
+            if (!pendingCached)
+                startBuild(pending, vertexCode, fragmentCode);
+            return true;
+        }
+
+        bool Reloading() const
+        {
+            return pending != 0;
+        }
+
+        // finishes a reload once the driver is done with it: a program that linked replaces the current one,
+        // one that didn't is reported and dropped. returns true when the program was swapped
+        bool Update()
+        {
+            if (!pending || !buildComplete())
+                return false;
+
+            bool linked = pendingCached || finishBuild(pending, pendingKey);
+            if (!linked)
             {
-                std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+                std::cout << "ERROR::SHADER::RELOAD_FAILED: " << vertexPath << " + " << fragmentPath << ", keeping the previous program" << std::endl;
+                discardPending();
+                return false;
             }
 
-            const char* vShaderCode = vertexCode.c_str();
-            const char* fShaderCode = fragmentCode.c_str();
+            // the new program takes over the old one's name in every binding the rest of the renderer relies on
+            GLint current = 0;
+            glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+            bool inUse = (unsigned int)current == ID;
 
-            // 2. compile shaders
-            unsigned int vertex, fragment;
+            glDeleteProgram(ID);
+            ID = pending;
+            cacheKey = pendingKey;
+            pending = 0;
+            if (inUse)
+                glUseProgram(ID);
 
-            // Vertex Shader
-            vertex = glCreateShader(GL_VERTEX_SHADER);
-            glShaderSource(vertex, 1, &vShaderCode, NULL);
-            glCompileShader(vertex);
+            for (size_t i = 0; i < blockBindings.size(); i++)
+                applyUniformBlock(blockBindings[i].first, blockBindings[i].second);
+            reflectUniforms();
+            generation++;
 
-            checkCompileErrors(vertex, "VERTEX");
-
-            // Fragment Shader
-            fragment = glCreateShader(GL_FRAGMENT_SHADER);
-            glShaderSource(fragment, 1, &fShaderCode, NULL);
-            glCompileShader(fragment);
+            std::cout << "Reloaded " << vertexPath << " + " << fragmentPath << " (program " << ID << ")" << std::endl;
+            return true;
+        }
 
-            checkCompileErrors(fragment, "FRAGMENT");
+        // points a named uniform block at a binding point shared by every program (no-op if the shader doesn't declare it).
+        // remembered, so a reloaded program gets the same bindings
+        void bindUniformBlock(const std::string &name, unsigned int binding) const
+        {
+            for (size_t i = 0; i < blockBindings.size(); i++)
+                if (blockBindings[i].first == name)
+                {
+                    blockBindings[i].second = binding;
+                    applyUniformBlock(name, binding);
+                    return;
+                }
 
-            // Shader Program
-            ID = glCreateProgram();
+            blockBindings.push_back(std::make_pair(name, binding));
+            applyUniformBlock(name, binding);
+        }
 
-            glAttachShader(ID, vertex);
-            glAttachShader(ID, fragment);
-            glLinkProgram(ID);
+        // cached location of a uniform; unknown names (misspelt, or optimised out of the program) warn once and give -1
+        int uniformLocation(const UniformName &name) const
+        {
+            const UniformSlot *slot = findUniform(name);
+            return slot ? slot->location : -1;
+        }
 
-            checkCompileErrors(ID, "PROGRAM");
+        // whether the program has an active uniform of that name, without the warning; for optional names
+        bool hasUniform(const UniformName &name) const
+        {
+            return uniformSlots.find(name.hash) != uniformSlots.end();
+        }
 
-            // delete shaders; they’re linked into our program and no longer necessary
-            glDeleteShader(vertex);
-            glDeleteShader(fragment);
+        // forgets the values last set through this shader, so the next setters upload unconditionally.
+        // needed after the program's uniforms are written behind its back, e.g. by replayed command lists
+        void InvalidateUniforms() const
+        {
+            for (size_t i = 0; i < uniforms.size(); i++)
+                uniforms[i].size = 0;
+        }
 
-            // move working directory back
-            chdir("../..");
+        // number of glUniform* calls issued through any shader since the counter was last reset
+        static unsigned int &uniformCalls()
+        {
+            static unsigned int calls = 0;
+            return calls;
         }
 
-        // use/activate the shader
-        void use()
+        // number of setter calls that issued nothing, because the program already held the value
+        static unsigned int &uniformCallsSkipped()
         {
-            glUseProgram(ID);
+            static unsigned int skipped = 0;
+            return skipped;
         }
 
-        // utility uniform functions
+        // utility uniform functions; each compares against the value last uploaded and skips the GL call if it's the same
         // ------------------------------------------------------------------------
-        void setBool(const std::string &name, bool value) const
+        void setBool(const UniformName &name, bool value) const
         {         
-            glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+            setInt(name, (int)value);
         }
         // ------------------------------------------------------------------------
-        void setInt(const std::string &name, int value) const
+        void setInt(const UniformName &name, int value) const
         { 
-            glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+            int location = changedUniform(name, &value, sizeof(value));
+            if (location >= 0)
+                glUniform1i(location, value); 
         }
         // ------------------------------------------------------------------------
-        void setFloat(const std::string &name, float value) const
+        void setFloat(const UniformName &name, float value) const
         { 
-            glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+            int location = changedUniform(name, &value, sizeof(value));
+            if (location >= 0)
+                glUniform1f(location, value); 
+        }
+        // ------------------------------------------------------------------------
+        void setMat3(const UniformName &name, const glm::mat3 &value) const
+        {
+            int location = changedUniform(name, glm::value_ptr(value), sizeof(value));
+            if (location >= 0)
+                glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(value));
         }
         // ------------------------------------------------------------------------
-        void setMat4(const std::string &name, glm::mat4 value) const
+        void setMat4(const UniformName &name, const glm::mat4 &value) const
         {
-            glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+            int location = changedUniform(name, glm::value_ptr(value), sizeof(value));
+            if (location >= 0)
+                glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
         }
         // ------------------------------------------------------------------------
-        void setVec3(const std::string &name, float x, float y, float z) const
+        void setVec2(const UniformName &name, const glm::vec2 &value) const
         {
-            glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+            int location = changedUniform(name, &value[0], sizeof(value));
+            if (location >= 0)
+                glUniform2fv(location, 1, &value[0]);
         }
-        void setVec3(const std::string &name, glm::vec3 value) const
+        // ------------------------------------------------------------------------
+        void setVec3(const UniformName &name, float x, float y, float z) const
         {
-            glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+            setVec3(name, glm::vec3(x, y, z));
+        }
+        void setVec3(const UniformName &name, const glm::vec3 &value) const
+        {
+            int location = changedUniform(name, &value[0], sizeof(value));
+            if (location >= 0)
+                glUniform3fv(location, 1, &value[0]);
         }
 
     private:
+        unsigned long long cacheKey;        // of the sources the current program was built from
+        unsigned int pending;               // program being rebuilt, 0 when none
+        unsigned long long pendingKey;
+        bool pendingCached;                 // pending program came straight from the binary cache
+        bool pendingWaited;                 // pending program has had a frame to build
+        unsigned int buildVertex, buildFragment;
+        mutable std::vector<std::pair<std::string, unsigned int> > blockBindings;
+        std::vector<std::string> vertexFiles, fragmentFiles; // in source string order, for #line numbers in compiler messages
+
+        // both stages' sources with their includes expanded; false if any file is missing
+        bool readSources(std::string &vertexCode, std::string &fragmentCode)
+        {
+            std::vector<std::string> vertexUsed, fragmentUsed;
+            bool read = ShaderSources::Load(vertexPath, vertexCode, &vertexUsed);
+            read &= ShaderSources::Load(fragmentPath, fragmentCode, &fragmentUsed);
+
+            // kept even when something is missing, so fixing the file triggers a reload
+            vertexFiles.swap(vertexUsed);
+            fragmentFiles.swap(fragmentUsed);
+
+            vertexCode = injectDefines(vertexCode);
+            fragmentCode = injectDefines(fragmentCode);
+            return read;
+        }
+
+        // #version has to stay the first directive, so the defines go right after it,
+        // followed by a #line that keeps compiler messages pointing at the lines of the file
+        std::string injectDefines(const std::string &code) const
+        {
+            if (defines.empty())
+                return code;
+
+            size_t version = code.find("#version");
+            size_t insert = version == std::string::npos ? 0 : code.find('\n', version);
+            if (insert == std::string::npos)
+                insert = code.size();
+            else if (version != std::string::npos)
+                insert++;
+
+            unsigned int nextLine = 1;
+            for (size_t i = 0; i < insert; i++)
+                nextLine += code[i] == '\n';
+
+            std::string block = defines;
+            if (!block.empty() && block[block.size() - 1] != '\n')
+                block += '\n';
+            block += "#line " + std::to_string(nextLine) + " 0\n";
+            if (insert > 0 && code[insert - 1] != '\n')
+                block = "\n" + block;
+            return code.substr(0, insert) + block + code.substr(insert);
+        }
+
+        // KHR_parallel_shader_compile (or its ARB twin): the driver compiles on its own threads and says when it's done
+        static bool parallelCompile()
+        {
+            static int supported = -1;
+            if (supported < 0)
+            {
+                supported = 0;
+                if (GLAD_GL_KHR_parallel_shader_compile && glad_glMaxShaderCompilerThreadsKHR != NULL)
+                {
+                    glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+                    supported = 1;
+                }
+                else if (GLAD_GL_ARB_parallel_shader_compile && glad_glMaxShaderCompilerThreadsARB != NULL)
+                {
+                    glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+                    supported = 1;
+                }
+            }
+            return supported == 1;
+        }
+
+        // issues the compile and link without asking for any result, which is what would block
+        void startBuild(unsigned int program, const std::string &vertexCode, const std::string &fragmentCode)
+        {
+            parallelCompile();
+
+            const char* vShaderCode = vertexCode.c_str();
+            const char* fShaderCode = fragmentCode.c_str();
+
+            // Vertex Shader
+            buildVertex = glCreateShader(GL_VERTEX_SHADER);
+            glShaderSource(buildVertex, 1, &vShaderCode, NULL);
+            glCompileShader(buildVertex);
+
+            // Fragment Shader
+            buildFragment = glCreateShader(GL_FRAGMENT_SHADER);
+            glShaderSource(buildFragment, 1, &fShaderCode, NULL);
+            glCompileShader(buildFragment);
+
+            // Shader Program
+            glAttachShader(program, buildVertex);
+            glAttachShader(program, buildFragment);
+
+            ProgramCache::PrepareLink(program);
+            glLinkProgram(program);
+            pendingWaited = false;
+        }
+
+        // whether the pending program can be checked without stalling
+        bool buildComplete()
+        {
+            if (pendingCached)
+                return true;
+
+            if (parallelCompile())
+            {
+                GLint complete = 0;
+                glGetProgramiv(pending, GL_COMPLETION_STATUS_KHR, &complete);
+                return complete != 0;
+            }
+
+            // without the extension, give the driver a frame (many compile on their own threads anyway)
+            bool waited = pendingWaited;
+            pendingWaited = true;
+            return waited;
+        }
+
+        // reports compile/link errors, frees the shader objects and stores the binary for the next launch; returns whether it linked
+        bool finishBuild(unsigned int program, unsigned long long key)
+        {
+            checkCompileErrors(buildVertex, "VERTEX", &vertexFiles);
+            checkCompileErrors(buildFragment, "FRAGMENT", &fragmentFiles);
+            checkCompileErrors(program, "PROGRAM");
+
+            // delete shaders; they’re linked into our program and no longer necessary
+            glDetachShader(program, buildVertex);
+            glDetachShader(program, buildFragment);
+            glDeleteShader(buildVertex);
+            glDeleteShader(buildFragment);
+            buildVertex = buildFragment = 0;
+
+            int success;
+            glGetProgramiv(program, GL_LINK_STATUS, &success);
+            if (success)
+                ProgramCache::Save(program, key);
+            return success != 0;
+        }
+
+        void discardPending()
+        {
+            if (!pending)
+                return;
+
+            if (!pendingCached)
+            {
+                glDeleteShader(buildVertex);
+                glDeleteShader(buildFragment);
+                buildVertex = buildFragment = 0;
+            }
+            glDeleteProgram(pending);
+            pending = 0;
+        }
+
+        void applyUniformBlock(const std::string &name, unsigned int binding) const
+        {
+            unsigned int index = glGetUniformBlockIndex(ID, name.c_str());
+            if (index != GL_INVALID_INDEX)
+                glUniformBlockBinding(ID, index, binding);
+        }
+
+        // an active uniform location and a shadow of the value last uploaded to it
+        struct UniformSlot
+        {
+            int location;
+            unsigned int size;  // bytes of value that are valid, 0 until the first upload
+            float value[16];    // large enough for a mat4
+        };
+
+        std::unordered_map<unsigned int, unsigned int> uniformSlots; // name hash -> slot, for every active uniform
+        mutable std::vector<UniformSlot> uniforms; // one per location, so every name of an array element shares a shadow
+        mutable std::unordered_set<unsigned int> unknownUniforms; // names already warned about
+
+        const UniformSlot *findUniform(const UniformName &name) const
+        {
+            std::unordered_map<unsigned int, unsigned int>::const_iterator found = uniformSlots.find(name.hash);
+            if (found != uniformSlots.end())
+                return &uniforms[found->second];
+
+            if (unknownUniforms.insert(name.hash).second)
+                std::cout << "WARNING::SHADER::UNKNOWN_UNIFORM: " << name.name << " (program " << ID << ")" << std::endl;
+            return NULL;
+        }
+
+        // the location to upload a value to, or -1 if the uniform doesn't exist or already holds exactly this value
+        int changedUniform(const UniformName &name, const void *value, unsigned int size) const
+        {
+            UniformSlot *slot = const_cast<UniformSlot*>(findUniform(name));
+            if (!slot)
+                return -1;
+            if (slot->size == size && memcmp(slot->value, value, size) == 0)
+            {
+                uniformCallsSkipped()++;
+                return -1;
+            }
+
+            memcpy(slot->value, value, size);
+            slot->size = size;
+            uniformCalls()++;
+            return slot->location;
+        }
+
+        // enumerates the active uniforms once after linking, so the setters never ask the driver for locations
+        void reflectUniforms()
+        {
+            // a relinked program starts over from its default values
+            uniformSlots.clear();
+            uniforms.clear();
+            unknownUniforms.clear();
+
+            GLint count = 0, maxLength = 0;
+            glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+            glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+            std::vector<char> buffer(maxLength > 0 ? maxLength : 1);
+
+            for (GLint i = 0; i < count; i++)
+            {
+                GLsizei length = 0;
+                GLint size = 0;
+                GLenum type;
+                glGetActiveUniform(ID, i, (GLsizei)buffer.size(), &length, &size, &type, &buffer[0]);
+                std::string name(&buffer[0], length);
+
+                // members of uniform blocks have no location of their own
+                GLint location = glGetUniformLocation(ID, name.c_str());
+                if (location < 0)
+                    continue;
+
+                addUniform(name, location);
+
+                // arrays are reported as "name[0]"; the bare name and every other element resolve as well
+                if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+                {
+                    std::string base = name.substr(0, name.size() - 3);
+                    addUniform(base, location);
+                    for (GLint element = 1; element < size; element++)
+                    {
+                        std::string elementName = base + "[" + std::to_string(element) + "]";
+                        addUniform(elementName, glGetUniformLocation(ID, elementName.c_str()));
+                    }
+                }
+            }
+        }
+
+        void addUniform(const std::string &name, GLint location)
+        {
+            unsigned int slot = 0;
+            while (slot < uniforms.size() && uniforms[slot].location != location)
+                slot++;
+            if (slot == uniforms.size())
+            {
+                UniformSlot added;
+                added.location = location;
+                added.size = 0;
+                uniforms.push_back(added);
+            }
+
+            std::pair<std::unordered_map<unsigned int, unsigned int>::iterator, bool> added = uniformSlots.insert(std::make_pair(HashUniformName(name.c_str()), slot));
+            if (!added.second && uniforms[added.first->second].location != location)
+                std::cout << "ERROR::SHADER::UNIFORM_HASH_COLLISION: " << name << " (program " << ID << ")" << std::endl;
+        }
+
         // utility function for checking shader compilation/linking errors.
-        void checkCompileErrors(unsigned int shader, std::string type)
+        void checkCompileErrors(unsigned int shader, std::string type, const std::vector<std::string> *files = NULL)
         {
             int success;
             char infoLog[1024];
@@ -140,7 +551,11 @@ class Shader
                 if (!success)
                 {
                     glGetShaderInfoLog(shader, 1024, NULL, infoLog);
-                    std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+                    std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n";
+                    // messages are "source:line", numbered in include order
+                    for (size_t i = 0; files && i < files->size(); i++)
+                        std::cout << "source " << i << ": " << (*files)[i] << "\n";
+                    std::cout << " -- --------------------------------------------------- -- " << std::endl;
                 }
             }
             else
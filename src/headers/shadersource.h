@@ -0,0 +1,175 @@
+#ifndef SHADERSOURCE_H
+#define SHADERSOURCE_H
+
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef SHADERS_EMBEDDED
+#include <embeddedshaders.h> // generated by cmake/EmbedShaders.cmake
+#endif
+
+// where shader sources come from. files are read once and kept in memory, from the shader directory or,
+// in builds with RENDERER_EMBED_SHADERS, from the copies compiled into the executable, so startup does no
+// shader file I/O. `#include "file"` lines are expanded (each file at most once per stage) with #line
+// directives numbering every file as its own source string, so compiler messages read "file:line".
+// everything is behind a mutex and nothing depends on the working directory changing, so any thread can load.
+class ShaderSources
+{
+    public:
+        // CMake builds point this at the source tree; otherwise it is relative to the repository root
+        static std::string &directory()
+        {
+#ifdef SHADER_SOURCE_DIR
+            static std::string path = SHADER_SOURCE_DIR;
+#else
+            static std::string path = "src/shaders";
+#endif
+            return path;
+        }
+
+        static bool Embedded()
+        {
+#ifdef SHADERS_EMBEDDED
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        // a shader's source with its includes expanded; false if it or one of its includes is missing.
+        // files receives every file that went into it, the shader itself first, in source string order
+        static bool Load(const std::string &name, std::string &source, std::vector<std::string> *files = NULL)
+        {
+            std::vector<std::string> used;
+            source.clear();
+            return expand(name, source, files ? *files : used);
+        }
+
+        // forgets a file, so the next Load reads it from the shader directory again (an edit, for hot reload).
+        // embedded builds switch to the file on disk from then on
+        static void Invalidate(const std::string &name)
+        {
+            std::lock_guard<std::mutex> lock(cache().mutex);
+            cache().files.erase(name);
+            cache().edited[name] = true;
+        }
+
+    private:
+        struct Cache
+        {
+            std::mutex mutex;
+            std::unordered_map<std::string, std::string> files;
+            std::unordered_map<std::string, bool> edited; // invalidated at least once
+        };
+
+        static Cache &cache()
+        {
+            static Cache instance;
+            return instance;
+        }
+
+        // the raw contents of one file, from memory after the first time
+        static bool file(const std::string &name, std::string &text)
+        {
+            std::lock_guard<std::mutex> lock(cache().mutex);
+            std::unordered_map<std::string, std::string>::iterator found = cache().files.find(name);
+            if (found != cache().files.end())
+            {
+                text = found->second;
+                return true;
+            }
+
+            bool read = false;
+#ifdef SHADERS_EMBEDDED
+            if (!cache().edited[name])
+            {
+                for (unsigned int i = 0; i < EMBEDDED_SHADER_COUNT && !read; i++)
+                    if (name == EMBEDDED_SHADERS[i].name)
+                    {
+                        text.assign(EMBEDDED_SHADERS[i].data, EMBEDDED_SHADERS[i].size);
+                        read = true;
+                    }
+            }
+#endif
+            if (!read)
+            {
+                std::ifstream stream((directory() + "/" + name).c_str(), std::ios::in | std::ios::binary);
+                if (!stream)
+                    return false;
+
+                std::stringstream contents;
+                contents << stream.rdbuf();
+                text = contents.str();
+            }
+
+            cache().files[name] = text;
+            return true;
+        }
+
+        static bool expand(const std::string &name, std::string &source, std::vector<std::string> &files)
+        {
+            std::string text;
+            if (!file(name, text))
+            {
+                std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << name << std::endl;
+                return false;
+            }
+
+            unsigned int index = files.size();
+            files.push_back(name);
+
+            bool complete = true;
+            std::istringstream lines(text);
+            std::string line;
+            for (unsigned int number = 1; std::getline(lines, line); number++)
+            {
+                std::string include;
+                if (!parseInclude(line, include))
+                {
+                    source += line;
+                    if (!lines.eof())
+                        source += '\n';
+                    continue;
+                }
+
+                // already part of this stage: #pragma once semantics
+                bool seen = false;
+                for (unsigned int i = 0; i < files.size(); i++)
+                    seen |= files[i] == include;
+
+                if (!seen)
+                {
+                    source += "#line 1 " + std::to_string(files.size()) + "\n";
+                    complete &= expand(include, source, files);
+                    source += "\n";
+                }
+                source += "#line " + std::to_string(number + 1) + " " + std::to_string(index) + "\n";
+            }
+            return complete;
+        }
+
+        // `#include "name"` (or <name>), with any whitespace around the tokens
+        static bool parseInclude(const std::string &line, std::string &name)
+        {
+            size_t start = line.find_first_not_of(" \t");
+            if (start == std::string::npos || line.compare(start, 8, "#include") != 0)
+                return false;
+
+            size_t open = line.find_first_of("\"<", start + 8);
+            if (open == std::string::npos)
+                return false;
+
+            size_t close = line.find(line[open] == '"' ? '"' : '>', open + 1);
+            if (close == std::string::npos)
+                return false;
+
+            name = line.substr(open + 1, close - open - 1);
+            return true;
+        }
+};
+#endif
@@ -0,0 +1,99 @@
+#ifndef SHADERVARIANTS_H
+#define SHADERVARIANTS_H
+
+#include <shader.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// a set of preprocessor defines selecting a shader permutation. kept sorted by name,
+// so the same set gives the same source (and the same key) whatever order it was built in
+class ShaderDefines
+{
+    public:
+        ShaderDefines &Set(const string &name, const string &value = "")
+        {
+            values[name] = value;
+            return *this;
+        }
+
+        ShaderDefines &Set(const string &name, int value)
+        {
+            return Set(name, to_string(value));
+        }
+
+        ShaderDefines &Unset(const string &name)
+        {
+            values.erase(name);
+            return *this;
+        }
+
+        bool IsSet(const string &name) const
+        {
+            return values.find(name) != values.end();
+        }
+
+        // the "#define NAME VALUE" lines handed to Shader
+        string Source() const
+        {
+            string source;
+            for(map<string, string>::const_iterator it = values.begin(); it != values.end(); ++it)
+                source += "#define " + it->first + (it->second.empty() ? "" : " " + it->second) + "\n";
+            return source;
+        }
+
+    private:
+        map<string, string> values;
+};
+
+// every permutation of one vertex/fragment pair. a permutation is compiled the first time it is asked for
+// (and comes from the program binary cache after that), so only the feature combinations something
+// actually draws with are ever built.
+class ShaderVariants
+{
+    public:
+        string vertexPath, fragmentPath;
+
+        ShaderVariants(const char *vertexPath, const char *fragmentPath) : vertexPath(vertexPath), fragmentPath(fragmentPath) {}
+
+        // applies to every permutation, including those built later
+        void bindUniformBlock(const string &name, unsigned int binding)
+        {
+            blockBindings.push_back(make_pair(name, binding));
+            for(unsigned int i = 0; i < built.size(); i++)
+                built[i]->bindUniformBlock(name, binding);
+        }
+
+        // the permutation for a set of defines, compiled on first use; the reference stays valid for the lifetime of the set
+        Shader &Get(const ShaderDefines &defines)
+        {
+            string key = defines.Source();
+            map<string, unique_ptr<Shader> >::iterator found = variants.find(key);
+            if(found != variants.end())
+                return *found->second;
+
+            Shader *shader = new Shader(vertexPath.c_str(), fragmentPath.c_str(), key);
+            for(unsigned int i = 0; i < blockBindings.size(); i++)
+                shader->bindUniformBlock(blockBindings[i].first, blockBindings[i].second);
+
+            variants[key].reset(shader);
+            built.push_back(shader);
+            return *shader;
+        }
+
+        // permutations built so far, in the order they were first asked for
+        const vector<Shader*> &Built() const
+        {
+            return built;
+        }
+
+    private:
+        map<string, unique_ptr<Shader> > variants; // keyed by the defines' source
+        vector<Shader*> built;
+        vector<pair<string, unsigned int> > blockBindings;
+};
+#endif
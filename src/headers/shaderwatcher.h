@@ -0,0 +1,188 @@
+#ifndef SHADERWATCHER_H
+#define SHADERWATCHER_H
+
+#include <shader.h>
+#include <shadervariants.h>
+
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// hot reload: watches the shader directory and rebuilds the programs whose files change.
+// on linux an inotify descriptor is drained without blocking once a frame; elsewhere (or if inotify is
+// unavailable) the watched files' modification times are polled a few times a second instead.
+// rebuilds don't stall the frame (see Shader::Reload) and a program that fails to link leaves the old one in place.
+class ShaderWatcher
+{
+    public:
+        float pollInterval; // seconds between stat sweeps when falling back to polling
+
+        ShaderWatcher(const string &directory = ShaderSources::directory()) : pollInterval(0.5f), directory(directory), descriptor(-1), sinceSweep(0.0f)
+        {
+#ifdef __linux__
+            descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            // editors save in place or write a temporary file and rename it over the original
+            if(descriptor >= 0 && inotify_add_watch(descriptor, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+            {
+                close(descriptor);
+                descriptor = -1;
+            }
+#endif
+        }
+
+        ~ShaderWatcher()
+        {
+#ifdef __linux__
+            if(descriptor >= 0)
+                close(descriptor);
+#endif
+        }
+
+        // true when changes are pushed by inotify rather than found by polling
+        bool Notified() const { return descriptor >= 0; }
+
+        void Add(Shader &shader)
+        {
+            shaders.push_back(&shader);
+            watchFiles(shader);
+        }
+
+        // every permutation of the set, including those first built after this call
+        void Add(ShaderVariants &variants)
+        {
+            variantSets.push_back(&variants);
+            watchFile(variants.vertexPath);
+            watchFile(variants.fragmentPath);
+        }
+
+        // starts rebuilding shaders whose files changed and swaps in those that finished; returns true if any was swapped
+        bool Update(float deltaTime)
+        {
+            vector<string> changed;
+            if(Notified())
+                drainEvents(changed);
+            else
+            {
+                sinceSweep += deltaTime;
+                if(sinceSweep >= pollInterval)
+                {
+                    sinceSweep = 0.0f;
+                    sweep(changed);
+                }
+            }
+
+            vector<Shader*> watched = shaders;
+            for(unsigned int i = 0; i < variantSets.size(); i++)
+                watched.insert(watched.end(), variantSets[i]->Built().begin(), variantSets[i]->Built().end());
+
+            // edited files are read again, by every program that uses them
+            for(unsigned int i = 0; i < changed.size(); i++)
+                ShaderSources::Invalidate(changed[i]);
+
+            for(unsigned int i = 0; i < changed.size(); i++)
+                for(unsigned int j = 0; j < watched.size(); j++)
+                    if(watched[j]->UsesFile(changed[i]))
+                        watched[j]->Reload();
+
+            bool swapped = false;
+            for(unsigned int i = 0; i < watched.size(); i++)
+                swapped |= watched[i]->Update();
+
+            // includes can change with any rebuild, and permutations appear as they are first used
+            if(!Notified())
+                for(unsigned int i = 0; i < watched.size(); i++)
+                    watchFiles(*watched[i]);
+            return swapped;
+        }
+
+    private:
+        struct File
+        {
+            string name;
+            long long modified;
+        };
+
+        string directory;
+        int descriptor;
+        float sinceSweep;
+        vector<Shader*> shaders;
+        vector<ShaderVariants*> variantSets;
+        vector<File> files;
+
+        void watchFiles(const Shader &shader)
+        {
+            vector<string> used = shader.SourceFiles();
+            for(unsigned int i = 0; i < used.size(); i++)
+                watchFile(used[i]);
+        }
+
+        void watchFile(const string &name)
+        {
+            for(unsigned int i = 0; i < files.size(); i++)
+                if(files[i].name == name)
+                    return;
+
+            File file;
+            file.name = name;
+            file.modified = modifiedTime(name);
+            files.push_back(file);
+        }
+
+        long long modifiedTime(const string &name) const
+        {
+            struct stat info;
+            if(stat((directory + "/" + name).c_str(), &info) != 0)
+                return 0;
+            return (long long)info.st_mtime;
+        }
+
+        void sweep(vector<string> &changed)
+        {
+            for(unsigned int i = 0; i < files.size(); i++)
+            {
+                long long modified = modifiedTime(files[i].name);
+                if(modified != 0 && modified != files[i].modified)
+                {
+                    files[i].modified = modified;
+                    changed.push_back(files[i].name);
+                }
+            }
+        }
+
+        void drainEvents(vector<string> &changed)
+        {
+#ifdef __linux__
+            char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+            for(;;)
+            {
+                ssize_t length = read(descriptor, buffer, sizeof(buffer));
+                if(length <= 0)
+                    break;
+
+                for(char *p = buffer; p < buffer + length; )
+                {
+                    const struct inotify_event *event = (const struct inotify_event*)p;
+                    if(event->len > 0)
+                    {
+                        string name(event->name);
+                        bool seen = false;
+                        for(unsigned int i = 0; i < changed.size(); i++)
+                            seen |= changed[i] == name;
+                        if(!seen)
+                            changed.push_back(name);
+                    }
+                    p += sizeof(struct inotify_event) + event->len;
+                }
+            }
+#else
+            (void)changed;
+#endif
+        }
+};
+#endif
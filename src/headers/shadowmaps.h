@@ -0,0 +1,343 @@
+#ifndef SHADOWMAPS_H
+#define SHADOWMAPS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <shader.h>
+#include <model.h>
+#include <frustum.h>
+#include <uniformblocks.h>
+#include <profiler.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+// cascaded shadow maps for the directional light, one layer of a depth texture array per cascade.
+// the view up to shadowDistance is split into MAX_SHADOW_CASCADES depth ranges; each cascade is fitted to a
+// sphere around its range, so its size never changes as the camera turns, and its origin is snapped to whole
+// shadow map texels, so the edges of shadows don't shimmer as the camera moves.
+// the scene is static, so a cascade is fitted with some room to spare and its map is kept until the camera
+// leaves that room, the light turns, or Invalidate says something inside it changed; only then is it fitted
+// again, culled against its own frustum and redrawn.
+class ShadowMaps
+{
+    public:
+        static const unsigned int CASCADES = MAX_SHADOW_CASCADES;
+        static const unsigned int UNIT = 9; // texture unit of the shadow map array
+        static const unsigned int TIMER_QUERIES = 3; // frames a GPU time may take to arrive
+
+        unsigned int resolution;
+        float shadowDistance; // view depth the last cascade ends at
+        float splitBlend;     // cascade splits from uniform (0) to logarithmic (1)
+        float hysteresis;     // extra radius a cascade is fitted with, as a fraction, so small moves keep it
+        bool caching;         // off: every cascade is redrawn every frame
+
+        ShadowsBlock block; // cascade transforms and splits for the shaders, copied into FrameUniforms::shadows
+
+        // per cascade, accumulated until the caller resets them
+        struct CascadeStats
+        {
+            unsigned int renders;   // frames it was redrawn
+            unsigned int casters;   // meshes drawn into it
+            double cpuMilliseconds; // culling and submitting its draws
+            double gpuMilliseconds; // drawing, for the renders whose timer results have arrived
+            unsigned int timed;     // renders gpuMilliseconds covers
+        };
+        CascadeStats stats[CASCADES];
+
+        ShadowMaps(unsigned int resolution = 2048) : resolution(resolution), shadowDistance(30.0f), splitBlend(0.75f), hysteresis(0.2f),
+                                                    caching(true), shadowShader("shadow.vs", "depth.fs"), lightDirection(0.0f)
+        {
+            memset(&block, 0, sizeof(block));
+            ResetStats();
+
+            glGenTextures(1, &depthArray);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, depthArray);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution, CASCADES, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+
+            // hardware compared and bilinearly filtered; outside the map counts as lit
+            float border[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+            glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+            glGenFramebuffers(1, &FBO);
+            glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+            for(unsigned int c = 0; c < CASCADES; c++)
+            {
+                Cascade &cascade = cascades[c];
+                cascade.fitted = false;
+                cascade.dirty = true;
+                glGenQueries(TIMER_QUERIES, cascade.queries);
+                for(unsigned int q = 0; q < TIMER_QUERIES; q++)
+                    cascade.pending[q] = false;
+                cascade.frame = 0;
+            }
+        }
+
+        // every cascade is redrawn next frame
+        void Invalidate()
+        {
+            for(unsigned int c = 0; c < CASCADES; c++)
+                cascades[c].dirty = true;
+        }
+
+        // something in these world bounds moved or changed: the cascades whose maps cover it are redrawn
+        void Invalidate(const AABB &bounds)
+        {
+            for(unsigned int c = 0; c < CASCADES; c++)
+                if(cascades[c].fitted && cascades[c].frustum.IntersectsAABB(bounds.center(), bounds.extent()))
+                    cascades[c].dirty = true;
+        }
+
+        // fits the cascades to the camera and decides which need redrawing; fills block.
+        // sceneBounds must enclose every shadow caster, it sets the depth range along the light
+        void Update(const glm::mat4 &projection, const glm::mat4 &view, float zNear, const glm::vec3 &direction, const AABB &sceneBounds)
+        {
+            PROFILE_ZONE("ShadowMaps::Update");
+            glm::vec3 towards = glm::normalize(direction);
+            if(glm::dot(towards, lightDirection) < 0.99999f)
+            {
+                lightDirection = towards;
+                Invalidate();
+            }
+
+            // practical split scheme: a blend of logarithmic (even resolution per depth) and uniform splits
+            float splits[CASCADES + 1];
+            splits[0] = zNear;
+            for(unsigned int c = 1; c <= CASCADES; c++)
+            {
+                float fraction = (float)c / CASCADES;
+                float logarithmic = zNear * powf(shadowDistance / zNear, fraction);
+                float uniform = zNear + (shadowDistance - zNear) * fraction;
+                splits[c] = splitBlend * logarithmic + (1.0f - splitBlend) * uniform;
+            }
+
+            glm::mat4 inverseProjection = glm::inverse(projection);
+            glm::mat4 inverseView = glm::inverse(view);
+
+            for(unsigned int c = 0; c < CASCADES; c++)
+            {
+                Cascade &cascade = cascades[c];
+
+                // bounding sphere of the slice of the view frustum between the two splits
+                glm::vec3 corners[8];
+                glm::vec3 center(0.0f);
+                for(unsigned int i = 0; i < 8; i++)
+                {
+                    glm::vec4 ray = inverseProjection * glm::vec4((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, 1.0f, 1.0f);
+                    glm::vec3 direction = glm::vec3(ray) / ray.w;
+                    float depth = (i & 4) ? splits[c + 1] : splits[c];
+                    corners[i] = glm::vec3(inverseView * glm::vec4(direction * (depth / -direction.z), 1.0f));
+                    center += corners[i] / 8.0f;
+                }
+
+                float radius = 0.0f;
+                for(unsigned int i = 0; i < 8; i++)
+                    radius = max(radius, glm::length(corners[i] - center));
+                radius = ceilf(radius * 16.0f) / 16.0f; // rounded up, so tiny changes don't resize it
+
+                // kept while the slice stays inside it and it isn't needlessly large (a zoomed in camera)
+                bool contains = cascade.fitted && glm::length(center - cascade.center) + radius <= cascade.radius;
+                bool tooLarge = cascade.radius > radius * (1.0f + 2.0f * hysteresis);
+                if(caching && contains && !tooLarge && !cascade.dirty)
+                {
+                    cascade.render = false;
+                    continue;
+                }
+
+                fit(cascade, center, radius * (1.0f + hysteresis), sceneBounds);
+                cascade.render = true;
+                cascade.dirty = false;
+            }
+
+            for(unsigned int c = 0; c < CASCADES; c++)
+            {
+                // from world space to [0, 1] shadow map coordinates and depth
+                glm::mat4 toTexture = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.5f));
+                block.cascades[c] = toTexture * cascades[c].viewProjection;
+                block.splits[c] = splits[c + 1];
+
+                // lookups are pushed out along the normal by about a texel and a half of the cascade, against acne
+                block.normalOffsets[c] = 1.5f * 2.0f * cascades[c].radius / resolution;
+            }
+        }
+
+        // draws the cascades Update chose, with their own frustum culling of the model's world space mesh
+        // bounds, then binds the map to UNIT. leaves the default framebuffer bound and the viewport as it was
+        void Render(Model &model, const glm::mat4 &transform, const AABBSoA &bounds)
+        {
+            PROFILE_GPU_ZONE("ShadowMaps::Render");
+            // depth needs filled triangles, whatever the polygon mode of the scene
+            GLint viewport[4], polygonMode[2];
+            glGetIntegerv(GL_VIEWPORT, viewport);
+            glGetIntegerv(GL_POLYGON_MODE, polygonMode);
+
+            bool begun = false;
+            for(unsigned int c = 0; c < CASCADES; c++)
+            {
+                Cascade &cascade = cascades[c];
+                collect(c);
+                if(!cascade.render)
+                    continue;
+
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+                if(!begun)
+                {
+                    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+                    glViewport(0, 0, resolution, resolution);
+                    glEnable(GL_DEPTH_CLAMP); // casters in front of the near plane still land at depth 0
+                    glEnable(GL_POLYGON_OFFSET_FILL);
+                    glPolygonOffset(2.0f, 4.0f);
+                    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+                    shadowShader.use();
+                    begun = true;
+                }
+
+                // a layer of the array per cascade
+                glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthArray, 0, c);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                shadowShader.setMat4("modelViewProjection", cascade.viewProjection * transform);
+
+                unsigned int slot = cascade.frame % TIMER_QUERIES;
+                bool timing = !cascade.pending[slot];
+                if(timing)
+                    glBeginQuery(GL_TIME_ELAPSED, cascade.queries[slot]);
+
+                unsigned int casters = CullAABBs(CullParams(cascade.projection, cascade.view), bounds, visible);
+                for(unsigned int i = 0; i < model.meshes.size(); i++)
+                    if(i >= visible.size() || visible[i])
+                        model.meshes[i].DrawDepth();
+
+                if(timing)
+                {
+                    glEndQuery(GL_TIME_ELAPSED);
+                    cascade.pending[slot] = true;
+                }
+                cascade.frame++;
+
+                stats[c].renders++;
+                stats[c].casters += casters;
+                stats[c].cpuMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            }
+
+            if(begun)
+            {
+                glPolygonOffset(0.0f, 0.0f);
+                glDisable(GL_POLYGON_OFFSET_FILL);
+                glDisable(GL_DEPTH_CLAMP);
+                glPolygonMode(GL_FRONT_AND_BACK, polygonMode[0]);
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+            }
+
+            glActiveTexture(GL_TEXTURE0 + UNIT);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, depthArray);
+            glActiveTexture(GL_TEXTURE0);
+        }
+
+        // points a SHADOWS program's sampler at the map; the program must be in use
+        void Bind(const Shader &shader) const
+        {
+            shader.setInt("shadowMap", UNIT);
+        }
+
+        void ResetStats()
+        {
+            memset(stats, 0, sizeof(stats));
+        }
+
+    private:
+        struct Cascade
+        {
+            bool fitted, dirty, render;
+            glm::vec3 center; // of the sphere the map covers
+            float radius;
+            glm::mat4 view, projection, viewProjection;
+            Frustum frustum;
+
+            unsigned int queries[TIMER_QUERIES];
+            bool pending[TIMER_QUERIES];
+            unsigned long long frame; // renders, selecting the query slot
+        };
+
+        Cascade cascades[CASCADES];
+        unsigned int depthArray, FBO;
+        Shader shadowShader;
+        glm::vec3 lightDirection;
+        vector<unsigned char> visible;
+
+        // an orthographic light view over the sphere, its origin snapped to whole texels in the light's plane
+        void fit(Cascade &cascade, const glm::vec3 &center, float radius, const AABB &sceneBounds)
+        {
+            glm::vec3 up = fabsf(lightDirection.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+            glm::mat4 rotation = glm::lookAt(glm::vec3(0.0f), lightDirection, up);
+
+            float texel = 2.0f * radius / resolution;
+            glm::vec3 origin = glm::vec3(rotation * glm::vec4(center, 1.0f));
+            origin.x = floorf(origin.x / texel) * texel;
+            origin.y = floorf(origin.y / texel) * texel;
+            glm::vec3 snapped = glm::vec3(glm::inverse(rotation) * glm::vec4(origin, 1.0f));
+
+            cascade.view = glm::lookAt(snapped, snapped + lightDirection, up);
+
+            // depth range: everything in the scene along the light, so casters outside the sphere still cast
+            float nearest = -radius, farthest = radius;
+            for(unsigned int i = 0; i < 8; i++)
+            {
+                glm::vec3 corner((i & 1) ? sceneBounds.max.x : sceneBounds.min.x, (i & 2) ? sceneBounds.max.y : sceneBounds.min.y,
+                                 (i & 4) ? sceneBounds.max.z : sceneBounds.min.z);
+                float depth = -(cascade.view * glm::vec4(corner, 1.0f)).z;
+                nearest = min(nearest, depth);
+                farthest = max(farthest, depth);
+            }
+
+            cascade.projection = glm::ortho(-radius, radius, -radius, radius, nearest, farthest);
+            cascade.viewProjection = cascade.projection * cascade.view;
+            cascade.frustum = Frustum(cascade.viewProjection);
+            cascade.center = center;
+            cascade.radius = radius;
+            cascade.fitted = true;
+        }
+
+        // the GPU time of the cascade's oldest render still in flight, if it has arrived
+        void collect(unsigned int c)
+        {
+            Cascade &cascade = cascades[c];
+            for(unsigned int q = 0; q < TIMER_QUERIES; q++)
+            {
+                if(!cascade.pending[q])
+                    continue;
+
+                GLuint available = 0;
+                glGetQueryObjectuiv(cascade.queries[q], GL_QUERY_RESULT_AVAILABLE, &available);
+                if(!available)
+                    continue;
+
+                GLuint64 nanoseconds = 0;
+                glGetQueryObjectui64v(cascade.queries[q], GL_QUERY_RESULT, &nanoseconds);
+                cascade.pending[q] = false;
+                stats[c].gpuMilliseconds += nanoseconds / 1e6;
+                stats[c].timed++;
+            }
+        }
+};
+#endif
@@ -0,0 +1,204 @@
+#ifndef TRANSFORMS_H
+#define TRANSFORMS_H
+
+#include <glm/glm.hpp>
+
+#include <frustum.h> // FRUSTUM_SSE / FRUSTUM_AVX and their intrinsics headers
+#include <shader.h>
+#include <profiler.h>
+
+#include <vector>
+
+using namespace std;
+
+// the matrices an object's vertices are transformed by, computed on the CPU once per object per frame so
+// the vertex shaders do one matrix multiply per position and no per-vertex matrix inverse
+struct ObjectTransform
+{
+    glm::mat4 modelViewProjection;
+    glm::mat4 model;
+    glm::mat4 normal; // inverse transpose of the model's upper 3x3, in the upper 3x3 (columns 16 byte aligned for SIMD stores)
+};
+
+// the normal matrix from the cofactors: the columns of inverse(M)^T are the cross products of M's columns
+// over its determinant. model matrices must be invertible
+inline unsigned int ComputeTransformsScalar(const glm::mat4 &viewProjection, const glm::mat4 *models, unsigned int count, ObjectTransform *transforms)
+{
+    for(unsigned int i = 0; i < count; i++)
+    {
+        const glm::mat4 &model = models[i];
+        ObjectTransform &transform = transforms[i];
+
+        transform.modelViewProjection = viewProjection * model;
+        transform.model = model;
+
+        glm::vec3 c0(model[0]), c1(model[1]), c2(model[2]);
+        glm::vec3 r0 = glm::cross(c1, c2), r1 = glm::cross(c2, c0), r2 = glm::cross(c0, c1);
+        float inverseDeterminant = 1.0f / glm::dot(c0, r0);
+        transform.normal = glm::mat4(glm::vec4(r0 * inverseDeterminant, 0.0f), glm::vec4(r1 * inverseDeterminant, 0.0f),
+                                     glm::vec4(r2 * inverseDeterminant, 0.0f), glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    }
+    return count;
+}
+
+#ifdef FRUSTUM_SSE
+// a x b of the xyz lanes, w stays 0
+inline __m128 crossSSE(__m128 a, __m128 b)
+{
+    __m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 zxy = _mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));
+    return _mm_shuffle_ps(zxy, zxy, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+// the sum of all four lanes, in every lane
+inline __m128 sumSSE(__m128 v)
+{
+    v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+// one object at a time, a column per register: every column of the product is the view projection's
+// columns weighted by the model column's broadcast components
+inline unsigned int ComputeTransformsSSE(const glm::mat4 &viewProjection, const glm::mat4 *models, unsigned int count, ObjectTransform *transforms)
+{
+    __m128 v0 = _mm_loadu_ps(&viewProjection[0][0]), v1 = _mm_loadu_ps(&viewProjection[1][0]);
+    __m128 v2 = _mm_loadu_ps(&viewProjection[2][0]), v3 = _mm_loadu_ps(&viewProjection[3][0]);
+    __m128 lastColumn = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+
+    for(unsigned int i = 0; i < count; i++)
+    {
+        const float *model = &models[i][0][0];
+        ObjectTransform &transform = transforms[i];
+
+        __m128 columns[4];
+        for(int c = 0; c < 4; c++)
+        {
+            columns[c] = _mm_loadu_ps(model + 4 * c);
+            __m128 x = _mm_shuffle_ps(columns[c], columns[c], _MM_SHUFFLE(0, 0, 0, 0));
+            __m128 y = _mm_shuffle_ps(columns[c], columns[c], _MM_SHUFFLE(1, 1, 1, 1));
+            __m128 z = _mm_shuffle_ps(columns[c], columns[c], _MM_SHUFFLE(2, 2, 2, 2));
+            __m128 w = _mm_shuffle_ps(columns[c], columns[c], _MM_SHUFFLE(3, 3, 3, 3));
+            __m128 product = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v0, x), _mm_mul_ps(v1, y)), _mm_add_ps(_mm_mul_ps(v2, z), _mm_mul_ps(v3, w)));
+            _mm_storeu_ps(&transform.modelViewProjection[c][0], product);
+            _mm_storeu_ps(&transform.model[c][0], columns[c]);
+        }
+
+        // w of the first three columns is 0 for any affine model matrix; masked anyway so it can't leak in
+        __m128 xyz = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+        __m128 c0 = _mm_and_ps(columns[0], xyz), c1 = _mm_and_ps(columns[1], xyz), c2 = _mm_and_ps(columns[2], xyz);
+        __m128 r0 = crossSSE(c1, c2), r1 = crossSSE(c2, c0), r2 = crossSSE(c0, c1);
+        __m128 inverseDeterminant = _mm_div_ps(_mm_set1_ps(1.0f), sumSSE(_mm_mul_ps(c0, r0)));
+        _mm_storeu_ps(&transform.normal[0][0], _mm_mul_ps(r0, inverseDeterminant));
+        _mm_storeu_ps(&transform.normal[1][0], _mm_mul_ps(r1, inverseDeterminant));
+        _mm_storeu_ps(&transform.normal[2][0], _mm_mul_ps(r2, inverseDeterminant));
+        _mm_storeu_ps(&transform.normal[3][0], lastColumn);
+    }
+    return count;
+}
+#endif
+
+#ifdef FRUSTUM_AVX
+// crossSSE in both 128 bit halves
+inline __m256 crossAVX(__m256 a, __m256 b)
+{
+    __m256 aYZX = _mm256_permute_ps(a, _MM_SHUFFLE(3, 0, 2, 1));
+    __m256 bYZX = _mm256_permute_ps(b, _MM_SHUFFLE(3, 0, 2, 1));
+    __m256 zxy = _mm256_sub_ps(_mm256_mul_ps(a, bYZX), _mm256_mul_ps(aYZX, b));
+    return _mm256_permute_ps(zxy, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+inline __m256 sumAVX(__m256 v)
+{
+    v = _mm256_add_ps(v, _mm256_permute_ps(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm256_add_ps(v, _mm256_permute_ps(v, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+// two columns per register, so a product takes two passes instead of four, and the normal matrices of two
+// objects side by side, one per 128 bit half. an odd object left over goes through the SSE kernel
+inline unsigned int ComputeTransformsAVX(const glm::mat4 &viewProjection, const glm::mat4 *models, unsigned int count, ObjectTransform *transforms)
+{
+    __m256 v0 = _mm256_broadcast_ps((const __m128*)&viewProjection[0][0]), v1 = _mm256_broadcast_ps((const __m128*)&viewProjection[1][0]);
+    __m256 v2 = _mm256_broadcast_ps((const __m128*)&viewProjection[2][0]), v3 = _mm256_broadcast_ps((const __m128*)&viewProjection[3][0]);
+    __m256 xyz = _mm256_castsi256_ps(_mm256_set_epi32(0, -1, -1, -1, 0, -1, -1, -1));
+    __m128 lastColumn = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+
+    unsigned int pairs = count & ~1u;
+    for(unsigned int i = 0; i < pairs; i += 2)
+    {
+        __m256 columns[2][2]; // per object, columns 0-1 and 2-3
+        for(int o = 0; o < 2; o++)
+        {
+            const float *model = &models[i + o][0][0];
+            ObjectTransform &transform = transforms[i + o];
+            for(int half = 0; half < 2; half++)
+            {
+                __m256 pair = _mm256_loadu_ps(model + 8 * half);
+                __m256 x = _mm256_permute_ps(pair, _MM_SHUFFLE(0, 0, 0, 0));
+                __m256 y = _mm256_permute_ps(pair, _MM_SHUFFLE(1, 1, 1, 1));
+                __m256 z = _mm256_permute_ps(pair, _MM_SHUFFLE(2, 2, 2, 2));
+                __m256 w = _mm256_permute_ps(pair, _MM_SHUFFLE(3, 3, 3, 3));
+                __m256 product = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(v0, x), _mm256_mul_ps(v1, y)), _mm256_add_ps(_mm256_mul_ps(v2, z), _mm256_mul_ps(v3, w)));
+                _mm256_storeu_ps(&transform.modelViewProjection[2 * half][0], product);
+                _mm256_storeu_ps(&transform.model[2 * half][0], pair);
+                columns[o][half] = pair;
+            }
+        }
+
+        // column k of both objects in one register: the first object low, the second high
+        __m256 c0 = _mm256_and_ps(_mm256_permute2f128_ps(columns[0][0], columns[1][0], 0x20), xyz);
+        __m256 c1 = _mm256_and_ps(_mm256_permute2f128_ps(columns[0][0], columns[1][0], 0x31), xyz);
+        __m256 c2 = _mm256_and_ps(_mm256_permute2f128_ps(columns[0][1], columns[1][1], 0x20), xyz);
+
+        __m256 r0 = crossAVX(c1, c2), r1 = crossAVX(c2, c0), r2 = crossAVX(c0, c1);
+        __m256 inverseDeterminant = _mm256_div_ps(_mm256_set1_ps(1.0f), sumAVX(_mm256_mul_ps(c0, r0)));
+        r0 = _mm256_mul_ps(r0, inverseDeterminant);
+        r1 = _mm256_mul_ps(r1, inverseDeterminant);
+        r2 = _mm256_mul_ps(r2, inverseDeterminant);
+
+        ObjectTransform &first = transforms[i], &second = transforms[i + 1];
+        _mm_storeu_ps(&first.normal[0][0], _mm256_castps256_ps128(r0));
+        _mm_storeu_ps(&first.normal[1][0], _mm256_castps256_ps128(r1));
+        _mm_storeu_ps(&first.normal[2][0], _mm256_castps256_ps128(r2));
+        _mm_storeu_ps(&first.normal[3][0], lastColumn);
+        _mm_storeu_ps(&second.normal[0][0], _mm256_extractf128_ps(r0, 1));
+        _mm_storeu_ps(&second.normal[1][0], _mm256_extractf128_ps(r1, 1));
+        _mm_storeu_ps(&second.normal[2][0], _mm256_extractf128_ps(r2, 1));
+        _mm_storeu_ps(&second.normal[3][0], lastColumn);
+    }
+
+    if(pairs < count)
+        ComputeTransformsSSE(viewProjection, models + pairs, count - pairs, transforms + pairs);
+    return count;
+}
+#endif
+
+// computes with the widest kernel the build supports. transforms must hold count entries
+inline unsigned int ComputeTransforms(const glm::mat4 &viewProjection, const glm::mat4 *models, unsigned int count, ObjectTransform *transforms)
+{
+#if defined(FRUSTUM_AVX)
+    return ComputeTransformsAVX(viewProjection, models, count, transforms);
+#elif defined(FRUSTUM_SSE)
+    return ComputeTransformsSSE(viewProjection, models, count, transforms);
+#else
+    return ComputeTransformsScalar(viewProjection, models, count, transforms);
+#endif
+}
+
+inline unsigned int ComputeTransforms(const glm::mat4 &viewProjection, const vector<glm::mat4> &models, vector<ObjectTransform> &transforms)
+{
+    PROFILE_ZONE("ComputeTransforms");
+    transforms.resize(models.size());
+    return models.size() ? ComputeTransforms(viewProjection, &models[0], models.size(), &transforms[0]) : 0;
+}
+
+// the uniforms of a program drawing one object (see modelShader.vs); the program must be in use
+inline void SetTransform(const Shader &shader, const ObjectTransform &transform)
+{
+    // called for every draw, so the names are hashed at compile time whatever the optimisation level
+    static constexpr UniformName modelViewProjection("modelViewProjection"), model("model"), normalMatrix("normalMatrix");
+    shader.setMat4(modelViewProjection, transform.modelViewProjection);
+    shader.setMat4(model, transform.model);
+    shader.setMat3(normalMatrix, glm::mat3(transform.normal));
+}
+#endif
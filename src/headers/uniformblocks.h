@@ -0,0 +1,175 @@
+#ifndef UNIFORMBLOCKS_H
+#define UNIFORMBLOCKS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <ringbuffer.h>
+#include <shader.h>
+#include <shadervariants.h>
+
+#include <cstring>
+
+// binding points shared by every program, so each block is bound once per frame instead of per shader
+enum UniformBlockBinding
+{
+    CAMERA_BLOCK_BINDING = 0,
+    LIGHTS_BLOCK_BINDING = 1,
+    CLUSTERS_BLOCK_BINDING = 2,
+    SHADOWS_BLOCK_BINDING = 3
+};
+
+// must match MAX_POINT_LIGHTS in src/shaders/lights.glsl; a permutation's NR_POINT_LIGHTS says how many of them it shades
+const unsigned int MAX_POINT_LIGHTS = 4;
+
+// must match SHADOW_CASCADES in src/shaders/shadows.glsl
+const unsigned int MAX_SHADOW_CASCADES = 4;
+
+// the structs below mirror the std140 layout of the blocks declared in src/shaders/.
+// a vec3 is aligned to 16 bytes, but a following float can sit in its fourth component.
+
+// uniform Camera
+struct CameraBlock
+{
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 viewPos;
+    float     pad0;
+};
+
+struct DirLightBlock
+{
+    glm::vec3 direction;
+    float     pad0;
+    glm::vec3 ambient;
+    float     pad1;
+    glm::vec3 diffuse;
+    float     pad2;
+    glm::vec3 specular;
+    float     pad3;
+};
+
+struct PointLightBlock
+{
+    glm::vec3 position;
+    float     pad0;
+    glm::vec3 ambient;
+    float     pad1;
+    glm::vec3 diffuse;
+    float     pad2;
+    glm::vec3 specular;
+    float     constant;
+    float     linear;
+    float     quadratic;
+    float     pad3[2];
+};
+
+struct SpotLightBlock
+{
+    glm::vec3 position;
+    float     pad0;
+    glm::vec3 direction;
+    float     innerCutOff;
+    float     outerCutOff;
+    float     pad1[3];
+    glm::vec3 ambient;
+    float     pad2;
+    glm::vec3 diffuse;
+    float     pad3;
+    glm::vec3 specular;
+    float     constant;
+    float     linear;
+    float     quadratic;
+    float     pad4[2];
+};
+
+// uniform Lights
+struct LightsBlock
+{
+    DirLightBlock   dirLight;
+    PointLightBlock pointLights[MAX_POINT_LIGHTS];
+    SpotLightBlock  spotLight;
+};
+
+// uniform Clusters (see clusteredlights.h)
+struct ClustersBlock
+{
+    glm::uvec4 grid;  // clusters along x, y and z
+    glm::vec4  scale; // clusters per pixel in x and y, then the log2 depth to slice scale and bias
+};
+
+// uniform Shadows (see shadowmaps.h)
+struct ShadowsBlock
+{
+    glm::mat4 cascades[MAX_SHADOW_CASCADES]; // world space to shadow map coordinates and depth, all in [0, 1]
+    glm::vec4 splits;                        // view depth each cascade ends at
+    glm::vec4 normalOffsets;                 // world distance lookups are pushed along the normal, per cascade
+};
+
+static_assert(sizeof(CameraBlock) == 144, "CameraBlock doesn't match the std140 layout");
+static_assert(sizeof(DirLightBlock) == 64, "DirLightBlock doesn't match the std140 layout");
+static_assert(sizeof(PointLightBlock) == 80, "PointLightBlock doesn't match the std140 layout");
+static_assert(sizeof(SpotLightBlock) == 112, "SpotLightBlock doesn't match the std140 layout");
+static_assert(sizeof(LightsBlock) == 496, "LightsBlock doesn't match the std140 layout");
+static_assert(sizeof(ClustersBlock) == 32, "ClustersBlock doesn't match the std140 layout");
+static_assert(sizeof(ShadowsBlock) == 288, "ShadowsBlock doesn't match the std140 layout");
+
+// CPU copy of the per-frame camera and lighting data. filled in by the render loop, then
+// uploaded once per frame and shared by every program through fixed binding points.
+class FrameUniforms
+{
+    public:
+        CameraBlock camera;
+        LightsBlock lights;
+        ClustersBlock clusters;
+        ShadowsBlock shadows;
+
+        FrameUniforms()
+        {
+            memset(&camera, 0, sizeof(camera));
+            memset(&lights, 0, sizeof(lights));
+            memset(&clusters, 0, sizeof(clusters));
+            memset(&shadows, 0, sizeof(shadows)); // no cascades: everything lit
+
+            // unused lights still need a sane attenuation
+            for(unsigned int i = 0; i < MAX_POINT_LIGHTS; i++)
+                lights.pointLights[i].constant = 1.0f;
+            lights.spotLight.constant = 1.0f;
+        }
+
+        // connects the shader's blocks to the shared binding points; call once after building a program
+        static void BindBlocks(const Shader &shader)
+        {
+            shader.bindUniformBlock("Camera", CAMERA_BLOCK_BINDING);
+            shader.bindUniformBlock("Lights", LIGHTS_BLOCK_BINDING);
+            shader.bindUniformBlock("Clusters", CLUSTERS_BLOCK_BINDING);
+            shader.bindUniformBlock("Shadows", SHADOWS_BLOCK_BINDING);
+        }
+
+        static void BindBlocks(ShaderVariants &variants)
+        {
+            variants.bindUniformBlock("Camera", CAMERA_BLOCK_BINDING);
+            variants.bindUniformBlock("Lights", LIGHTS_BLOCK_BINDING);
+            variants.bindUniformBlock("Clusters", CLUSTERS_BLOCK_BINDING);
+            variants.bindUniformBlock("Shadows", SHADOWS_BLOCK_BINDING);
+        }
+
+        // streams the blocks through this frame's ring buffer region and binds them
+        void Upload(RingBuffer &ring)
+        {
+            upload(ring, CAMERA_BLOCK_BINDING, &camera, sizeof(camera));
+            upload(ring, LIGHTS_BLOCK_BINDING, &lights, sizeof(lights));
+            upload(ring, CLUSTERS_BLOCK_BINDING, &clusters, sizeof(clusters));
+            upload(ring, SHADOWS_BLOCK_BINDING, &shadows, sizeof(shadows));
+        }
+
+    private:
+        void upload(RingBuffer &ring, unsigned int binding, const void *data, GLsizeiptr size)
+        {
+            GLintptr offset = ring.Upload(data, size, ring.uniformAlignment);
+            if(offset >= 0)
+                glBindBufferRange(GL_UNIFORM_BUFFER, binding, ring.ID, offset, size);
+        }
+};
+#endif
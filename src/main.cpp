@@ -7,9 +7,33 @@
 
 #include <shader.h>
 #include <camera.h>
+#include <camerapath.h>
 #include <model.h>
+#include <batch.h>
+#include <ringbuffer.h>
+#include <uniformblocks.h>
+#include <frustum.h>
+#include <occlusion.h>
+#include <occlusionquery.h>
+#include <depthprepass.h>
+#include <dynamicresolution.h>
+#include <framescheduler.h>
+#include <commandlist.h>
+#include <glbackend.h>
+#include <shadervariants.h>
+#include <shaderwatcher.h>
+#include <clusteredlights.h>
+#include <gbuffer.h>
+#include <lightculling.h>
+#include <shadowmaps.h>
+#include <transforms.h>
+#include <parallel.h>
+#include <profiler.h>
 
+#include <cstring>
 #include <iostream>
+#include <random>
+#include <unistd.h>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
@@ -20,12 +44,41 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 
 void escInput(GLFWwindow* window);
 void tabInput(GLFWwindow* window);
-void cameraInput(GLFWwindow* window);
+void batchInput(GLFWwindow* window);
+void occlusionInput(GLFWwindow* window);
+void queryInput(GLFWwindow* window);
+void prePassInput(GLFWwindow* window);
+void commandListInput(GLFWwindow* window);
+void localLightsInput(GLFWwindow* window);
+void shadowCacheInput(GLFWwindow* window);
+void lightListsInput(GLFWwindow* window);
+void dynamicResolutionInput(GLFWwindow* window);
+void swapModeInput(GLFWwindow* window);
+void profileInput(GLFWwindow* window);
+void startProfile(unsigned int frames);
+void cameraInput(GLFWwindow* window, float timestep);
 
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
 
+// meshes covering less than this fraction of the screen height are culled
+const float MIN_SCREEN_SIZE = 0.002f;
+
+// meshes whose bounding sphere is at least this fraction of the largest one act as occluders
+const float OCCLUDER_SIZE = 0.25f;
+
+// small coloured point lights scattered around the model, shaded through the cluster lists
+const unsigned int SCENE_LIGHTS = 256;
+
+// frames of zones a capture records (t, or --profile from startup), written as Chrome trace JSON
+const unsigned int PROFILE_FRAMES = 120;
+const char *const PROFILE_PATH = "profile.json";
+
+// clip planes
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 100.0f;
+
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
 float lastX = SCR_WIDTH / 2.0f, lastY = SCR_HEIGHT / 2.0f;
@@ -35,11 +88,61 @@ bool firstMouse = true;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
+// frame pacing: the swap interval (cycled with v) and a frame rate cap (0 for none), both from the command line
+FrameScheduler::SwapMode swapMode = FrameScheduler::SWAP_VSYNC;
+bool swapModeChanged = false;
+double frameCap = 0.0;
+
+// frames to profile from the first one, from the command line
+unsigned int profileFrames = 0;
+
+// camera paths, relative to the repository root like the assets: --record writes the camera after every
+// fixed update on exit, --replay shows one of them per frame instead of input, then exits and writes the
+// frames' timings to the path with .csv appended, so two builds can be compared over the same views
+string recordPath, replayPath;
+
 // lighting
 glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
 
-int main()
+// draw submission
+bool useIndirect = true; // batch meshes into glMultiDrawElementsIndirect calls when supported
+bool useOcclusion = false; // hide meshes behind the occluders with the CPU occlusion buffer
+bool useQueries = false; // hardware occlusion queries against mesh bounding boxes
+bool useDepthPrePass = false; // depth-only pass first, then shade with GL_EQUAL
+bool useCommandLists = false; // per-mesh draws are recorded on worker threads and replayed on this one
+bool useLocalLights = true; // the scene's point lights, binned into clusters every frame
+bool useShadowCache = true; // keep shadow cascades between frames until the camera leaves them
+bool useLightLists = true; // each draw shades only the block's point lights and spot light that reach its bounds
+bool useDynamicResolution = true; // the scene is drawn at whatever fraction of the window holds its GPU time budget
+
+// shading, chosen at startup: forward (the model shaders light every fragment they draw), or deferred with
+// --deferred (the model is drawn into a G-buffer, then every pixel is lit once by a full screen pass)
+bool deferred = false;
+
+int main(int argc, char **argv)
 {
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--deferred") == 0)
+            deferred = true;
+        else if(strcmp(argv[i], "--swap") == 0 && i + 1 < argc)
+        {
+            const char *mode = argv[++i];
+            swapMode = strcmp(mode, "off") == 0 ? FrameScheduler::SWAP_OFF : strcmp(mode, "adaptive") == 0 ? FrameScheduler::SWAP_ADAPTIVE : FrameScheduler::SWAP_VSYNC;
+        }
+        else if(strcmp(argv[i], "--fps-cap") == 0 && i + 1 < argc)
+            frameCap = atof(argv[++i]);
+        else if(strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+            profileFrames = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            recordPath = argv[++i];
+        else if(strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+            replayPath = argv[++i];
+        else
+            std::cout << "Unknown option " << argv[i] << ", usage: Renderer [--deferred] [--swap vsync|adaptive|off] [--fps-cap fps] [--profile frames]"
+                      << " [--record path | --replay path]" << std::endl;
+    }
+
     chdir("..");
     #pragma region GLFW & GLAD Initialisation
     // ----------------- GLFW INIT -----------------
@@ -88,6 +191,33 @@ int main()
     }
 
 
+    // ----------------- FRAME PACING -----------------
+    // the camera moves in fixed timesteps and is drawn interpolated between them; the swap interval is set
+    // explicitly rather than left to the driver
+    FrameScheduler scheduler;
+    scheduler.frameCap = frameCap;
+    swapMode = scheduler.SetSwapMode(swapMode);
+    std::cout << "Frame pacing: " << 1.0 / scheduler.timestep << " Hz fixed updates, swap interval " << FrameScheduler::SwapModeName(swapMode)
+              << ", frame cap " << (frameCap > 0.0 ? std::to_string((int)frameCap) + " fps" : string("off")) << std::endl;
+
+    // ----------------- CAMERA PATHS -----------------
+    CameraPath cameraRecording((float)scheduler.timestep);
+    CameraReplay *replay = NULL;
+    if(!replayPath.empty())
+    {
+        replay = new CameraReplay();
+        if(!replay->path.Load(replayPath))
+        {
+            glfwTerminate();
+            return -1;
+        }
+
+        // the scene's resolution would follow each build's GPU time, and the views differ between them
+        useDynamicResolution = false;
+        std::cout << "Replaying " << replay->path.keys.size() << " camera keys from " << replayPath << ", recorded at "
+                  << 1.0f / replay->path.timestep << " Hz, one per frame; dynamic resolution off" << std::endl;
+    }
+
     // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
     stbi_set_flip_vertically_on_load(true);
 
@@ -99,12 +229,228 @@ int main()
 
     // build and compile shaders
     // -------------------------
-    Shader ourShader("modelShader.vs", "modelShader.fs");
+    // permutations are compiled the first time something draws with them. deferred shading draws the model
+    // into the G-buffer instead, and lights it in a full screen pass with the same lighting permutation
+    const char *modelFragment = deferred ? "gbuffer.fs" : "modelShader.fs";
+    ShaderVariants modelShaders("modelShader.vs", modelFragment);
+    ShaderVariants indirectShaders("modelShaderIndirect.vs", modelFragment);
+    ShaderVariants lightingShaders("fullscreen.vs", "deferred.fs");
+
+    // camera and lighting come from uniform blocks shared by every program
+    FrameUniforms::BindBlocks(modelShaders);
+    FrameUniforms::BindBlocks(indirectShaders);
+    FrameUniforms::BindBlocks(lightingShaders);
+
+    // every feature the scene uses (the directional light and its shadows, the block's point lights and the
+    // flashlight, and the scene lights through the cluster lists). forward draws take per-draw light lists for
+    // the block's lights; the deferred lighting pass has no draws to list them for and shades them everywhere.
+    // batched and recorded draws share one program across all meshes, so they get all of them; the per-mesh
+    // path drops what a mesh doesn't need
+    ShaderDefines sceneDefines;
+    sceneDefines.Set("NR_POINT_LIGHTS", MAX_POINT_LIGHTS).Set("SPOT_LIGHT").Set("SPECULAR_MAP").Set("CLUSTERED_LIGHTS").Set("SHADOWS");
+    if(!deferred)
+        sceneDefines.Set("LIGHT_LISTS");
+
+    Shader &ourShader = modelShaders.Get(sceneDefines);
+    Shader &indirectShader = indirectShaders.Get(sceneDefines);
+    Shader *lightingShader = deferred ? &lightingShaders.Get(sceneDefines) : NULL;
+
+    FrameUniforms frameUniforms;
+
+    // light properties
+    frameUniforms.lights.dirLight.direction = glm::vec3(0.4f, -1.0f, -0.3f);
+
+    frameUniforms.lights.dirLight.ambient = glm::vec3(0.1f, 0.1f, 0.1f);
+    frameUniforms.lights.dirLight.diffuse = glm::vec3(0.7f, 0.7f, 0.7f);
+    frameUniforms.lights.dirLight.specular = glm::vec3(0.5f, 0.5f, 0.5f);
 
     // load models
     // -----------
     Model ourModel("assets/backpack/backpack.obj");
 
+    // point lights of random colours in and around the model's bounds
+    AABB modelBounds = ourModel.meshes.empty() ? AABB() : ourModel.meshes[0].bounds;
+    for(unsigned int i = 1; i < ourModel.meshes.size(); i++)
+    {
+        modelBounds.min = glm::min(modelBounds.min, ourModel.meshes[i].bounds.min);
+        modelBounds.max = glm::max(modelBounds.max, ourModel.meshes[i].bounds.max);
+    }
+
+    std::mt19937 lightRng(42);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    vector<LocalLight> sceneLights(SCENE_LIGHTS), noLights;
+    for(unsigned int i = 0; i < SCENE_LIGHTS; i++)
+    {
+        LocalLight &light = sceneLights[i];
+        glm::vec3 offset(unit(lightRng), unit(lightRng), unit(lightRng));
+        light.position = modelBounds.min - 1.0f + offset * (modelBounds.max - modelBounds.min + 2.0f);
+
+        glm::vec3 colour = glm::normalize(glm::vec3(unit(lightRng), unit(lightRng), unit(lightRng)) + 0.05f);
+        light.diffuse = colour * 0.5f;
+        light.specular = colour * 0.2f;
+        light.quadratic = 20.0f; // a reach of about 3 units
+    }
+
+    // the block's point lights sit at the corners of the model, each reaching a part of it
+    const glm::vec3 pointColours[MAX_POINT_LIGHTS] = { glm::vec3(1.0f, 0.3f, 0.2f), glm::vec3(0.3f, 1.0f, 0.3f), glm::vec3(0.2f, 0.4f, 1.0f), glm::vec3(1.0f, 0.9f, 0.4f) };
+    for(unsigned int i = 0; i < MAX_POINT_LIGHTS; i++)
+    {
+        PointLightBlock &light = frameUniforms.lights.pointLights[i];
+        light.position = glm::vec3(i & 1 ? modelBounds.max.x : modelBounds.min.x, modelBounds.center().y, i & 2 ? modelBounds.max.z : modelBounds.min.z);
+        light.ambient = pointColours[i] * 0.02f;
+        light.diffuse = pointColours[i] * 0.8f;
+        light.specular = pointColours[i] * 0.4f;
+        light.constant = 1.0f;
+        light.linear = 0.0f;
+        light.quadratic = 40.0f; // a reach of about 2.8 units
+    }
+
+    // a flashlight held by the camera, placed every frame
+    SpotLightBlock &flashlight = frameUniforms.lights.spotLight;
+    flashlight.innerCutOff = glm::cos(glm::radians(12.5f));
+    flashlight.outerCutOff = glm::cos(glm::radians(17.5f));
+    flashlight.diffuse = glm::vec3(0.8f);
+    flashlight.specular = glm::vec3(0.5f);
+    flashlight.constant = 1.0f;
+    flashlight.linear = 0.7f;
+    flashlight.quadratic = 1.8f; // a reach of about 13.4 units
+
+    ClusteredLights clusteredLights;
+    ShadowMaps shadowMaps;
+    DrawLightLists drawLightLists;
+
+    // allocated like the dynamic resolution target, drawn at the scene's size
+    GBuffer gBuffer;
+
+    // the scene's size, from its GPU time; the window gets the upscaled result
+    DynamicResolution dynamicResolution;
+    std::cout << "Shading: " << (deferred ? "deferred, 8 byte G-buffer pixels plus depth" : "forward") << std::endl;
+    std::cout << "Clustered lighting: " << SCENE_LIGHTS << " point lights, " << ClusterParams::GRID_X << "x" << ClusterParams::GRID_Y << "x"
+              << ClusterParams::GRID_Z << " clusters" << std::endl;
+    std::cout << "Light lists: " << MAX_POINT_LIGHTS << " point lights and a flashlight reaching " << SpotLightRadius(flashlight) << " units, culled per draw "
+              << (deferred ? "(not in deferred shading, lit per pixel)" : "by their reach and cone") << std::endl;
+    std::cout << "Dynamic resolution: " << dynamicResolution.minScale << "x to " << dynamicResolution.maxScale << "x of the window for "
+              << dynamicResolution.targetMilliseconds << " ms of GPU time" << std::endl;
+    std::cout << "Shadow maps: " << ShadowMaps::CASCADES << " cascades of " << shadowMaps.resolution << "x" << shadowMaps.resolution
+              << " up to " << shadowMaps.shadowDistance << " units" << std::endl;
+
+    // transient per-frame uploads (uniform blocks, draw data, indirect commands) are streamed through here
+    RingBuffer frameData(4 * 1024 * 1024);
+    std::cout << "Frame ring buffer: " << (frameData.persistent ? "persistently mapped" : "orphaning fallback") << std::endl;
+
+    // pack the model's meshes into shared buffers for multi-draw indirect batching
+    DrawBatcher batcher;
+    batcher.Build(ourModel);
+
+    if(DrawBatcher::IsSupported())
+        std::cout << "Multi-draw indirect: " << ourModel.meshes.size() << " meshes in " << batcher.batches.size() << " batches" << std::endl;
+    else
+        std::cout << "Multi-draw indirect not supported, drawing meshes one at a time" << std::endl;
+
+    // designate the largest meshes as occluders for software occlusion culling
+    float largestRadius = 0.0f;
+    for(unsigned int i = 0; i < ourModel.meshes.size(); i++)
+        largestRadius = std::max(largestRadius, ourModel.meshes[i].sphere.radius);
+
+    unsigned int occluderCount = 0;
+    for(unsigned int i = 0; i < ourModel.meshes.size(); i++)
+    {
+        ourModel.meshes[i].occluder = ourModel.meshes[i].sphere.radius >= OCCLUDER_SIZE * largestRadius;
+        occluderCount += ourModel.meshes[i].occluder;
+    }
+
+    OcclusionBuffer occlusionBuffer;
+    std::cout << "Software occlusion: " << occluderCount << " occluder meshes, " << occlusionBuffer.width << "x" << occlusionBuffer.height
+              << " depth buffer on " << occlusionBuffer.threads << " threads" << std::endl;
+
+    OcclusionQueries occlusionQueries;
+    std::cout << "Hardware occlusion queries: conditional rendering " << (occlusionQueries.SupportsConditionalRender() ? "supported" : "not supported") << std::endl;
+
+    DepthPrePass depthPrePass;
+    std::cout << "Depth pre-pass: counting " << (depthPrePass.statistics ? "fragment shader invocations" : "samples passed (no pipeline statistics)") << std::endl;
+
+    // one command list per worker thread for the per-mesh path
+    vector<CommandList> commandLists(HardwareThreads());
+    MaterialLocations materialLocations(ourShader);
+
+    // edits to the model shaders are picked up while running
+    ShaderWatcher shaderWatcher;
+    shaderWatcher.Add(modelShaders);
+    shaderWatcher.Add(indirectShaders);
+    shaderWatcher.Add(lightingShaders);
+    std::cout << "Shader hot reload: " << (shaderWatcher.Notified() ? "inotify" : "polling file times") << std::endl;
+
+    // the permutation each mesh is drawn with on the per-mesh path, looked up on first use
+    vector<Shader*> meshShaders(ourModel.meshes.size(), (Shader*)NULL);
+    auto meshShader = [&](unsigned int i) -> Shader&
+    {
+        if(!meshShaders[i])
+        {
+            ShaderDefines defines = sceneDefines;
+            if(!ourModel.meshes[i].HasTexture("texture_specular"))
+                defines.Unset("SPECULAR_MAP");
+            meshShaders[i] = &modelShaders.Get(defines);
+        }
+        return *meshShaders[i];
+    };
+
+    // world space mesh bounds, per-mesh transforms and visibility, refreshed every frame
+    AABBSoA meshBounds;
+    vector<AABB> meshWorldBounds;
+    vector<glm::mat4> meshModels;
+    vector<ObjectTransform> meshTransforms;
+    vector<unsigned char> meshVisible;
+    vector<unsigned char> meshQueried, meshHeldBack;
+
+    // draws a mesh with its permutation, switching programs only when it differs from the last mesh's
+    Shader *boundShader = NULL;
+    auto drawMesh = [&](unsigned int i)
+    {
+        Shader &shader = meshShader(i);
+        if(&shader != boundShader)
+        {
+            shader.use();
+            shader.setFloat("material.shininess", 32.0f);
+            if(!deferred)
+            {
+                clusteredLights.Bind(shader);
+                shadowMaps.Bind(shader);
+            }
+            boundShader = &shader;
+        }
+        SetTransform(shader, meshTransforms[i]); // unchanged matrices are skipped by the uniform shadow copy
+        static constexpr UniformName drawLights("drawLights"); // hashed at compile time, as in SetTransform
+        if(!deferred)
+            shader.setInt(drawLights, drawLightLists.lists[i]);
+        ourModel.meshes[i].Draw(shader);
+    };
+
+    // startup cost of every program built so far, warm when the binaries came from the cache
+    ProgramCache::Stats &programStats = ProgramCache::stats();
+    std::cout << "Shader programs: " << programStats.hits + programStats.misses << " built in " << programStats.milliseconds << " ms ("
+              << programStats.hits << " from the binary cache, " << programStats.misses << " compiled, " << programStats.rejected << " binaries rejected"
+              << (ProgramCache::IsSupported() ? "" : ", program binaries not supported") << ")" << std::endl;
+
+    // frame stats, reported once a second
+    float statsTime = 0.0f;
+    unsigned int statsFrames = 0;
+    unsigned int statsUniformCalls = 0, statsUniformSkipped = 0;
+    unsigned int statsVisible = 0, statsCulled = 0, statsOccluded = 0;
+    unsigned int statsQueries = 0, statsPending = 0, statsSkipped = 0;
+    unsigned int statsLightsInView = 0, statsLitClusters = 0, statsLightEntries = 0, statsMaxClusterLights = 0;
+    unsigned int statsListedObjects = 0, statsListedPointLights = 0, statsListedSpotLights = 0;
+    // the shadow cascades keep their own, see ShadowMaps::stats
+    GLuint64 statsInvocations = 0;
+
+    // the camera's position before the latest fixed update, interpolated from
+    glm::vec3 previousCameraPosition = camera.Position;
+
+    // ----------------- PROFILER -----------------
+    // the render loop's thread in captures; --profile captures from the first frame
+    PROFILE_THREAD("main");
+    if(profileFrames)
+        startProfile(profileFrames);
+
     // render loop
     // -----------
     while (!glfwWindowShouldClose(window))
@@ -119,53 +465,401 @@ int main()
         // -----
         escInput(window);
         tabInput(window);
-        cameraInput(window);
+        batchInput(window);
+        occlusionInput(window);
+        queryInput(window);
+        prePassInput(window);
+        commandListInput(window);
+        localLightsInput(window);
+        shadowCacheInput(window);
+        lightListsInput(window);
+        dynamicResolutionInput(window);
+        swapModeInput(window);
+        profileInput(window);
+
+        if(swapModeChanged)
+        {
+            FrameScheduler::SwapMode applied = scheduler.SetSwapMode(swapMode);
+            std::cout << "Swap interval " << FrameScheduler::SwapModeName(applied) << (applied != swapMode ? " (adaptive not supported)" : "") << std::endl;
+            swapModeChanged = false;
+        }
+
+        // ----------------- FIXED UPDATES -----------------
+        // the simulation catches up with real time in whole timesteps; the frame is drawn at the camera
+        // position the right fraction of the way between the last two
+        unsigned int updates = scheduler.BeginFrame();
+        if(replay)
+        {
+            // the path moves the camera instead, a recorded update a frame and nothing to interpolate
+            replay->BeginFrame(camera);
+            previousCameraPosition = camera.Position;
+            updates = 0;
+        }
+        for(unsigned int u = 0; u < updates; u++)
+        {
+            PROFILE_ZONE("Fixed update");
+            previousCameraPosition = camera.Position;
+            cameraInput(window, (float)scheduler.timestep);
+            if(!recordPath.empty())
+                cameraRecording.Record(camera);
+        }
+
+        Camera frameCamera = camera;
+        frameCamera.Position = scheduler.Interpolate(previousCameraPosition, camera.Position);
+
+        // pick up edited shaders; a swapped program has new uniform locations
+        if(shaderWatcher.Update(deltaTime))
+            materialLocations = MaterialLocations(ourShader);
+
+        // wait for the GPU to release this frame's part of the ring buffer
+        frameData.BeginFrame();
+        if(frameData.frameStalls > 0)
+            std::cout << "Frame ring buffer: GPU lagging, stalled " << frameData.frameStallMs << " ms" << std::endl;
+
+        // ----------------- PER-FRAME UNIFORM BLOCKS -----------------
+        // projection transformations
+        frameUniforms.camera.projection = glm::perspective(glm::radians(frameCamera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, NEAR_PLANE, FAR_PLANE);
+
+        // view transformations
+        frameUniforms.camera.view = frameCamera.GetViewMatrix();
+
+        // view position
+        frameUniforms.camera.viewPos = frameCamera.Position;
+
+        // the flashlight follows the camera
+        flashlight.position = frameCamera.Position;
+        flashlight.direction = frameCamera.Front;
+
+        // ----------------- DYNAMIC RESOLUTION -----------------
+        // the size the scene is drawn at this frame, from the GPU times of the last few
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        dynamicResolution.enabled = useDynamicResolution;
+        dynamicResolution.Update(framebufferWidth, framebufferHeight);
+
+        // ----------------- CLUSTERED LIGHTS -----------------
+        // the point lights are binned into the clusters of this view; the tiles follow the scene's size
+        clusteredLights.Build(useLocalLights ? sceneLights : noLights, frameUniforms.camera.projection, frameUniforms.camera.view,
+                              dynamicResolution.width, dynamicResolution.height, NEAR_PLANE, FAR_PLANE);
+        clusteredLights.Upload();
+        frameUniforms.clusters = clusteredLights.block;
+
+        statsLightsInView += clusteredLights.lightsInView;
+        statsLitClusters += clusteredLights.occupiedClusters;
+        statsLightEntries += clusteredLights.lightIndices.size();
+        statsMaxClusterLights = std::max(statsMaxClusterLights, clusteredLights.maxClusterLights);
+
+        // model transformations
+        glm::mat4 model(1.0f);
+        model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f)); // translate it down so it's at the center of the scene
+        model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));	// it's a bit too big for our scene, so scale it down
+
+        // every mesh's matrices for the vertex shaders, once per frame in one batch
+        meshModels.assign(ourModel.meshes.size(), model);
+        ComputeTransforms(frameUniforms.camera.projection * frameUniforms.camera.view, meshModels, meshTransforms);
+
+        // ----------------- SHADOW CASCADES -----------------
+        // fitted to this view; only the cascades the camera left (or all, without caching) are redrawn below
+        shadowMaps.caching = useShadowCache;
+        shadowMaps.Update(frameUniforms.camera.projection, frameUniforms.camera.view, NEAR_PLANE, frameUniforms.lights.dirLight.direction,
+                          TransformAABB(modelBounds, model));
+        frameUniforms.shadows = shadowMaps.block;
+
+        // uploaded once, read by every program
+        frameUniforms.Upload(frameData);
+
+        // ----------------- FRUSTUM CULLING -----------------
+        // every mesh's world space box is tested against the camera frustum in one batch
+        meshBounds.clear();
+        meshWorldBounds.resize(ourModel.meshes.size());
+        for(unsigned int i = 0; i < ourModel.meshes.size(); i++)
+        {
+            meshWorldBounds[i] = TransformAABB(ourModel.meshes[i].bounds, model);
+            meshBounds.Add(meshWorldBounds[i]);
+        }
+
+        CullParams cullParams(frameUniforms.camera.projection, frameUniforms.camera.view, MIN_SCREEN_SIZE);
+        unsigned int visibleMeshes = CullAABBs(cullParams, meshBounds, meshVisible);
+
+        statsCulled += meshBounds.size() - visibleMeshes;
+
+        // ----------------- SHADOW MAPS -----------------
+        // the cascades Update chose are culled against their own frusta and redrawn from the position-only streams
+        shadowMaps.Render(ourModel, model, meshBounds);
 
         // render
         // ------
+        // everything from here to the upscale is drawn at the scene's size and timed. the shadow cascades above
+        // don't depend on it, and their own timers can't overlap this one
+        dynamicResolution.Begin();
         glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        // ----------------- OCCLUSION CULLING -----------------
+        // the visible occluders are rasterized on the CPU, then every other visible mesh is tested against them
+        if(useOcclusion)
+        {
+            PROFILE_ZONE("Occlusion culling");
+            occlusionBuffer.Begin(frameUniforms.camera.projection * frameUniforms.camera.view);
+            for(unsigned int i = 0; i < ourModel.meshes.size(); i++)
+            {
+                Mesh &mesh = ourModel.meshes[i];
+                if(mesh.occluder && meshVisible[i])
+                    occlusionBuffer.AddOccluder(&mesh.vertices[0].Position, sizeof(Vertex), mesh.vertices.size(), &mesh.indices[0], mesh.indices.size(), model);
+            }
+            occlusionBuffer.Rasterize();
+
+            // occluders stay visible; they would only be tested against themselves
+            for(unsigned int i = 0; i < ourModel.meshes.size(); i++)
+            {
+                if(meshVisible[i] && !ourModel.meshes[i].occluder && !occlusionBuffer.IsVisible(meshWorldBounds[i]))
+                {
+                    meshVisible[i] = 0;
+                    visibleMeshes--;
+                    statsOccluded++;
+                }
+            }
+        }
+
+        statsVisible += visibleMeshes;
+
+        // ----------------- LIGHT LISTS -----------------
+        // every visible mesh gets the point lights and flashlight that reach its world space box. built even
+        // when turned off, for the stats; the draws then get every light
+        drawLightLists.Build(frameUniforms.lights, MAX_POINT_LIGHTS, true, meshWorldBounds, &meshVisible);
+        if(!useLightLists)
+            drawLightLists.lists.assign(ourModel.meshes.size(), AllDrawLights(MAX_POINT_LIGHTS, true));
+
+        statsListedObjects += drawLightLists.objects;
+        statsListedPointLights += drawLightLists.pointLightsListed;
+        statsListedSpotLights += drawLightLists.spotLightsListed;
+
+        // ----------------- HARDWARE OCCLUSION QUERIES -----------------
+        // every mesh that survived culling gets a box query after the main pass; the ones last seen
+        // occluded are held back from it and drawn conditionally on their queries afterwards
+        if(useQueries)
+        {
+            occlusionQueries.Collect(ourModel.meshes.size());
+
+            meshQueried = meshVisible;
+            meshHeldBack.assign(ourModel.meshes.size(), 0);
+            for(unsigned int i = 0; i < ourModel.meshes.size(); i++)
+            {
+                if(!meshQueried[i])
+                {
+                    occlusionQueries.Invalidate(i);
+                }
+                else if(!occlusionQueries.WasVisible(i))
+                {
+                    meshHeldBack[i] = 1;
+                    meshVisible[i] = 0;
+                }
+            }
+        }
+
+        // ----------------- G-BUFFER -----------------
+        // in deferred mode every pass up to the lighting draws into the G-buffer, the pre-pass and queries included
+        if(deferred)
+        {
+            gBuffer.Resize(dynamicResolution.outputWidth, dynamicResolution.outputHeight, dynamicResolution.maxScale);
+            gBuffer.Begin(dynamicResolution.width, dynamicResolution.height);
+        }
+
+        // ----------------- DEPTH PRE-PASS -----------------
+        // depth from the position-only streams, so the main pass shades every pixel once
+        if(useDepthPrePass)
+            depthPrePass.Draw(ourModel, meshTransforms, meshVisible);
+
         // ----------------- RENDER MODEL -----------------
+        // falls back to the per-mesh loop when multi-draw indirect isn't available
+        bool indirect = useIndirect && DrawBatcher::IsSupported();
+
         // enable shader
-        ourShader.use();
+        Shader &activeShader = indirect ? indirectShader : ourShader;
+        activeShader.use();
 
-        // view position
-        ourShader.setVec3("viewPos", camera.Position);
+        // material properties
+        activeShader.setFloat("material.shininess", 32.0f);
+        if(!deferred)
+        {
+            clusteredLights.Bind(activeShader);
+            shadowMaps.Bind(activeShader);
+        }
 
-        // light properties
-        ourShader.setVec3("dirLight.direction", 0.4f, -1.0f, -0.3f);
+        // render the visible meshes of the model
+        depthPrePass.BeginMainPass(useDepthPrePass);
+        if(indirect)
+        {
+            batcher.Draw(indirectShader, meshTransforms, frameData, &meshVisible, &drawLightLists.lists);
+        }
+        else if(useCommandLists)
+        {
+            PROFILE_GPU_ZONE("Command lists");
 
-        ourShader.setVec3("dirLight.ambient", 0.1f, 0.1f, 0.1f);
-        ourShader.setVec3("dirLight.diffuse", 0.7f, 0.7f, 0.7f);
-        ourShader.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
+            // every thread records its own range of meshes, then the lists are replayed here in order
+            for(unsigned int t = 0; t < commandLists.size(); t++)
+                commandLists[t].clear();
 
-        // material properties
-        ourShader.setFloat("material.shininess", 32.0f);
+            ParallelFor(ourModel.meshes.size(), commandLists.size(), [&](unsigned int begin, unsigned int end, unsigned int thread)
+            {
+                PROFILE_ZONE("Record commands");
+                CommandList &list = commandLists[thread];
+                list.BindProgram(ourShader.ID);
+                for(unsigned int i = begin; i < end; i++)
+                {
+                    if(!meshVisible[i])
+                        continue;
 
+                    const ObjectTransform &transform = meshTransforms[i];
+                    list.SetMat4(materialLocations.modelViewProjection, transform.modelViewProjection);
+                    list.SetMat4(materialLocations.model, transform.model);
+                    list.SetMat3(materialLocations.normalMatrix, glm::mat3(transform.normal));
+                    list.SetInt(materialLocations.drawLights, drawLightLists.lists[i]);
+                    ourModel.meshes[i].Record(list, materialLocations);
+                }
+            });
 
-        // projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        ourShader.setMat4("projection", projection);
+            SubmitCommandLists(commandLists);
 
-        // view transformations
-        glm::mat4 view = camera.GetViewMatrix();
-        ourShader.setMat4("view", view);
+            // the replayed lists wrote ourShader's uniforms directly, so its shadow copy no longer holds
+            ourShader.InvalidateUniforms();
+        }
+        else
+        {
+            PROFILE_GPU_ZONE("Per-mesh draws");
+            boundShader = NULL;
+            for(unsigned int i = 0; i < ourModel.meshes.size(); i++)
+                if(meshVisible[i])
+                    drawMesh(i);
+        }
+        depthPrePass.EndMainPass();
 
-        // model transformations
-        glm::mat4 model(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f)); // translate it down so it's at the center of the scene
-        model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));	// it's a bit too big for our scene, so scale it down
-        ourShader.setMat4("model", model);
+        // box queries against the depth of the main pass, then the held back meshes under conditional rendering
+        if(useQueries)
+        {
+            PROFILE_GPU_ZONE("Occlusion queries");
+            occlusionQueries.BeginBoxes();
+            for(unsigned int i = 0; i < ourModel.meshes.size(); i++)
+                if(meshQueried[i])
+                    occlusionQueries.QueryBox(i, meshWorldBounds[i], frameCamera.Position, 0.1f);
+            occlusionQueries.EndBoxes();
+
+            boundShader = NULL;
+            for(unsigned int i = 0; i < ourModel.meshes.size(); i++)
+            {
+                if(meshHeldBack[i] && occlusionQueries.BeginConditional(i))
+                {
+                    drawMesh(i);
+                    occlusionQueries.EndConditional();
+                }
+            }
+
+            statsQueries += occlusionQueries.queriesIssued;
+            statsPending += occlusionQueries.resultsPending;
+            statsSkipped += occlusionQueries.drawsSkipped;
+        }
+
+        // ----------------- DEFERRED LIGHTING -----------------
+        // every pixel the model covers is lit once, from the G-buffer, into the window
+        if(deferred)
+        {
+            PROFILE_GPU_ZONE("Deferred lighting");
+            gBuffer.End();
+            lightingShader->use();
+            clusteredLights.Bind(*lightingShader);
+            shadowMaps.Bind(*lightingShader);
+            gBuffer.Resolve(*lightingShader, frameUniforms.camera.projection * frameUniforms.camera.view);
+        }
+
+        // ----------------- UPSCALE -----------------
+        dynamicResolution.End();
+
+        // fence this frame's uploads so the region isn't rewritten while the GPU reads it
+        frameData.EndFrame();
 
-        // render the model
-        ourModel.Draw(ourShader);
+        if(replay)
+        {
+            replay->EndFrame();
+            if(replay->Done())
+                glfwSetWindowShouldClose(window, true);
+        }
+
+        // ----------------- FRAME STATS -----------------
+        statsFrames++;
+        statsInvocations += depthPrePass.invocations;
+        statsUniformCalls += Shader::uniformCalls();
+        statsUniformSkipped += Shader::uniformCallsSkipped();
+        Shader::uniformCallsSkipped() = 0;
+        Shader::uniformCalls() = 0;
+
+        if(currentFrame - statsTime >= 1.0f)
+        {
+            std::cout << statsFrames << " fps, " << statsUniformCalls / statsFrames << " uniform uploads/frame (" << statsUniformSkipped / statsFrames << " unchanged, skipped), "
+                      << statsVisible / statsFrames << " visible / " << statsCulled / statsFrames << " culled / " << statsOccluded / statsFrames << " occluded meshes/frame" << std::endl;
+            std::cout << "Main pass: " << statsInvocations / statsFrames << (depthPrePass.statistics ? " fragment shader invocations" : " samples passed")
+                      << "/frame, depth pre-pass " << (useDepthPrePass ? "on" : "off") << std::endl;
+            if(useQueries)
+                std::cout << "Occlusion queries: " << statsQueries / statsFrames << " issued, " << statsPending / statsFrames << " results pending, "
+                          << statsSkipped / statsFrames << " draws skipped per frame" << std::endl;
+            if(useLocalLights)
+                std::cout << "Clustered lights: " << statsLightsInView / statsFrames << " of " << SCENE_LIGHTS << " in view, "
+                          << (statsLitClusters ? (float)statsLightEntries / statsLitClusters : 0.0f) << " per lit cluster (at most "
+                          << statsMaxClusterLights << ") in " << statsLitClusters / statsFrames << " lit clusters" << std::endl;
+            if(statsListedObjects)
+                std::cout << "Light lists " << (useLightLists ? "on" : "off") << ": " << (float)statsListedPointLights / statsListedObjects << " of "
+                          << MAX_POINT_LIGHTS << " point lights per drawn object, " << 100.0f * statsListedSpotLights / statsListedObjects
+                          << "% of them in the flashlight" << std::endl;
+            std::cout << "Dynamic resolution " << (useDynamicResolution ? "on" : "off") << ": " << dynamicResolution.width << "x" << dynamicResolution.height
+                      << " (" << dynamicResolution.scale << "x), " << dynamicResolution.gpuMilliseconds << " ms GPU at " << dynamicResolution.measuredScale
+                      << "x for a " << dynamicResolution.targetMilliseconds << " ms target, " << dynamicResolution.adjustments << " adjustments so far" << std::endl;
+            std::cout << "Frame times: " << scheduler.recent.Mean() << " ms mean, " << scheduler.recent.Jitter() << " ms jitter, median "
+                      << scheduler.recent.Percentile(0.5f) << " ms, 99th percentile " << scheduler.recent.Percentile(0.99f) << " ms, longest "
+                      << scheduler.recent.longest << " ms" << std::endl;
+            scheduler.recent.Reset();
+
+            // per cascade: how often it was redrawn this second, and what each redraw cost
+            for(unsigned int c = 0; c < ShadowMaps::CASCADES; c++)
+            {
+                const ShadowMaps::CascadeStats &cascade = shadowMaps.stats[c];
+                std::cout << "Shadow cascade " << c << ": " << cascade.renders << " renders, ";
+                if(cascade.renders)
+                    std::cout << cascade.casters / cascade.renders << " casters, " << cascade.cpuMilliseconds / cascade.renders << " ms CPU, "
+                              << (cascade.timed ? cascade.gpuMilliseconds / cascade.timed : 0.0) << " ms GPU each" << std::endl;
+                else
+                    std::cout << "cached" << std::endl;
+            }
+            shadowMaps.ResetStats();
+
+            statsTime = currentFrame;
+            statsFrames = 0;
+            statsUniformCalls = statsUniformSkipped = 0;
+            statsVisible = statsCulled = statsOccluded = 0;
+            statsQueries = statsPending = statsSkipped = 0;
+            statsLightsInView = statsLitClusters = statsLightEntries = statsMaxClusterLights = 0;
+            statsListedObjects = statsListedPointLights = statsListedSpotLights = 0;
+            statsInvocations = 0;
+        }
 
         // ----------------- SWAP BUFFERS AND POLL EVENTS --------------
-        glfwSwapBuffers(window);
+        // held back first if the frame rate is capped, so swaps are evenly spaced
+        scheduler.Limit();
+        {
+            PROFILE_ZONE("Swap buffers");
+            glfwSwapBuffers(window);
+        }
         glfwPollEvents();
+        PROFILE_FRAME();
     }
 
+    std::cout << "Frame times over " << scheduler.overall.frames << " frames: " << scheduler.overall.Mean() << " ms mean, " << scheduler.overall.Jitter()
+              << " ms jitter, 99th percentile " << scheduler.overall.Percentile(0.99f) << " ms" << std::endl;
+    scheduler.overall.Print(std::cout);
+
+    if(replay)
+        replay->Finish(replayPath + ".csv");
+    if(!recordPath.empty() && cameraRecording.Save(recordPath))
+        std::cout << "Camera path of " << cameraRecording.keys.size() << " updates written to " << recordPath << std::endl;
+
     glfwTerminate();
     return 0;
 }
@@ -199,16 +893,189 @@ void tabInput(GLFWwindow* window)
     tabPressedLastFrame = tabPressed;
 }
 
-void cameraInput(GLFWwindow* window)
+void batchInput(GLFWwindow* window)
+{
+    static bool bPressedLastFrame = false;
+    bool bPressed = glfwGetKey(window, GLFW_KEY_B);
+
+    // b to switch between multi-draw indirect batching and one draw per mesh
+    if(bPressed && !bPressedLastFrame)
+    {
+        useIndirect = !useIndirect;
+        std::cout << "Indirect batching " << (useIndirect ? "on" : "off") << std::endl;
+    }
+
+    bPressedLastFrame = bPressed;
+}
+
+void occlusionInput(GLFWwindow* window)
+{
+    static bool oPressedLastFrame = false;
+    bool oPressed = glfwGetKey(window, GLFW_KEY_O);
+
+    // o to toggle software occlusion culling
+    if(oPressed && !oPressedLastFrame)
+    {
+        useOcclusion = !useOcclusion;
+        std::cout << "Occlusion culling " << (useOcclusion ? "on" : "off") << std::endl;
+    }
+
+    oPressedLastFrame = oPressed;
+}
+
+void queryInput(GLFWwindow* window)
+{
+    static bool qPressedLastFrame = false;
+    bool qPressed = glfwGetKey(window, GLFW_KEY_Q);
+
+    // q to toggle hardware occlusion queries
+    if(qPressed && !qPressedLastFrame)
+    {
+        useQueries = !useQueries;
+        std::cout << "Occlusion queries " << (useQueries ? "on" : "off") << std::endl;
+    }
+
+    qPressedLastFrame = qPressed;
+}
+
+void prePassInput(GLFWwindow* window)
+{
+    static bool pPressedLastFrame = false;
+    bool pPressed = glfwGetKey(window, GLFW_KEY_P);
+
+    // p to toggle the depth pre-pass
+    if(pPressed && !pPressedLastFrame)
+    {
+        useDepthPrePass = !useDepthPrePass;
+        std::cout << "Depth pre-pass " << (useDepthPrePass ? "on" : "off") << std::endl;
+    }
+
+    pPressedLastFrame = pPressed;
+}
+
+void commandListInput(GLFWwindow* window)
+{
+    static bool lPressedLastFrame = false;
+    bool lPressed = glfwGetKey(window, GLFW_KEY_L);
+
+    // l to toggle recording per-mesh draws into command lists on worker threads (with indirect batching off)
+    if(lPressed && !lPressedLastFrame)
+    {
+        useCommandLists = !useCommandLists;
+        std::cout << "Command lists " << (useCommandLists ? "on" : "off") << std::endl;
+    }
+
+    lPressedLastFrame = lPressed;
+}
+
+void localLightsInput(GLFWwindow* window)
+{
+    static bool kPressedLastFrame = false;
+    bool kPressed = glfwGetKey(window, GLFW_KEY_K);
+
+    // k to toggle the scene's clustered point lights
+    if(kPressed && !kPressedLastFrame)
+    {
+        useLocalLights = !useLocalLights;
+        std::cout << "Clustered point lights " << (useLocalLights ? "on" : "off") << std::endl;
+    }
+
+    kPressedLastFrame = kPressed;
+}
+
+void shadowCacheInput(GLFWwindow* window)
+{
+    static bool cPressedLastFrame = false;
+    bool cPressed = glfwGetKey(window, GLFW_KEY_C);
+
+    // c to toggle keeping shadow cascades between frames
+    if(cPressed && !cPressedLastFrame)
+    {
+        useShadowCache = !useShadowCache;
+        std::cout << "Shadow cascade caching " << (useShadowCache ? "on" : "off") << std::endl;
+    }
+
+    cPressedLastFrame = cPressed;
+}
+
+void lightListsInput(GLFWwindow* window)
+{
+    static bool iPressedLastFrame = false;
+    bool iPressed = glfwGetKey(window, GLFW_KEY_I);
+
+    // i to toggle per-draw light lists, every draw shading all of the block's lights without them
+    if(iPressed && !iPressedLastFrame)
+    {
+        useLightLists = !useLightLists;
+        std::cout << "Per-draw light lists " << (useLightLists ? "on" : "off") << std::endl;
+    }
+
+    iPressedLastFrame = iPressed;
+}
+
+void dynamicResolutionInput(GLFWwindow* window)
+{
+    static bool rPressedLastFrame = false;
+    bool rPressed = glfwGetKey(window, GLFW_KEY_R);
+
+    // r to toggle dynamic resolution, drawing the scene at the window's full size without it
+    if(rPressed && !rPressedLastFrame)
+    {
+        useDynamicResolution = !useDynamicResolution;
+        std::cout << "Dynamic resolution " << (useDynamicResolution ? "on" : "off") << std::endl;
+    }
+
+    rPressedLastFrame = rPressed;
+}
+
+void swapModeInput(GLFWwindow* window)
+{
+    static bool vPressedLastFrame = false;
+    bool vPressed = glfwGetKey(window, GLFW_KEY_V);
+
+    // v to cycle the swap interval through vsync, adaptive vsync and off
+    if(vPressed && !vPressedLastFrame)
+    {
+        swapMode = (FrameScheduler::SwapMode)((swapMode + 1) % 3);
+        swapModeChanged = true;
+    }
+
+    vPressedLastFrame = vPressed;
+}
+
+void profileInput(GLFWwindow* window)
+{
+    static bool tPressedLastFrame = false;
+    bool tPressed = glfwGetKey(window, GLFW_KEY_T);
+
+    // t to capture the next frames' profiler zones
+    if(tPressed && !tPressedLastFrame)
+        startProfile(PROFILE_FRAMES);
+
+    tPressedLastFrame = tPressed;
+}
+
+void startProfile(unsigned int frames)
+{
+#ifdef RENDERER_PROFILER
+    PROFILE_CAPTURE(frames, PROFILE_PATH);
+    std::cout << "Profiling " << frames << " frames into " << PROFILE_PATH << std::endl;
+#else
+    std::cout << "Profiler not built in, configure with -DRENDERER_PROFILER=ON to capture " << frames << " frames" << std::endl;
+#endif
+}
+
+// one fixed update of the camera's movement
+void cameraInput(GLFWwindow* window, float timestep)
 {
     if(glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        camera.ProcessKeyboard(FORWARD, deltaTime);
+        camera.ProcessKeyboard(FORWARD, timestep);
     if(glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        camera.ProcessKeyboard(BACKWARD, deltaTime);
+        camera.ProcessKeyboard(BACKWARD, timestep);
     if(glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        camera.ProcessKeyboard(LEFT, deltaTime);
+        camera.ProcessKeyboard(LEFT, timestep);
     if(glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        camera.ProcessKeyboard(RIGHT, deltaTime);
+        camera.ProcessKeyboard(RIGHT, timestep);
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -0,0 +1,9 @@
+#version 330 core
+
+out vec4 FragColour;
+
+void main()
+{
+    // colour writes are masked off, only whether any sample passes the depth test matters
+    FragColour = vec4(1.0);
+}
\ No newline at end of file
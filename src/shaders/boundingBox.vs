@@ -0,0 +1,14 @@
+#version 330 core
+
+layout (location = 0) in vec3 aPos; // unit cube corner
+
+// world space box the unit cube is stretched over
+uniform vec3 boxMin;
+uniform vec3 boxSize;
+
+#include "camera.glsl"
+
+void main()
+{
+    gl_Position = projection * view * vec4(boxMin + aPos * boxSize, 1.0);
+}
\ No newline at end of file
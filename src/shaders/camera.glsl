@@ -0,0 +1,7 @@
+// per-frame camera data, shared by every program through CAMERA_BLOCK_BINDING (see uniformblocks.h)
+layout (std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos; // camera position
+};
\ No newline at end of file
@@ -0,0 +1,73 @@
+// clustered point and spot lights for CLUSTERED_LIGHTS permutations, assigned on the CPU by ClusteredLights
+// (clusteredlights.h). the view is cut into screen tiles and exponential depth slices, and every cluster
+// lists the lights reaching into it, so a fragment only visits those. needs the Camera block
+
+#define LOCAL_LIGHT_TEXELS 6
+
+layout (std140) uniform Clusters // per-frame, shared by every program through CLUSTERS_BLOCK_BINDING
+{
+    uvec4 clusterGrid;  // clusters along x, y and z
+    vec4  clusterScale; // clusters per pixel in x and y, then the log2 depth to slice scale and bias
+};
+
+uniform samplerBuffer  clusterLights;       // the lights in view, LOCAL_LIGHT_TEXELS texels each
+uniform usamplerBuffer clusterRanges;       // per cluster, its first entry and count in clusterLightIndices
+uniform usamplerBuffer clusterLightIndices; // every cluster's lights, one run per cluster
+
+struct LocalLight
+{
+    vec3 position;
+    float radius; // no light beyond this; the CPU binned it by the same bound
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+
+    float constant;
+    float linear;
+    float quadratic;
+
+    vec3 towardsLight; // spot lights: the negated spot direction
+    float coneScale;   // cone intensity is cos(angle) * coneScale + coneOffset; 0 and 1 for point lights
+    float coneOffset;
+};
+
+LocalLight FetchLocalLight(uint index)
+{
+    int texel = int(index) * LOCAL_LIGHT_TEXELS;
+    vec4 positionRadius = texelFetch(clusterLights, texel);
+    vec4 ambientConstant = texelFetch(clusterLights, texel + 1);
+    vec4 diffuseLinear = texelFetch(clusterLights, texel + 2);
+    vec4 specularQuadratic = texelFetch(clusterLights, texel + 3);
+    vec4 cone = texelFetch(clusterLights, texel + 4);
+
+    LocalLight light;
+    light.position = positionRadius.xyz;
+    light.radius = positionRadius.w;
+    light.ambient = ambientConstant.rgb;
+    light.constant = ambientConstant.w;
+    light.diffuse = diffuseLinear.rgb;
+    light.linear = diffuseLinear.w;
+    light.specular = specularQuadratic.rgb;
+    light.quadratic = specularQuadratic.w;
+    light.towardsLight = cone.xyz;
+    light.coneScale = cone.w;
+    light.coneOffset = texelFetch(clusterLights, texel + 5).x;
+    return light;
+}
+
+// the first entry and count of the lights in the cluster of a fragment (window position, world position)
+uvec2 ClusterLightRange(vec2 fragCoord, vec3 position)
+{
+    float depth = -(view * vec4(position, 1.0)).z;
+    ivec3 cell = ivec3(ivec2(fragCoord * clusterScale.xy), int(log2(depth) * clusterScale.z + clusterScale.w));
+    cell = clamp(cell, ivec3(0), ivec3(clusterGrid.xyz) - 1);
+
+    int cluster = (cell.z * int(clusterGrid.y) + cell.y) * int(clusterGrid.x) + cell.x;
+    return texelFetch(clusterRanges, cluster).xy;
+}
+
+LocalLight ClusterLight(uint entry)
+{
+    return FetchLocalLight(texelFetch(clusterLightIndices, int(entry)).r);
+}
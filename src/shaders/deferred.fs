@@ -0,0 +1,48 @@
+#version 330 core
+
+out vec4 FragColor;
+
+// lighting pass of deferred shading: one full screen triangle (fullscreen.vs) shading every covered pixel of
+// the G-buffer with the forward shaders' lighting. permutation defines as modelShader.fs:
+//   NR_POINT_LIGHTS  point lights shaded (the block always holds MAX_POINT_LIGHTS)
+//   SPOT_LIGHT       shade the spot light
+//   CLUSTERED_LIGHTS shade the point and spot lights of the pixel's cluster (clusters.glsl)
+//   SHADOWS          shadow the directional light with its cascades (shadows.glsl)
+//   SPECULAR_MAP     shade the stored specular intensity
+
+#include "camera.glsl"
+#include "gbuffer.glsl"
+#include "lighting.glsl"
+
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormalShininess;
+uniform sampler2D gDepth;
+
+uniform vec2 sceneSize;             // pixels drawn this frame, the lower left of the targets
+uniform mat4 inverseViewProjection; // from normalised device coordinates back to world space
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    if(depth == 1.0)
+        discard; // nothing was drawn here
+
+    vec4 albedoSpecular = texelFetch(gAlbedoSpecular, pixel, 0);
+    vec4 normalShininess = texelFetch(gNormalShininess, pixel, 0);
+
+    // world position reconstructed from the depth buffer
+    vec3 ndc = vec3(gl_FragCoord.xy / sceneSize, depth) * 2.0 - 1.0;
+    vec4 position = inverseViewProjection * vec4(ndc, 1.0);
+
+    Surface surface;
+    surface.normal = DecodeNormal(normalShininess.xy);
+    surface.position = position.xyz / position.w;
+    surface.viewDir = normalize(viewPos - surface.position);
+
+    surface.diffuse = albedoSpecular.rgb;
+    surface.specular = vec3(albedoSpecular.a);
+    surface.shininess = DecodeShininess(normalShininess.z);
+
+    FragColor = vec4(CalcLighting(surface), 1.0);
+}
\ No newline at end of file
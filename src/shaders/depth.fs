@@ -0,0 +1,6 @@
+#version 330 core
+
+void main()
+{
+    // depth only, colour writes are masked off
+}
\ No newline at end of file
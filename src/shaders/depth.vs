@@ -0,0 +1,13 @@
+#version 330 core
+
+layout (location = 0) in vec3 aPos; // position-only stream
+
+uniform mat4 modelViewProjection; // the same matrix the model shaders get, see transforms.h
+
+// must match the model shaders exactly for their GL_EQUAL depth test
+invariant gl_Position;
+
+void main()
+{
+    gl_Position = modelViewProjection * vec4(aPos, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,9 @@
+#version 330 core
+
+// one triangle covering the whole screen, made from gl_VertexID alone: draw 3 vertices with no attributes
+
+void main()
+{
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
\ No newline at end of file
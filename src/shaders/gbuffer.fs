@@ -0,0 +1,37 @@
+#version 330 core
+
+// geometry pass of deferred shading: the material is sampled once per pixel into the G-buffer, and lit
+// afterwards by deferred.fs. permutation defines, injected after #version by ShaderVariants:
+//   SPECULAR_MAP  the material has a specular texture; without one there is no specular term
+
+layout (location = 0) out vec4 AlbedoSpecular;  // diffuse colour, specular intensity
+layout (location = 1) out vec4 NormalShininess; // octahedral normal, shininess
+
+struct Material 
+{
+    sampler2D texture_diffuse1;
+    sampler2D texture_specular1;
+
+    float shininess;
+};
+
+in vec3 Normal; // normal of the fragment in world space
+in vec3 FragPos;
+in vec2 TexCoords;
+
+#include "gbuffer.glsl"
+
+uniform Material material;
+
+void main()
+{
+    AlbedoSpecular.rgb = vec3(texture(material.texture_diffuse1, TexCoords));
+#ifdef SPECULAR_MAP
+    // one channel; specular maps are grey
+    AlbedoSpecular.a = dot(vec3(texture(material.texture_specular1, TexCoords)), vec3(1.0 / 3.0));
+#else
+    AlbedoSpecular.a = 0.0;
+#endif
+
+    NormalShininess = vec4(EncodeNormal(normalize(Normal)), EncodeShininess(material.shininess), 0.0);
+}
\ No newline at end of file
@@ -0,0 +1,33 @@
+// packing of the deferred shading G-buffer (see gbuffer.h), shared by the pass writing it and the one reading it
+
+// shininess is stored as a fraction of this, in 10 bits
+#define MAX_SHININESS 256.0
+
+// octahedral normal: the unit sphere folded onto the [0, 1] square, two channels with an even spread of precision
+vec2 EncodeNormal(vec3 normal)
+{
+    normal /= abs(normal.x) + abs(normal.y) + abs(normal.z);
+    vec2 folded = normal.xy;
+    if(normal.z < 0.0)
+        folded = (1.0 - abs(normal.yx)) * vec2(normal.x >= 0.0 ? 1.0 : -1.0, normal.y >= 0.0 ? 1.0 : -1.0);
+    return folded * 0.5 + 0.5;
+}
+
+vec3 DecodeNormal(vec2 encoded)
+{
+    encoded = encoded * 2.0 - 1.0;
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float unfold = clamp(-normal.z, 0.0, 1.0);
+    normal.xy += vec2(normal.x >= 0.0 ? -unfold : unfold, normal.y >= 0.0 ? -unfold : unfold);
+    return normalize(normal);
+}
+
+float EncodeShininess(float shininess)
+{
+    return clamp(shininess / MAX_SHININESS, 0.0, 1.0);
+}
+
+float DecodeShininess(float encoded)
+{
+    return encoded * MAX_SHININESS;
+}
\ No newline at end of file
@@ -3,8 +3,8 @@
 layout (location = 0) in vec3 aPos; // position has attribute position 0
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+#include "camera.glsl"
 
 void main()
 {
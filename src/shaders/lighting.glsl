@@ -0,0 +1,183 @@
+// phong lighting for the lights in lights.glsl, from a surface the material has already been sampled into.
+// permutations without SPECULAR_MAP have no specular term and skip its cost
+
+#include "lights.glsl"
+
+#ifdef LIGHT_LISTS
+// the lights reaching the draw (DrawLightLists in lightculling.h): the number of point lights in bits 0-2,
+// their indices 2 bits each from bit 3, and the spot light in bit 11
+flat in int DrawLights;
+#endif
+
+struct Surface
+{
+    vec3 normal;   // normalised
+    vec3 position;
+    vec3 viewDir;  // towards the camera, normalised
+
+    vec3 diffuse;  // material colours
+    vec3 specular;
+    float shininess;
+};
+
+// specular shading
+float CalcSpecular(vec3 lightDir, Surface surface)
+{
+#ifdef SPECULAR_MAP
+    vec3 reflectDir = reflect(-lightDir, surface.normal);
+    return pow(max(dot(surface.viewDir, reflectDir), 0.0), surface.shininess);
+#else
+    return 0.0;
+#endif
+}
+
+float CalcAttenuation(vec3 lightPosition, float constant, float linear, float quadratic, Surface surface)
+{
+    float distance = length(lightPosition - surface.position);
+    return 1.0 / (constant + linear * distance + quadratic * (distance * distance));
+}
+
+vec3 CalcDirLight(DirLight light, Surface surface)
+{
+    vec3 lightDir = normalize(-light.direction);
+
+    // diffuse shading
+    float diff = max(dot(surface.normal, lightDir), 0.0);
+    // specular shading
+    float spec = CalcSpecular(lightDir, surface);
+
+    // combine results
+    vec3 ambient = light.ambient * surface.diffuse;
+
+    vec3 diffuse = light.diffuse * diff * surface.diffuse;
+
+    vec3 specular = light.specular * spec * surface.specular;
+
+#ifdef SHADOWS
+    // shadows leave ambient alone
+    float shadow = CalcShadow(surface.position, surface.normal);
+    diffuse *= shadow;
+    specular *= shadow;
+#endif
+
+    return (ambient + diffuse + specular);
+}
+
+vec3 CalcPointLight(PointLight light, Surface surface)
+{
+    vec3 lightDir = normalize(light.position - surface.position);
+
+    // diffuse shading
+    float diff = max(dot(surface.normal, lightDir), 0.0);
+    // specular shading
+    float spec = CalcSpecular(lightDir, surface);
+
+    // attenuation
+    float attenuation = CalcAttenuation(light.position, light.constant, light.linear, light.quadratic, surface);
+
+    // combine results
+    vec3 ambient = light.ambient * surface.diffuse;
+
+    vec3 diffuse = light.diffuse * diff * surface.diffuse;
+
+    vec3 specular = light.specular * spec * surface.specular;
+
+    return (ambient + diffuse + specular) * attenuation;
+}
+
+vec3 CalcSpotLight(SpotLight light, Surface surface)
+{
+    vec3 lightDir = normalize(light.position - surface.position);
+
+    // diffuse shading
+    float diff = max(dot(surface.normal, lightDir), 0.0);
+    // specular shading
+    float spec = CalcSpecular(lightDir, surface);
+
+    // attenuation
+    float attenuation = CalcAttenuation(light.position, light.constant, light.linear, light.quadratic, surface);
+
+    // check if in the spotlight
+    float theta = dot(lightDir, normalize(-light.direction));
+    float epsilon = light.innerCutOff - light.outerCutOff;
+    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+
+    // combine results, leaving ambient unaffected by the cone
+    vec3 ambient = light.ambient * surface.diffuse;
+
+    vec3 diffuse = light.diffuse * diff * surface.diffuse * intensity;
+
+    vec3 specular = light.specular * spec * surface.specular * intensity;
+
+    return (ambient + diffuse + specular) * attenuation;
+}
+
+#ifdef CLUSTERED_LIGHTS
+// a point or spot light from the cluster lists, cut off at its radius
+vec3 CalcLocalLight(LocalLight light, Surface surface)
+{
+    vec3 toLight = light.position - surface.position;
+    float distance = length(toLight);
+    if(distance >= light.radius)
+        return vec3(0.0);
+
+    vec3 lightDir = toLight / distance;
+
+    // diffuse shading
+    float diff = max(dot(surface.normal, lightDir), 0.0);
+    // specular shading
+    float spec = CalcSpecular(lightDir, surface);
+
+    // attenuation
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+
+    // spot cone, always 1 for point lights
+    float intensity = clamp(dot(lightDir, light.towardsLight) * light.coneScale + light.coneOffset, 0.0, 1.0);
+
+    // combine results, leaving ambient unaffected by the cone
+    vec3 ambient = light.ambient * surface.diffuse;
+
+    vec3 diffuse = light.diffuse * diff * surface.diffuse * intensity;
+
+    vec3 specular = light.specular * spec * surface.specular * intensity;
+
+    return (ambient + diffuse + specular) * attenuation;
+}
+#endif
+
+// every light the permutation shades
+vec3 CalcLighting(Surface surface)
+{
+    // directional lighting
+    vec3 result = CalcDirLight(dirLight, surface);
+
+    // point lighting
+#if NR_POINT_LIGHTS > 0
+#ifdef LIGHT_LISTS
+    // only the ones listed for the draw
+    int pointCount = DrawLights & 7;
+    for(int i = 0; i < pointCount; i++)
+        result += CalcPointLight(pointLights[(DrawLights >> (3 + 2 * i)) & 3], surface);
+#else
+    for(int i = 0; i < NR_POINT_LIGHTS; i++)
+        result += CalcPointLight(pointLights[i], surface);
+#endif
+#endif
+
+    // spot lighting
+#ifdef SPOT_LIGHT
+#ifdef LIGHT_LISTS
+    if((DrawLights & 2048) != 0)
+#endif
+    result += CalcSpotLight(spotLight, surface);
+#endif
+
+    // clustered point and spot lighting: only the lights listed for the fragment's cluster
+#ifdef CLUSTERED_LIGHTS
+    uvec2 cluster = ClusterLightRange(gl_FragCoord.xy, surface.position);
+    for(uint i = 0u; i < cluster.y; i++)
+        result += CalcLocalLight(ClusterLight(cluster.x + i), surface);
+#endif
+
+    return result;
+}
\ No newline at end of file
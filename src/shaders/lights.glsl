@@ -0,0 +1,65 @@
+// light types and the per-frame Lights block, shared by every program through LIGHTS_BLOCK_BINDING.
+// the block always holds MAX_POINT_LIGHTS point lights (LightsBlock in uniformblocks.h mirrors it);
+// a permutation's NR_POINT_LIGHTS says how many of them it shades. CLUSTERED_LIGHTS permutations also
+// shade any number of point and spot lights from the cluster lists in clusters.glsl, and SHADOWS
+// permutations shadow the directional light with the cascades in shadows.glsl
+
+#ifndef NR_POINT_LIGHTS
+#define NR_POINT_LIGHTS 0
+#endif
+
+#define MAX_POINT_LIGHTS 4
+
+struct DirLight 
+{
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct PointLight
+{
+    vec3 position;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+struct SpotLight
+{
+    vec3 position;
+    vec3 direction;
+
+    float innerCutOff;
+    float outerCutOff;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+layout (std140) uniform Lights // per-frame lighting, shared by every program
+{
+    DirLight dirLight;
+    PointLight pointLights[MAX_POINT_LIGHTS];
+    SpotLight spotLight;
+};
+
+#ifdef CLUSTERED_LIGHTS
+#include "clusters.glsl"
+#endif
+
+#ifdef SHADOWS
+#include "shadows.glsl"
+#endif
\ No newline at end of file
@@ -2,14 +2,13 @@
 
 out vec4 FragColor;
 
-struct DirLight 
-{
-    vec3 direction;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
+// permutation defines, injected after #version by ShaderVariants:
+//   NR_POINT_LIGHTS  point lights shaded (the block always holds MAX_POINT_LIGHTS)
+//   SPOT_LIGHT       shade the spot light
+//   LIGHT_LISTS      shade only the point lights and spot light listed for the draw (lightculling.h)
+//   CLUSTERED_LIGHTS shade the point and spot lights of the fragment's cluster (clusters.glsl)
+//   SHADOWS          shadow the directional light with its cascades (shadows.glsl)
+//   SPECULAR_MAP     the material has a specular texture; without one there is no specular term
 
 struct Material 
 {
@@ -23,41 +22,26 @@ in vec3 Normal; // normal of the fragment in view space
 in vec3 FragPos; // position of the fragment in view space
 in vec2 TexCoords;
 
-uniform vec3 viewPos; // camera position
+#include "camera.glsl"
+#include "lighting.glsl"
 
-uniform DirLight dirLight;
 uniform Material material;
 
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
-
 void main()
 {    
-    // properties
-    vec3 norm = normalize(Normal);
-    vec3 viewDir = normalize(viewPos - FragPos);
-
-    // directional lighting
-    vec3 result = CalcDirLight(dirLight, norm, viewDir);
-
-    FragColor = vec4(result, 1.0);
-}
-
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
-{
-    vec3 lightDir = normalize(-light.direction);
-
-    // diffuse shading
-    float diff = max(dot(normal, lightDir), 0.0);
-    // specular shading
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-
-    // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
-
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
-
-    return (ambient + diffuse + specular);
+    // properties, with the material sampled once for every light
+    Surface surface;
+    surface.normal = normalize(Normal);
+    surface.position = FragPos;
+    surface.viewDir = normalize(viewPos - FragPos);
+
+    surface.diffuse = vec3(texture(material.texture_diffuse1, TexCoords));
+#ifdef SPECULAR_MAP
+    surface.specular = vec3(texture(material.texture_specular1, TexCoords));
+#else
+    surface.specular = vec3(0.0);
+#endif
+    surface.shininess = material.shininess;
+
+    FragColor = vec4(CalcLighting(surface), 1.0);
 }
\ No newline at end of file
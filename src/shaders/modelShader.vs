@@ -4,22 +4,35 @@ layout (location = 0) in vec3 aPos; // position has attribute position 0
 layout (location = 1) in vec3 aNormal; // normal has attribute position 1
 layout (location = 2) in vec2 aTexCoords; // texture coordinates has attribute position 2
 
+// per object, computed once on the CPU (ObjectTransform in transforms.h) instead of for every vertex
+uniform mat4 modelViewProjection;
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat3 normalMatrix; // inverse transpose of the model's upper 3x3
+
+#ifdef LIGHT_LISTS
+uniform int drawLights; // the lights reaching this object, packed (see lighting.glsl)
+flat out int DrawLights;
+#endif
 
 out vec3 Normal; // normal vector stored in vertex buffer
 out vec3 FragPos; // fragment position in world space
 out vec2 TexCoords; // texture coordinates
 
+// bit-identical depth to the depth pre-pass, so the main pass can test with GL_EQUAL
+invariant gl_Position;
+
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0); // apply transformation to position
+    gl_Position = modelViewProjection * vec4(aPos, 1.0); // apply transformation to position
 
     TexCoords = aTexCoords; // pass texture coordinates to fragment shader
 
-    // view space is used for consistency and because its faster to transform here than in fragment shader
-    FragPos = vec3(model * vec4(aPos, 1.0)); // view position of fragment
-    Normal = mat3(transpose(inverse(model))) * aNormal; // view position of normal
-                                                        // http://www.lighthouse3d.com/tutorials/glsl-12-tutorial/the-normal-matrix/
+#ifdef LIGHT_LISTS
+    DrawLights = drawLights;
+#endif
+
+    // world space is used for consistency and because its faster to transform here than in fragment shader
+    FragPos = vec3(model * vec4(aPos, 1.0)); // world position of fragment
+    Normal = normalMatrix * aNormal; // world space normal
+                                     // http://www.lighthouse3d.com/tutorials/glsl-12-tutorial/the-normal-matrix/
 }
\ No newline at end of file
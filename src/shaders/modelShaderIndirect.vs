@@ -0,0 +1,35 @@
+#version 330 core
+
+layout (location = 0) in vec3 aPos; // position has attribute position 0
+layout (location = 1) in vec3 aNormal; // normal has attribute position 1
+layout (location = 2) in vec2 aTexCoords; // texture coordinates has attribute position 2
+// per-draw matrices, picked by the draw's base instance (DrawData in batch.h, computed once on the CPU)
+layout (location = 3) in mat4 aModel;               // locations 3-6
+layout (location = 7) in mat4 aModelViewProjection; // locations 7-10
+layout (location = 11) in mat3 aNormalMatrix;       // locations 11-13, inverse transpose of the model's upper 3x3
+
+#ifdef LIGHT_LISTS
+layout (location = 14) in int aDrawLights; // the lights reaching this draw, packed (see lighting.glsl)
+flat out int DrawLights;
+#endif
+
+out vec3 Normal; // normal vector stored in vertex buffer
+out vec3 FragPos; // fragment position in world space
+out vec2 TexCoords; // texture coordinates
+
+// bit-identical depth to the depth pre-pass, so the main pass can test with GL_EQUAL
+invariant gl_Position;
+
+void main()
+{
+    gl_Position = aModelViewProjection * vec4(aPos, 1.0); // apply transformation to position
+
+    TexCoords = aTexCoords; // pass texture coordinates to fragment shader
+
+#ifdef LIGHT_LISTS
+    DrawLights = aDrawLights;
+#endif
+
+    FragPos = vec3(aModel * vec4(aPos, 1.0)); // world position of fragment
+    Normal = aNormalMatrix * aNormal; // world space normal
+}
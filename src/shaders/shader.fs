@@ -2,6 +2,15 @@
 
 out vec4 FragColour;
 
+// permutation defines, injected after #version by ShaderVariants:
+//   NR_POINT_LIGHTS  point lights shaded (the block always holds MAX_POINT_LIGHTS)
+//   SPOT_LIGHT       shade the spot light
+//   CLUSTERED_LIGHTS shade the point and spot lights of the fragment's cluster (clusters.glsl)
+//   SHADOWS          shadow the directional light with its cascades (shadows.glsl)
+
+// this material always has a specular map
+#define SPECULAR_MAP
+
 struct Material 
 {
     sampler2D diffuse;
@@ -10,166 +19,26 @@ struct Material
     float shininess;
 };
 
-struct DirLight 
-{
-    vec3 direction;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-struct PointLight
-{
-    vec3 position;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
-
-struct SpotLight
-{
-    vec3 position;
-    vec3 direction;
-
-    float innerCutOff;
-    float outerCutOff;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
-
-#define NR_POINT_LIGHTS 4
-
 in vec3 Normal; // normal of the fragment in view space
 in vec3 FragPos; // position of the fragment in view space
 in vec2 TexCoords;
 
 uniform Material material;
-uniform vec3 viewPos; // camera position
 
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLight;
-
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+#include "camera.glsl"
+#include "lighting.glsl"
 
 void main()
 {
     // properties
-    vec3 norm = normalize(Normal);
-    vec3 viewDir = normalize(viewPos - FragPos);
-
-    // directional lighting
-    vec3 result = vec3(0.0f);
-
-    result = CalcDirLight(dirLight, norm, viewDir);
-
-    // point lighting
-    /*
-    for(int i = 0; i < NR_POINT_LIGHTS; i++)
-        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
-    
-    // spot lighting
-    result += CalcSpotLight(spotLight, norm, FragPos, viewDir);
-    */
-
-    FragColour = vec4(result, 1.0f);
-}
-
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
-{
-    vec3 lightDir = normalize(-light.direction);
-
-    // diffuse shading
-    float diff = max(dot(normal, lightDir), 0.0);
-    // specular shading
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-
-    // combine results
-    vec3 ambient = light.ambient * texture(material.diffuse, TexCoords).rgb;
-
-    vec3 diffuse = light.diffuse * diff * texture(material.diffuse, TexCoords).rgb;
-
-    vec3 specular = light.specular * spec * texture(material.specular, TexCoords).rgb;
-
-    return (ambient + diffuse + specular);
-}
-
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
-{
-    vec3 lightDir = normalize(light.position - FragPos);
-
-    // diffuse shading
-    float diff = max(dot(normal, lightDir), 0.0);
-    // specular shading
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-
-    // combine results
-    vec3 ambient = light.ambient * texture(material.diffuse, TexCoords).rgb;
-
-    vec3 diffuse = light.diffuse * diff * texture(material.diffuse, TexCoords).rgb;
-
-    vec3 specular = light.specular * spec * texture(material.specular, TexCoords).rgb;
-
-    // attenuation
-    float distance = length(light.position - FragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
-
-    ambient *= attenuation;
-    diffuse *= attenuation;
-    specular *= attenuation;
-
-    return (ambient + diffuse + specular);
-}
-
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
-{
-        vec3 lightDir = normalize(light.position - FragPos);
-
-    // diffuse shading
-    float diff = max(dot(normal, lightDir), 0.0);
-    // specular shading
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-
-    // combine results
-    vec3 ambient = light.ambient * texture(material.diffuse, TexCoords).rgb;
-
-    vec3 diffuse = light.diffuse * diff * texture(material.diffuse, TexCoords).rgb;
-
-    vec3 specular = light.specular * spec * texture(material.specular, TexCoords).rgb;
-
-    // attenuation
-    float distance = length(light.position - FragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
-
-    ambient *= attenuation;
-    diffuse *= attenuation;
-    specular *= attenuation;
-
-    // check if in the spotlight
-    float theta = dot(lightDir, normalize(-light.direction));
-    float epsilon = light.innerCutOff - light.outerCutOff;
-    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+    Surface surface;
+    surface.normal = normalize(Normal);
+    surface.position = FragPos;
+    surface.viewDir = normalize(viewPos - FragPos);
 
-    // leave ambient unaffected
-    diffuse *= intensity;
-    specular *= intensity;
+    surface.diffuse = texture(material.diffuse, TexCoords).rgb;
+    surface.specular = texture(material.specular, TexCoords).rgb;
+    surface.shininess = material.shininess;
 
-    return (ambient + diffuse + specular);
+    FragColour = vec4(CalcLighting(surface), 1.0f);
 }
\ No newline at end of file
@@ -0,0 +1,11 @@
+#version 330 core
+
+layout (location = 0) in vec3 aPos; // position-only stream
+
+// shadow map pass: depth from the light, one cascade at a time (see shadowmaps.h)
+uniform mat4 modelViewProjection; // the cascade's light view projection times the model matrix
+
+void main()
+{
+    gl_Position = modelViewProjection * vec4(aPos, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+// cascaded shadows of the directional light for SHADOWS permutations, drawn on the CPU side by ShadowMaps
+// (shadowmaps.h). the cascade is picked by the fragment's view depth; nothing beyond the last one is shadowed.
+// needs the Camera block
+
+#include "camera.glsl"
+
+#define SHADOW_CASCADES 4
+
+layout (std140) uniform Shadows // per-frame, shared by every program through SHADOWS_BLOCK_BINDING
+{
+    mat4 shadowCascades[SHADOW_CASCADES]; // world space to shadow map coordinates and depth, all in [0, 1]
+    vec4 shadowSplits;                    // view depth each cascade ends at
+    vec4 shadowNormalOffsets;             // world distance lookups are pushed along the normal, per cascade
+};
+
+uniform sampler2DArrayShadow shadowMap; // a layer per cascade, compared and bilinearly filtered
+
+// how much of the directional light reaches the surface, 0 to 1
+float CalcShadow(vec3 position, vec3 normal)
+{
+    float depth = -(view * vec4(position, 1.0)).z;
+    int cascade = int(dot(step(shadowSplits, vec4(depth)), vec4(1.0))); // splits already passed
+    if(cascade >= SHADOW_CASCADES)
+        return 1.0;
+
+    // pushed off the surface against self shadowing
+    vec3 coords = (shadowCascades[cascade] * vec4(position + normal * shadowNormalOffsets[cascade], 1.0)).xyz;
+
+    // 3x3 filtered lookups
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for(int x = -1; x <= 1; x++)
+        for(int y = -1; y <= 1; y++)
+            lit += texture(shadowMap, vec4(coords.xy + vec2(x, y) * texel, float(cascade), coords.z));
+    return lit / 9.0;
+}
\ No newline at end of file